@@ -0,0 +1,234 @@
+#include "AdmissionControl.hpp"
+
+/* TokenBucket */
+void TokenBucket::Reset(const TokenBucketConfig& config, int64_t now_us)
+{
+    _config = config;
+    _units = (uint64_t)config.burst * _units_per_token;
+    _last_refill_time_us = now_us;
+}
+
+void TokenBucket::Refill(int64_t now_us)
+{
+    if (now_us <= _last_refill_time_us)
+    {
+        return;
+    }
+
+    uint64_t capacity = (uint64_t)_config.burst * _units_per_token;
+    uint64_t elapsed_us = now_us - _last_refill_time_us;
+    _last_refill_time_us = now_us;
+
+    // A bucket idle for longer than a full refill is simply full, this also keeps the product small
+    if (_config.rate_per_s == 0 || elapsed_us >= capacity / _config.rate_per_s)
+    {
+        _units = _config.rate_per_s == 0 ? _units : capacity;
+        return;
+    }
+
+    _units += elapsed_us * _config.rate_per_s;
+    if (_units > capacity)
+    {
+        _units = capacity;
+    }
+}
+
+bool TokenBucket::HasToken() const
+{
+    return _units >= _units_per_token;
+}
+
+void TokenBucket::Take()
+{
+    _units -= _units_per_token;
+}
+
+/* AdmissionControl */
+AdmissionControl::AdmissionControl(const Config& config)
+    : _config(config)
+{
+    _global_bucket.Reset(config.global, 0);
+}
+
+bool AdmissionControl::OnOpen(int socket_file_descriptor, uint32_t address, int64_t now_us)
+{
+    AddressEntry* address_entry = FindOrAddAddress(address, now_us);
+    if (address_entry)
+    {
+        address_entry->bucket.Refill(now_us);
+        if (!address_entry->bucket.HasToken())
+        {
+            _statistics.rejected_connection_count++;
+            return false;
+        }
+        address_entry->bucket.Take();
+    }
+
+    SocketEntry* socket_entry = FindSocket(socket_file_descriptor);
+    if (!socket_entry)
+    {
+        for (SocketEntry& entry : _sockets)
+        {
+            if (!entry.is_used)
+            {
+                socket_entry = &entry;
+                break;
+            }
+        }
+    }
+    else if (socket_entry->address_entry)
+    {
+        // The descriptor was reused without a close callback, drop the stale reference
+        socket_entry->address_entry->socket_count--;
+    }
+
+    if (!socket_entry)
+    {
+        // Still admitted, requests on it are only checked against the global budget
+        _statistics.untracked_socket_count++;
+        return true;
+    }
+
+    socket_entry->is_used = true;
+    socket_entry->socket_file_descriptor = socket_file_descriptor;
+    socket_entry->address_entry = address_entry;
+    socket_entry->bucket.Reset(_config.socket, now_us);
+    if (address_entry)
+    {
+        address_entry->socket_count++;
+    }
+    return true;
+}
+
+void AdmissionControl::OnClose(int socket_file_descriptor)
+{
+    SocketEntry* socket_entry = FindSocket(socket_file_descriptor);
+    if (!socket_entry)
+    {
+        return;
+    }
+
+    if (socket_entry->address_entry)
+    {
+        socket_entry->address_entry->socket_count--;
+    }
+    socket_entry->is_used = false;
+    socket_entry->address_entry = nullptr;
+}
+
+uint8_t AdmissionControl::Admit(int socket_file_descriptor, int64_t now_us)
+{
+    SocketEntry* socket_entry = FindSocket(socket_file_descriptor);
+    AddressEntry* address_entry = socket_entry ? socket_entry->address_entry : nullptr;
+
+    // Check every bucket before taking from any, a rejected request must not drain the shared ones
+    if (socket_entry)
+    {
+        socket_entry->bucket.Refill(now_us);
+        if (!socket_entry->bucket.HasToken())
+        {
+            _statistics.socket_limited_count++;
+            return ADMISSION_RESULT_SOCKET_LIMITED;
+        }
+    }
+
+    if (address_entry)
+    {
+        address_entry->bucket.Refill(now_us);
+        address_entry->last_seen_time_us = now_us;
+        if (!address_entry->bucket.HasToken())
+        {
+            _statistics.address_limited_count++;
+            return ADMISSION_RESULT_ADDRESS_LIMITED;
+        }
+    }
+
+    _global_bucket.Refill(now_us);
+    if (!_global_bucket.HasToken())
+    {
+        _statistics.global_limited_count++;
+        return ADMISSION_RESULT_GLOBAL_LIMITED;
+    }
+
+    if (socket_entry)
+    {
+        socket_entry->bucket.Take();
+    }
+    if (address_entry)
+    {
+        address_entry->bucket.Take();
+    }
+    _global_bucket.Take();
+
+    _statistics.admitted_count++;
+    return ADMISSION_RESULT_ADMITTED;
+}
+
+AdmissionControl::Statistics AdmissionControl::GetStatistics() const
+{
+    Statistics statistics = _statistics;
+    statistics.open_socket_count = 0;
+    statistics.tracked_address_count = 0;
+    for (const SocketEntry& entry : _sockets)
+    {
+        statistics.open_socket_count += entry.is_used ? 1 : 0;
+    }
+    for (const AddressEntry& entry : _addresses)
+    {
+        statistics.tracked_address_count += entry.is_used ? 1 : 0;
+    }
+    return statistics;
+}
+
+const AdmissionControl::Config& AdmissionControl::GetConfig() const
+{
+    return _config;
+}
+
+AdmissionControl::SocketEntry* AdmissionControl::FindSocket(int socket_file_descriptor)
+{
+    for (SocketEntry& entry : _sockets)
+    {
+        if (entry.is_used && entry.socket_file_descriptor == socket_file_descriptor)
+        {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+AdmissionControl::AddressEntry* AdmissionControl::FindOrAddAddress(uint32_t address, int64_t now_us)
+{
+    AddressEntry* replaced_entry = nullptr;
+    for (AddressEntry& entry : _addresses)
+    {
+        if (entry.is_used && entry.address == address)
+        {
+            entry.last_seen_time_us = now_us;
+            return &entry;
+        }
+
+        // Prefer a free slot, otherwise the address without open sockets that was seen longest ago
+        if (entry.is_used && entry.socket_count > 0)
+        {
+            continue;
+        }
+
+        if (!replaced_entry || (replaced_entry->is_used && (!entry.is_used || entry.last_seen_time_us < replaced_entry->last_seen_time_us)))
+        {
+            replaced_entry = &entry;
+        }
+    }
+
+    if (!replaced_entry)
+    {
+        return nullptr;
+    }
+
+    replaced_entry->is_used = true;
+    replaced_entry->address = address;
+    replaced_entry->socket_count = 0;
+    replaced_entry->last_seen_time_us = now_us;
+    replaced_entry->bucket.Reset(_config.address, now_us);
+    return replaced_entry;
+}
\ No newline at end of file
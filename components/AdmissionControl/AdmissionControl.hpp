@@ -0,0 +1,134 @@
+#ifndef ADMISSIONCONTROL_HPP
+#define ADMISSIONCONTROL_HPP
+
+// Token bucket admission control for the HTTP server. Every request or websocket frame must get a
+// token from its socket, its source address and the global budget before it is parsed.
+// This file has no ESP-IDF dependency: the caller passes the current time, so the limiter is
+// exercised on the host with simulated clocks as well.
+//
+// Not thread safe. On the device every call comes from the httpd task.
+//
+// OnOpen is the earliest point httpd offers. Over HTTPS esp_https_server calls it only after the
+// TLS handshake, so a refused connection has already cost its handshake.
+
+#include <cstddef>
+#include <cstdint>
+
+// Sized for the lwIP socket limit, httpd never has more connections open
+#ifndef ADMISSION_MAX_SOCKETS
+#define ADMISSION_MAX_SOCKETS 16
+#endif
+
+// Addresses are remembered after their sockets close, so reconnecting does not refill the bucket
+#ifndef ADMISSION_MAX_ADDRESSES
+#define ADMISSION_MAX_ADDRESSES 8
+#endif
+
+#ifndef ADMISSION_RESULT_ADMITTED
+#define ADMISSION_RESULT_ADMITTED 0
+#endif
+
+#ifndef ADMISSION_RESULT_SOCKET_LIMITED
+#define ADMISSION_RESULT_SOCKET_LIMITED 1
+#endif
+
+#ifndef ADMISSION_RESULT_ADDRESS_LIMITED
+#define ADMISSION_RESULT_ADDRESS_LIMITED 2
+#endif
+
+#ifndef ADMISSION_RESULT_GLOBAL_LIMITED
+#define ADMISSION_RESULT_GLOBAL_LIMITED 3
+#endif
+
+struct TokenBucketConfig
+{
+    uint32_t rate_per_s;
+    uint32_t burst;
+};
+
+/// @brief Fixed point token bucket, one token is 1000000 units so a refill of a single
+/// microsecond is never rounded away
+class TokenBucket
+{
+public:
+    /// @brief Start full so a new client can load a page without waiting
+    void Reset(const TokenBucketConfig& config, int64_t now_us);
+    void Refill(int64_t now_us);
+    bool HasToken() const;
+    void Take();
+
+private:
+    static constexpr uint64_t _units_per_token = 1000000;
+
+    TokenBucketConfig _config = {};
+    uint64_t _units = 0;
+    int64_t _last_refill_time_us = 0;
+};
+
+class AdmissionControl
+{
+public:
+    struct Config
+    {
+        TokenBucketConfig socket;
+        TokenBucketConfig address;
+        TokenBucketConfig global;
+    };
+
+    struct Statistics
+    {
+        uint32_t admitted_count;
+        uint32_t socket_limited_count;
+        uint32_t address_limited_count;
+        uint32_t global_limited_count;
+        uint32_t rejected_connection_count;
+        uint32_t untracked_socket_count;
+        uint32_t open_socket_count;
+        uint32_t tracked_address_count;
+    };
+
+    AdmissionControl(const Config& config);
+
+    /// @brief Track a new connection. Opening a connection costs a token of its address, which
+    /// stops a client from dodging the socket limit by reconnecting.
+    /// @param address IPv4 address, or a folded IPv6 address
+    /// @return False if the address is out of tokens and the connection should be refused
+    bool OnOpen(int socket_file_descriptor, uint32_t address, int64_t now_us);
+    void OnClose(int socket_file_descriptor);
+
+    /// @brief Take one token from the socket, its address and the global budget, or none of them
+    /// @return ADMISSION_RESULT_ADMITTED or the first bucket that was empty
+    uint8_t Admit(int socket_file_descriptor, int64_t now_us);
+
+    Statistics GetStatistics() const;
+    const Config& GetConfig() const;
+
+private:
+    struct AddressEntry
+    {
+        bool is_used;
+        uint32_t address;
+        uint32_t socket_count;
+        int64_t last_seen_time_us;
+        TokenBucket bucket;
+    };
+
+    struct SocketEntry
+    {
+        bool is_used;
+        int socket_file_descriptor;
+        AddressEntry* address_entry;
+        TokenBucket bucket;
+    };
+
+    Config _config;
+    TokenBucket _global_bucket;
+    SocketEntry _sockets[ADMISSION_MAX_SOCKETS] = {};
+    AddressEntry _addresses[ADMISSION_MAX_ADDRESSES] = {};
+    Statistics _statistics = {};
+
+    SocketEntry* FindSocket(int socket_file_descriptor);
+    AddressEntry* FindOrAddAddress(uint32_t address, int64_t now_us);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "ButtonDebouncer.hpp"
+
+ButtonDebouncer::ButtonDebouncer(uint32_t settle_time_us, bool is_leading_edge, bool is_active_low, int initial_level)
+    : _settle_time_us(settle_time_us), _is_leading_edge(is_leading_edge), _is_active_low(is_active_low), _stable_level(initial_level ? 1 : 0)
+{
+}
+
+uint8_t ButtonDebouncer::OnEdge(int64_t time_us)
+{
+    _last_edge_time_us = time_us;
+    if (_is_settling)
+    {
+        _bounce_count++;
+        return BUTTON_EVENT_NONE;
+    }
+
+    _is_settling = true;
+    _burst_start_time_us = time_us;
+    if (!_is_leading_edge)
+    {
+        return BUTTON_EVENT_NONE;
+    }
+
+    // Any edge out of a stable state can only be a move to the other level
+    _stable_level = !_stable_level;
+    return GetEventForLevel(_stable_level);
+}
+
+uint8_t ButtonDebouncer::OnSettled(int level, int64_t now_us)
+{
+    // An expiry queued before a later edge re-armed the timer
+    if (!_is_settling || now_us - _last_edge_time_us < (int64_t)_settle_time_us)
+    {
+        return BUTTON_EVENT_NONE;
+    }
+
+    _is_settling = false;
+    level = level ? 1 : 0;
+    if (level == _stable_level)
+    {
+        return BUTTON_EVENT_NONE;
+    }
+
+    _stable_level = level;
+    return GetEventForLevel(level);
+}
+
+int64_t ButtonDebouncer::GetBurstStartTime() const
+{
+    return _burst_start_time_us;
+}
+
+bool ButtonDebouncer::IsSettling() const
+{
+    return _is_settling;
+}
+
+bool ButtonDebouncer::IsPressed() const
+{
+    return GetEventForLevel(_stable_level) == BUTTON_EVENT_PRESSED;
+}
+
+uint32_t ButtonDebouncer::GetSettleTimeUs() const
+{
+    return _settle_time_us;
+}
+
+uint32_t ButtonDebouncer::GetBounceCount() const
+{
+    return _bounce_count;
+}
+
+uint8_t ButtonDebouncer::GetEventForLevel(int level) const
+{
+    bool is_pressed = _is_active_low ? level == 0 : level == 1;
+    return is_pressed ? BUTTON_EVENT_PRESSED : BUTTON_EVENT_RELEASED;
+}
\ No newline at end of file
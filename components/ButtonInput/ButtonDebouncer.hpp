@@ -0,0 +1,67 @@
+#ifndef BUTTONDEBOUNCER_HPP
+#define BUTTONDEBOUNCER_HPP
+
+// Timer driven debouncing of one button. This file has no ESP-IDF dependency: edges and timer
+// expiries are fed in with their timestamps, so tools/ButtonInputHost replays edge sequences on Linux.
+//
+// Every edge (re)arms a settle timer. When it expires the pin is read once:
+//  - leading edge mode reports the first edge of a burst immediately and only uses the settle
+//    read to catch up when the pin ended somewhere else (a tap shorter than the settle time)
+//  - trailing edge mode reports nothing until the pin was quiet for the settle time
+// Neither mode ever polls or busy waits.
+
+#include <cstdint>
+
+#ifndef BUTTON_EVENT_NONE
+#define BUTTON_EVENT_NONE 0
+#endif
+
+#ifndef BUTTON_EVENT_PRESSED
+#define BUTTON_EVENT_PRESSED 1
+#endif
+
+#ifndef BUTTON_EVENT_RELEASED
+#define BUTTON_EVENT_RELEASED 2
+#endif
+
+class ButtonDebouncer
+{
+public:
+    /// @param settle_time_us How long the pin must be quiet before it is read
+    /// @param is_leading_edge Report the first edge at once instead of after the settle time
+    /// @param is_active_low The pin reads 0 while the button is held (pull up wiring)
+    /// @param initial_level Pin level when the button was set up
+    ButtonDebouncer(uint32_t settle_time_us, bool is_leading_edge, bool is_active_low, int initial_level);
+
+    /// @brief An edge was seen by the interrupt. The caller must (re)arm the settle timer.
+    /// @return The event to act on, only ever set in leading edge mode
+    uint8_t OnEdge(int64_t time_us);
+
+    /// @brief The settle timer expired
+    /// @param level The pin level read now
+    /// @return BUTTON_EVENT_NONE if the pin is still bouncing or ended where it was reported
+    uint8_t OnSettled(int level, int64_t now_us);
+
+    /// @brief Time of the first edge of the current or last burst, the start of the latency measurement
+    int64_t GetBurstStartTime() const;
+    bool IsSettling() const;
+    bool IsPressed() const;
+    uint32_t GetSettleTimeUs() const;
+
+    /// @brief Edges that did not produce an event
+    uint32_t GetBounceCount() const;
+
+private:
+    uint32_t _settle_time_us;
+    bool _is_leading_edge;
+    bool _is_active_low;
+    int _stable_level;
+    bool _is_settling = false;
+    int64_t _burst_start_time_us = 0;
+    int64_t _last_edge_time_us = 0;
+    uint32_t _bounce_count = 0;
+
+    uint8_t GetEventForLevel(int level) const;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,237 @@
+#include "ButtonInput.hpp"
+#include <algorithm>
+
+const char* ButtonInput::_TAG = "ButtonInput";
+
+ButtonInput::ButtonInput(std::shared_ptr<LedControl> led)
+    : _led(led)
+{
+}
+
+ButtonInput::~ButtonInput()
+{
+    Stop();
+
+    for (size_t i = 0; i < _button_count; i++)
+    {
+        gpio_isr_handler_remove(_buttons[i]->pin);
+        esp_timer_delete(_buttons[i]->settle_timer);
+    }
+
+    if (_message_queue)
+    {
+        vQueueDelete(_message_queue);
+    }
+}
+
+esp_err_t ButtonInput::AddButton(gpio_num_t pin, bool is_active_low)
+{
+    if (_button_task || _button_count >= BUTTON_INPUT_MAX_BUTTONS)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    gpio_config_t pin_config = {
+        .pin_bit_mask = 1ULL << pin,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = is_active_low ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE,
+        .pull_down_en = is_active_low ? GPIO_PULLDOWN_DISABLE : GPIO_PULLDOWN_ENABLE,
+        .intr_type = GPIO_INTR_ANYEDGE
+    };
+    esp_err_t status = gpio_config(&pin_config);
+    if (status != ESP_OK)
+    {
+        ESP_LOGE(_TAG, "Failed to configure the button pin %d %s", pin, esp_err_to_name(status));
+        return status;
+    }
+
+    uint8_t index = _button_count;
+    _buttons[index].reset(new Button{
+        this,
+        index,
+        pin,
+        ButtonDebouncer(BUTTON_INPUT_SETTLE_MS * 1000, BUTTON_INPUT_LEADING_EDGE, is_active_low, gpio_get_level(pin)),
+        NULL
+    });
+
+    esp_timer_create_args_t timer_args = {
+        .callback = &SettleTimerStatic,
+        .arg = _buttons[index].get(),
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "button_settle",
+        .skip_unhandled_events = true
+    };
+    status = esp_timer_create(&timer_args, &_buttons[index]->settle_timer);
+    if (status != ESP_OK)
+    {
+        _buttons[index].reset();
+        return status;
+    }
+
+    _button_count++;
+    ESP_LOGI(_TAG, "Button %d on pin %d", index, pin);
+    return ESP_OK;
+}
+
+esp_err_t ButtonInput::Start()
+{
+    if (_button_task)
+    {
+        return ESP_OK;
+    }
+
+    if (!_message_queue)
+    {
+        _message_queue = xQueueCreate(_message_queue_length, sizeof(ButtonMessage));
+        if (!_message_queue)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    // Above httpd, a press must not wait behind a slow request
+    if (xTaskCreate(&ButtonTaskStatic, "button_input", 4096, this, 7, &_button_task) != pdPASS)
+    {
+        ESP_LOGE(_TAG, "Failed to create the button task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Another component may have installed the service already
+    esp_err_t status = gpio_install_isr_service(0);
+    if (status != ESP_OK && status != ESP_ERR_INVALID_STATE)
+    {
+        ESP_LOGE(_TAG, "Failed to install the GPIO ISR service %s", esp_err_to_name(status));
+        Stop();
+        return status;
+    }
+
+    for (size_t i = 0; i < _button_count; i++)
+    {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(gpio_isr_handler_add(_buttons[i]->pin, &EdgeIsrStatic, _buttons[i].get()));
+    }
+
+    ESP_LOGI(_TAG, "Started %d buttons, %s edge, settle time %d ms", _button_count, BUTTON_INPUT_LEADING_EDGE ? "leading" : "trailing", BUTTON_INPUT_SETTLE_MS);
+    return ESP_OK;
+}
+
+void ButtonInput::Stop()
+{
+    for (size_t i = 0; i < _button_count; i++)
+    {
+        gpio_isr_handler_remove(_buttons[i]->pin);
+        esp_timer_stop(_buttons[i]->settle_timer);
+    }
+
+    if (_button_task)
+    {
+        vTaskDelete(_button_task);
+        _button_task = NULL;
+    }
+}
+
+ButtonInput::Statistics ButtonInput::GetStatistics()
+{
+    std::lock_guard<std::mutex> lock(_statisticsMutex);
+    Statistics statistics = _statistics;
+    statistics.dropped_edge_count = _dropped_edge_count;
+    statistics.mean_latency_us = statistics.press_count == 0 ? 0 : _total_latency_us / statistics.press_count;
+    return statistics;
+}
+
+void ButtonInput::ButtonTask()
+{
+    ButtonMessage message;
+    while (true)
+    {
+        if (xQueueReceive(_message_queue, &message, portMAX_DELAY) != pdTRUE || message.button_index >= _button_count)
+        {
+            continue;
+        }
+
+        Button& button = *_buttons[message.button_index];
+        if (message.type == BUTTON_MESSAGE_EDGE)
+        {
+            // Every edge pushes the settle read further out, a bouncing contact keeps re-arming it
+            esp_timer_stop(button.settle_timer);
+            esp_timer_start_once(button.settle_timer, button.debouncer.GetSettleTimeUs());
+
+            // The debouncer belongs to this task, only the count is handed over to the readers
+            uint32_t bounce_count = button.debouncer.GetBounceCount();
+            uint8_t event = button.debouncer.OnEdge(message.time_us);
+            if (button.debouncer.GetBounceCount() != bounce_count)
+            {
+                std::lock_guard<std::mutex> lock(_statisticsMutex);
+                _statistics.bounce_count++;
+            }
+
+            if (event != BUTTON_EVENT_NONE)
+            {
+                HandleEvent(button, event, message.time_us);
+            }
+            continue;
+        }
+
+        uint8_t event = button.debouncer.OnSettled(gpio_get_level(button.pin), message.time_us);
+        if (event != BUTTON_EVENT_NONE)
+        {
+            HandleEvent(button, event, button.debouncer.GetBurstStartTime());
+        }
+    }
+}
+
+void ButtonInput::HandleEvent(Button& button, uint8_t event, int64_t edge_time_us)
+{
+    if (event == BUTTON_EVENT_RELEASED)
+    {
+        std::lock_guard<std::mutex> lock(_statisticsMutex);
+        _statistics.release_count++;
+        return;
+    }
+
+    // One step, a command arriving from httpd or MQTT meanwhile is not undone. The listeners of
+    // LedControl broadcast the new state before Toggle returns.
+    _led->Toggle();
+
+    uint32_t latency_us = esp_timer_get_time() - edge_time_us;
+    ESP_LOGI(_TAG, "Button %d pressed, applied and broadcast after %lu us", button.index, latency_us);
+
+    std::lock_guard<std::mutex> lock(_statisticsMutex);
+    _statistics.press_count++;
+    _statistics.last_latency_us = latency_us;
+    _statistics.min_latency_us = _statistics.press_count == 1 ? latency_us : std::min(_statistics.min_latency_us, latency_us);
+    _statistics.max_latency_us = std::max(_statistics.max_latency_us, latency_us);
+    _total_latency_us += latency_us;
+}
+
+/* Static Handler Wrapper */
+void IRAM_ATTR ButtonInput::EdgeIsrStatic(void* arg)
+{
+    // Only the timestamp is taken here, everything else runs in the button task
+    auto* button = reinterpret_cast<Button*>(arg);
+    ButtonMessage message = {BUTTON_MESSAGE_EDGE, button->index, esp_timer_get_time()};
+
+    BaseType_t is_higher_priority_task_woken = pdFALSE;
+    if (xQueueSendFromISR(button->owner->_message_queue, &message, &is_higher_priority_task_woken) != pdTRUE)
+    {
+        // The interrupt is the only writer
+        button->owner->_dropped_edge_count = button->owner->_dropped_edge_count + 1;
+    }
+
+    if (is_higher_priority_task_woken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+void ButtonInput::SettleTimerStatic(void* arg)
+{
+    auto* button = reinterpret_cast<Button*>(arg);
+    ButtonMessage message = {BUTTON_MESSAGE_SETTLED, button->index, esp_timer_get_time()};
+    xQueueSend(button->owner->_message_queue, &message, 0);
+}
+
+void ButtonInput::ButtonTaskStatic(void* parameters)
+{
+    auto* button_input = reinterpret_cast<ButtonInput*>(parameters);
+    button_input->ButtonTask();
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+#ifndef BUTTONINPUT_HPP
+#define BUTTONINPUT_HPP
+
+#include <driver/gpio.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <memory>
+#include <mutex>
+#include "LedControl.hpp"
+#include "ButtonDebouncer.hpp"
+
+#ifndef BUTTON_INPUT_MAX_BUTTONS
+#define BUTTON_INPUT_MAX_BUTTONS 4
+#endif
+
+#ifndef BUTTON_INPUT_SETTLE_MS
+#define BUTTON_INPUT_SETTLE_MS 30
+#endif
+
+// Act on the first edge of a press. Set to 0 on noisy wiring, a press is then reported
+// BUTTON_INPUT_SETTLE_MS later but a short glitch never toggles the LED.
+#ifndef BUTTON_INPUT_LEADING_EDGE
+#define BUTTON_INPUT_LEADING_EDGE 1
+#endif
+
+#ifndef BUTTON_MESSAGE_EDGE
+#define BUTTON_MESSAGE_EDGE 1
+#endif
+
+#ifndef BUTTON_MESSAGE_SETTLED
+#define BUTTON_MESSAGE_SETTLED 2
+#endif
+
+/// @brief Wall buttons that toggle the LED. The interrupt only timestamps the edge and queues it,
+/// a task debounces it with a one shot timer per button and issues the command through LedControl,
+/// so the dashboards are updated by the same state change listeners a websocket command triggers.
+class ButtonInput
+{
+public:
+    struct Statistics
+    {
+        uint32_t press_count;
+        uint32_t release_count;
+        uint32_t bounce_count;
+        uint32_t dropped_edge_count;
+        // From the interrupt to the LED being switched and the broadcast handed to every socket
+        uint32_t last_latency_us;
+        uint32_t min_latency_us;
+        uint32_t max_latency_us;
+        uint32_t mean_latency_us;
+    };
+
+private:
+    struct Button
+    {
+        ButtonInput* owner;
+        uint8_t index;
+        gpio_num_t pin;
+        ButtonDebouncer debouncer;
+        esp_timer_handle_t settle_timer;
+    };
+
+    struct ButtonMessage
+    {
+        uint8_t type;
+        uint8_t button_index;
+        int64_t time_us;
+    };
+
+    std::shared_ptr<LedControl> _led;
+    std::unique_ptr<Button> _buttons[BUTTON_INPUT_MAX_BUTTONS];
+    size_t _button_count = 0;
+    QueueHandle_t _message_queue = NULL;
+    TaskHandle_t _button_task = NULL;
+
+    // Written by the interrupt
+    volatile uint32_t _dropped_edge_count = 0;
+
+    // Written by the button task, read by whoever asks for the statistics
+    std::mutex _statisticsMutex;
+    Statistics _statistics = {};
+    uint64_t _total_latency_us = 0;
+
+    static constexpr size_t _message_queue_length = 32;
+
+    static const char* _TAG;
+
+    void ButtonTask();
+    void HandleEvent(Button& button, uint8_t event, int64_t edge_time_us);
+
+public:
+    ButtonInput(std::shared_ptr<LedControl> led);
+    ~ButtonInput();
+
+    /// @brief Configure a pin as a button input, call before Start
+    /// @param is_active_low The button pulls the pin to ground, the internal pull up is enabled
+    esp_err_t AddButton(gpio_num_t pin, bool is_active_low = true);
+
+    esp_err_t Start();
+    void Stop();
+
+    Statistics GetStatistics();
+
+    static void EdgeIsrStatic(void* arg);
+    static void SettleTimerStatic(void* arg);
+    static void ButtonTaskStatic(void* parameters);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,231 @@
+#include "GroupClock.hpp"
+#include <algorithm>
+
+GroupClock::GroupClock(int64_t leader_timeout_us)
+    : _leader_timeout_us(leader_timeout_us)
+{
+}
+
+void GroupClock::Reset(uint32_t own_id)
+{
+    _own_id = own_id;
+    FollowLeader(own_id);
+    _offset_us = 0;
+}
+
+bool GroupClock::OnBeacon(uint32_t sender_id, int64_t sender_group_time_us, int64_t receive_time_us)
+{
+    // A lower id takes over the leadership, a silent leader is replaced by whoever beacons next
+    bool is_new_leader = false;
+    bool is_leader_stale = receive_time_us - _leader_last_heard_time_us > _leader_timeout_us;
+    if (sender_id < _own_id && sender_id != _leader_id && (sender_id < _leader_id || is_leader_stale))
+    {
+        FollowLeader(sender_id);
+        is_new_leader = true;
+    }
+
+    if (sender_id != _leader_id)
+    {
+        return is_new_leader;
+    }
+    _leader_last_heard_time_us = receive_time_us;
+
+    // The transit delay only ever makes a sample smaller, so the largest recent sample is the best estimate
+    _offset_samples_us[_offset_sample_index] = sender_group_time_us - receive_time_us;
+    _offset_sample_index = (_offset_sample_index + 1) % GROUP_SYNC_OFFSET_SAMPLES;
+    _offset_sample_count = std::min<size_t>(_offset_sample_count + 1, GROUP_SYNC_OFFSET_SAMPLES);
+
+    _offset_us = *std::max_element(_offset_samples_us, _offset_samples_us + _offset_sample_count);
+    return is_new_leader;
+}
+
+bool GroupClock::IsLeader(int64_t now_us)
+{
+    if (_leader_id != _own_id && now_us - _leader_last_heard_time_us > _leader_timeout_us)
+    {
+        // The leader went away. We lead on with its time base, so the group time does not jump when a
+        // few beacons are lost in a row or the next leader takes over.
+        FollowLeader(_own_id);
+    }
+
+    return _leader_id == _own_id;
+}
+
+uint32_t GroupClock::GetLeaderId() const
+{
+    return _leader_id;
+}
+
+int64_t GroupClock::GetOffsetUs() const
+{
+    return _offset_us;
+}
+
+void GroupClock::FollowLeader(uint32_t leader_id)
+{
+    // Samples of the previous leader mean nothing against the new one, the offset is kept until the first beacon
+    _leader_id = leader_id;
+    _offset_sample_count = 0;
+    _offset_sample_index = 0;
+}
+
+/* SequenceTracker */
+bool SequenceTracker::Track(uint32_t sender_id, uint16_t boot_id, uint32_t sequence, int64_t now_us, uint32_t& output_lost_count)
+{
+    output_lost_count = 0;
+
+    SenderEntry* entry = nullptr;
+    SenderEntry* oldest_entry = &_senders[0];
+    for (SenderEntry& sender : _senders)
+    {
+        if (sender.is_used && sender.sender_id == sender_id)
+        {
+            entry = &sender;
+            break;
+        }
+
+        if (!sender.is_used || (oldest_entry->is_used && sender.last_heard_time_us < oldest_entry->last_heard_time_us))
+        {
+            oldest_entry = &sender;
+        }
+    }
+
+    if (entry && entry->boot_id != boot_id)
+    {
+        // Rebooted, its sequence starts over and the commands before the reboot are not lost
+        entry->boot_id = boot_id;
+    }
+    else if (entry)
+    {
+        int32_t sequence_gap = (int32_t)(sequence - entry->sequence);
+        if (sequence_gap <= 0)
+        {
+            // Repeated copy of a command already scheduled
+            return false;
+        }
+        output_lost_count = sequence_gap - 1;
+    }
+    else
+    {
+        // A forgotten sender starts over, the copies of its next command are still dropped
+        if (oldest_entry->is_used)
+        {
+            _eviction_count++;
+        }
+        entry = oldest_entry;
+        entry->is_used = true;
+        entry->sender_id = sender_id;
+        entry->boot_id = boot_id;
+    }
+
+    entry->sequence = sequence;
+    entry->last_heard_time_us = now_us;
+    return true;
+}
+
+void SequenceTracker::Clear()
+{
+    for (SenderEntry& sender : _senders)
+    {
+        sender.is_used = false;
+    }
+}
+
+size_t SequenceTracker::GetSenderCount() const
+{
+    size_t sender_count = 0;
+    for (const SenderEntry& sender : _senders)
+    {
+        sender_count += sender.is_used ? 1 : 0;
+    }
+    return sender_count;
+}
+
+uint32_t SequenceTracker::GetEvictionCount() const
+{
+    return _eviction_count;
+}
+
+/* ApplyQueue */
+bool ApplyQueue::Push(const PendingApply& apply)
+{
+    // Applying it now would undo a command that is due later
+    if (_has_applied && apply.group_deadline_us < _last_applied_group_deadline_us)
+    {
+        _dropped_count++;
+        return false;
+    }
+
+    size_t position = _count;
+    while (position > 0 && _applies[position - 1].group_deadline_us > apply.group_deadline_us)
+    {
+        position--;
+    }
+
+    if (_count == GROUP_SYNC_MAX_PENDING_APPLIES)
+    {
+        _dropped_count++;
+        if (position == 0)
+        {
+            return false;
+        }
+
+        // Make room by dropping the earliest
+        std::copy(_applies + 1, _applies + position, _applies);
+        position--;
+        _count--;
+    }
+    else
+    {
+        std::copy_backward(_applies + position, _applies + _count, _applies + _count + 1);
+    }
+
+    _applies[position] = apply;
+    _count++;
+    return true;
+}
+
+bool ApplyQueue::Peek(PendingApply& output_apply) const
+{
+    if (_count == 0)
+    {
+        return false;
+    }
+
+    output_apply = _applies[0];
+    return true;
+}
+
+void ApplyQueue::Pop()
+{
+    if (_count == 0)
+    {
+        return;
+    }
+
+    _has_applied = true;
+    _last_applied_group_deadline_us = _applies[0].group_deadline_us;
+    std::copy(_applies + 1, _applies + _count, _applies);
+    _count--;
+}
+
+void ApplyQueue::ForgetLastApplied()
+{
+    _has_applied = false;
+}
+
+void ApplyQueue::Clear()
+{
+    _count = 0;
+    _has_applied = false;
+}
+
+size_t ApplyQueue::GetCount() const
+{
+    return _count;
+}
+
+uint32_t ApplyQueue::GetDroppedCount() const
+{
+    return _dropped_count;
+}
\ No newline at end of file
@@ -0,0 +1,171 @@
+#ifndef GROUPCLOCK_HPP
+#define GROUPCLOCK_HPP
+
+// Wire format, leader clock, duplicate filter and apply queue of the group sync.
+// This file has no ESP-IDF dependency: the caller passes the local time, so several members can
+// run on one Linux host over loopback multicast in tools/GroupSyncHost.
+//
+// Not thread safe. GroupSync holds its state mutex around every call.
+
+#include <cstddef>
+#include <cstdint>
+
+/// @brief Wire format of the group sync packets. All fields are little endian.
+struct __attribute__((packed)) GroupSyncPacket
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t type;
+    uint16_t group_id;
+    uint32_t sender_id;
+    uint32_t sequence;
+    // Beacon: the group time at which the beacon was sent
+    int64_t sender_group_time_us;
+    // Command: group time at which every member applies the state. 0 => receipt time + lead time
+    int64_t deadline_group_time_us;
+    uint8_t state;
+    uint8_t reserved;
+    // Drawn at every boot. The sequence of a sender starts over when its boot id changes.
+    uint16_t boot_id;
+};
+static_assert(sizeof(GroupSyncPacket) == 36, "GroupSyncPacket layout is part of the wire protocol");
+
+#ifndef GROUP_SYNC_PACKET_MAGIC
+#define GROUP_SYNC_PACKET_MAGIC 0x5052474C // "LGRP"
+#endif
+
+#ifndef GROUP_SYNC_PACKET_BEACON
+#define GROUP_SYNC_PACKET_BEACON 1
+#endif
+
+#ifndef GROUP_SYNC_PACKET_COMMAND
+#define GROUP_SYNC_PACKET_COMMAND 2
+#endif
+
+// Beacons kept by the offset filter
+#ifndef GROUP_SYNC_OFFSET_SAMPLES
+#define GROUP_SYNC_OFFSET_SAMPLES 8
+#endif
+
+// Senders whose last sequence is remembered. Anyone on the LAN can send to the group, so the table is
+// fixed and the sender heard least recently is forgotten first.
+#ifndef GROUP_SYNC_MAX_SENDERS
+#define GROUP_SYNC_MAX_SENDERS 16
+#endif
+
+// Commands waiting for their deadline. Several members may send within one lead time.
+#ifndef GROUP_SYNC_MAX_PENDING_APPLIES
+#define GROUP_SYNC_MAX_PENDING_APPLIES 8
+#endif
+
+/// @brief Group time of a member: its own clock plus the offset towards the leader. The leader is
+/// the member with the lowest id that is still beaconing.
+class GroupClock
+{
+public:
+    /// @param leader_timeout_us A leader not heard from for this long is dropped
+    GroupClock(int64_t leader_timeout_us);
+
+    /// @brief Start over on our own clock, e.g. when the group changed
+    void Reset(uint32_t own_id);
+
+    /// @brief Take the leadership from a lower id and add an offset sample if the beacon came from the leader
+    /// @return True if the sender became the leader
+    bool OnBeacon(uint32_t sender_id, int64_t sender_group_time_us, int64_t receive_time_us);
+
+    /// @brief Whether this member is the leader. A stale leader is dropped, we lead on with the last offset.
+    bool IsLeader(int64_t now_us);
+
+    uint32_t GetLeaderId() const;
+    /// @brief Group time = local time + offset
+    int64_t GetOffsetUs() const;
+
+private:
+    int64_t _leader_timeout_us;
+    uint32_t _own_id = 0;
+    uint32_t _leader_id = 0;
+    int64_t _leader_last_heard_time_us = 0;
+    int64_t _offset_samples_us[GROUP_SYNC_OFFSET_SAMPLES] = {};
+    size_t _offset_sample_count = 0;
+    size_t _offset_sample_index = 0;
+    int64_t _offset_us = 0;
+
+    void FollowLeader(uint32_t leader_id);
+};
+
+/// @brief Last command sequence per sender, to drop the repeated copies and count lost commands
+class SequenceTracker
+{
+public:
+    /// @brief Record a command. A new boot id means the sender rebooted, its entry starts over.
+    /// @param output_lost_count Commands of this sender skipped since the previous one
+    /// @return False for a copy of a command already seen
+    bool Track(uint32_t sender_id, uint16_t boot_id, uint32_t sequence, int64_t now_us, uint32_t& output_lost_count);
+
+    void Clear();
+
+    size_t GetSenderCount() const;
+    /// @brief Senders forgotten to make room for another one
+    uint32_t GetEvictionCount() const;
+
+private:
+    struct SenderEntry
+    {
+        bool is_used;
+        uint32_t sender_id;
+        uint16_t boot_id;
+        uint32_t sequence;
+        int64_t last_heard_time_us;
+    };
+
+    SenderEntry _senders[GROUP_SYNC_MAX_SENDERS] = {};
+    uint32_t _eviction_count = 0;
+};
+
+/// @brief A command waiting for its deadline
+struct PendingApply
+{
+    int64_t group_deadline_us;
+    // Converted with the offset at the time the command arrived
+    int64_t local_deadline_us;
+    uint8_t state;
+};
+
+/// @brief Commands waiting for their deadline, applied in the order of their group deadlines.
+/// Whichever order the commands arrive in, every member ends on the state with the latest deadline.
+class ApplyQueue
+{
+public:
+    /// @brief Queue a command. When the queue is full the earliest command is dropped, it would be
+    /// overridden first anyway.
+    /// @return False if the command is dropped: its deadline is before the last applied one, or the
+    /// queue is full and every queued command is due after it
+    bool Push(const PendingApply& apply);
+
+    /// @brief The command with the earliest group deadline
+    /// @return False if the queue is empty
+    bool Peek(PendingApply& output_apply) const;
+
+    /// @brief Remove the command Peek returned, once it is applied
+    void Pop();
+
+    /// @brief The group time may have jumped, e.g. a new leader took over with its own clock. Deadlines
+    /// before the last applied one are accepted again.
+    void ForgetLastApplied();
+
+    void Clear();
+
+    size_t GetCount() const;
+    /// @brief Commands dropped by Push, or dropped from a full queue
+    uint32_t GetDroppedCount() const;
+
+private:
+    // Sorted by group deadline, commands with the same deadline in arrival order
+    PendingApply _applies[GROUP_SYNC_MAX_PENDING_APPLIES] = {};
+    size_t _count = 0;
+    bool _has_applied = false;
+    int64_t _last_applied_group_deadline_us = 0;
+    uint32_t _dropped_count = 0;
+};
+
+#endif
\ No newline at end of file
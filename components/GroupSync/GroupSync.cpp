@@ -0,0 +1,555 @@
+#include "GroupSync.hpp"
+#include <esp_mac.h>
+#include <esp_random.h>
+#include <nvs_flash.h>
+#include <nvs.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+
+const char* GroupSync::_TAG = "GroupSync";
+
+GroupSync::GroupSync(std::shared_ptr<LedControl> led)
+    : _led(led), _clock(3 * (int64_t)_beacon_interval_ms * 1000)
+{
+}
+
+GroupSync::~GroupSync()
+{
+    Stop();
+}
+
+esp_err_t GroupSync::Start()
+{
+    if (_receive_task)
+    {
+        ESP_LOGI(_TAG, "Group sync already started");
+        return ESP_OK;
+    }
+
+    // The lower half of the MAC identifies the member and orders the leader election
+    uint8_t mac[6] = {};
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_efuse_mac_get_default(mac));
+    _sender_id = ((uint32_t)mac[2] << 24) | ((uint32_t)mac[3] << 16) | ((uint32_t)mac[4] << 8) | mac[5];
+    // The sequence starts over at every boot, the boot id tells the members to forget the old one
+    _boot_id = (uint16_t)esp_random();
+    _clock.Reset(_sender_id);
+
+    LoadMembership();
+
+    esp_timer_create_args_t apply_timer_args = {};
+    apply_timer_args.callback = &ApplyTimerStatic;
+    apply_timer_args.arg = this;
+    apply_timer_args.name = "group_apply";
+    esp_err_t status = esp_timer_create(&apply_timer_args, &_apply_timer);
+    if (status != ESP_OK)
+    {
+        ESP_LOGE(_TAG, "Failed to create the apply timer %s", esp_err_to_name(status));
+        return status;
+    }
+
+    status = OpenSocket();
+    if (status != ESP_OK)
+    {
+        return status;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_stateMutex);
+        _is_stopping = false;
+
+        // The apply task runs above the receive task, a deadline is not delayed by incoming packets
+        if (xTaskCreate(&ApplyTaskStatic, "group_apply", 4096, this, 7, &_apply_task) != pdPASS)
+        {
+            ESP_LOGE(_TAG, "Failed to create the apply task");
+            _apply_task = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+
+        if (xTaskCreate(&ReceiveTaskStatic, "group_sync", 4096, this, 6, &_receive_task) != pdPASS)
+        {
+            ESP_LOGE(_TAG, "Failed to create the receive task");
+            _receive_task = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    ESP_LOGI(_TAG, "Started member %08lx, group: %d, enabled: %d", _sender_id, _group_id, _is_enabled);
+    return ESP_OK;
+}
+
+esp_err_t GroupSync::Stop()
+{
+    // Each task exits at its next wake up and notifies us once: the apply task right away, the receive
+    // task when its recv times out, within a quarter beacon interval
+    int running_task_count = 0;
+    {
+        std::lock_guard<std::mutex> lock(_stateMutex);
+        _is_stopping = true;
+        _stopping_task = xTaskGetCurrentTaskHandle();
+        running_task_count = (_receive_task ? 1 : 0) + (_apply_task ? 1 : 0);
+        if (_apply_task)
+        {
+            xTaskNotifyGive(_apply_task);
+        }
+
+        if (_apply_timer)
+        {
+            esp_timer_stop(_apply_timer);
+            esp_timer_delete(_apply_timer);
+            _apply_timer = NULL;
+        }
+    }
+
+    for (int i = 0; i < running_task_count; i++)
+    {
+        ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+    }
+
+    if (_socket >= 0)
+    {
+        close(_socket);
+        _socket = -1;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t GroupSync::SetMembership(uint16_t group_id, bool is_enabled, uint32_t lead_time_ms)
+{
+    {
+        std::lock_guard<std::mutex> lock(_stateMutex);
+        if (group_id != _group_id)
+        {
+            // Offsets, sequences and deadlines of the old group mean nothing in the new one
+            _clock.Reset(_sender_id);
+            _sequences.Clear();
+            _apply_queue.ForgetLastApplied();
+        }
+
+        _group_id = group_id;
+        _is_enabled = is_enabled;
+        _lead_time_ms = lead_time_ms;
+    }
+
+    ESP_LOGI(_TAG, "Membership changed, group: %d, enabled: %d, lead time: %lu ms", group_id, is_enabled, lead_time_ms);
+    return SaveMembership();
+}
+
+esp_err_t GroupSync::SendCommand(int state)
+{
+    GroupSyncPacket packet = {};
+    int64_t now_us = esp_timer_get_time();
+    int64_t local_deadline_us = 0;
+    {
+        std::lock_guard<std::mutex> lock(_stateMutex);
+        if (!_is_enabled || _socket < 0)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        local_deadline_us = now_us + (int64_t)_lead_time_ms * 1000;
+
+        packet.type = GROUP_SYNC_PACKET_COMMAND;
+        packet.sequence = ++_sequence;
+        packet.sender_group_time_us = now_us + _clock.GetOffsetUs();
+        packet.deadline_group_time_us = local_deadline_us + _clock.GetOffsetUs();
+        packet.state = state == LED_ON ? LED_ON : LED_OFF;
+        _statistics.commands_sent++;
+    }
+
+    SendPacket(packet, _command_repeat_count);
+    ScheduleApply(packet.state, packet.deadline_group_time_us, local_deadline_us);
+    return ESP_OK;
+}
+
+int64_t GroupSync::GetGroupTime()
+{
+    std::lock_guard<std::mutex> lock(_stateMutex);
+    return esp_timer_get_time() + _clock.GetOffsetUs();
+}
+
+GroupSync::Statistics GroupSync::GetStatistics()
+{
+    int64_t now_us = esp_timer_get_time();
+    std::lock_guard<std::mutex> lock(_stateMutex);
+    _statistics.group_id = _group_id;
+    _statistics.is_enabled = _is_enabled;
+    _statistics.is_leader = _clock.IsLeader(now_us);
+    _statistics.leader_id = _clock.GetLeaderId();
+    _statistics.lead_time_ms = _lead_time_ms;
+    _statistics.clock_offset_us = _clock.GetOffsetUs();
+    _statistics.forgotten_sender_count = _sequences.GetEvictionCount();
+    _statistics.dropped_apply_count = _apply_queue.GetDroppedCount();
+    return _statistics;
+}
+
+esp_err_t GroupSync::LoadMembership()
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t status = nvs_open("group_sync", NVS_READONLY, &nvs_handle);
+    if (status != ESP_OK)
+    {
+        // Nothing saved yet, keep the defaults
+        return status;
+    }
+
+    uint8_t is_enabled = 0;
+    nvs_get_u16(nvs_handle, "group_id", &_group_id);
+    nvs_get_u8(nvs_handle, "enabled", &is_enabled);
+    nvs_get_u32(nvs_handle, "lead_time_ms", &_lead_time_ms);
+    _is_enabled = is_enabled != 0;
+
+    nvs_close(nvs_handle);
+    return ESP_OK;
+}
+
+esp_err_t GroupSync::SaveMembership()
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t status = nvs_open("group_sync", NVS_READWRITE, &nvs_handle);
+    if (status != ESP_OK)
+    {
+        ESP_LOGE(_TAG, "Cannot open the NVS namespace %s", esp_err_to_name(status));
+        return status;
+    }
+
+    ESP_ERROR_CHECK_WITHOUT_ABORT(nvs_set_u16(nvs_handle, "group_id", _group_id));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(nvs_set_u8(nvs_handle, "enabled", _is_enabled ? 1 : 0));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(nvs_set_u32(nvs_handle, "lead_time_ms", _lead_time_ms));
+    status = nvs_commit(nvs_handle);
+
+    nvs_close(nvs_handle);
+    return status;
+}
+
+esp_err_t GroupSync::OpenSocket()
+{
+    _socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (_socket < 0)
+    {
+        ESP_LOGE(_TAG, "Failed to create the socket");
+        return ESP_FAIL;
+    }
+
+    int reuse = 1;
+    setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in bind_address = {};
+    bind_address.sin_family = AF_INET;
+    bind_address.sin_port = htons(_port);
+    bind_address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(_socket, (struct sockaddr*)&bind_address, sizeof(bind_address)) < 0)
+    {
+        ESP_LOGE(_TAG, "Failed to bind port %d", _port);
+        close(_socket);
+        _socket = -1;
+        return ESP_FAIL;
+    }
+
+    struct ip_mreq membership = {};
+    membership.imr_multiaddr.s_addr = inet_addr(_multicast_address);
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0)
+    {
+        ESP_LOGE(_TAG, "Failed to join %s", _multicast_address);
+        close(_socket);
+        _socket = -1;
+        return ESP_FAIL;
+    }
+
+    // Loopback lets several instances on one host form a group, our own packets are filtered by id
+    uint8_t ttl = 1;
+    uint8_t loopback = 1;
+    setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loopback, sizeof(loopback));
+
+    // Wake up at least once per beacon interval to send our own beacon
+    struct timeval receive_timeout = {};
+    receive_timeout.tv_sec = 0;
+    receive_timeout.tv_usec = _beacon_interval_ms * 1000 / 4;
+    setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, &receive_timeout, sizeof(receive_timeout));
+
+    return ESP_OK;
+}
+
+void GroupSync::ReceiveTask()
+{
+    GroupSyncPacket packet;
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_stateMutex);
+            if (_is_stopping)
+            {
+                break;
+            }
+        }
+
+        ssize_t received_length = recv(_socket, &packet, sizeof(packet), 0);
+        int64_t receive_time_us = esp_timer_get_time();
+
+        if (received_length == (ssize_t)sizeof(packet))
+        {
+            HandlePacket(packet, receive_time_us);
+        }
+
+        if (receive_time_us - _last_beacon_time_us >= (int64_t)_beacon_interval_ms * 1000)
+        {
+            _last_beacon_time_us = receive_time_us;
+            SendBeacon();
+        }
+    }
+
+    ReportTaskStopped(_receive_task);
+}
+
+void GroupSync::ApplyTask()
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        {
+            std::lock_guard<std::mutex> lock(_stateMutex);
+            if (_is_stopping)
+            {
+                break;
+            }
+        }
+
+        ApplyPendingState();
+    }
+
+    ReportTaskStopped(_apply_task);
+}
+
+void GroupSync::ReportTaskStopped(TaskHandle_t& task)
+{
+    // Notified under the lock, so the timer callback never notifies a deleted task
+    {
+        std::lock_guard<std::mutex> lock(_stateMutex);
+        task = NULL;
+        xTaskNotifyGive(_stopping_task);
+    }
+    vTaskDelete(NULL);
+}
+
+void GroupSync::HandlePacket(const GroupSyncPacket& packet, int64_t receive_time_us)
+{
+    if (packet.magic != GROUP_SYNC_PACKET_MAGIC || packet.version != 1 || packet.sender_id == _sender_id)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_stateMutex);
+        if (!_is_enabled || packet.group_id != _group_id)
+        {
+            return;
+        }
+    }
+
+    if (packet.type == GROUP_SYNC_PACKET_BEACON)
+    {
+        HandleBeacon(packet, receive_time_us);
+    }
+    else if (packet.type == GROUP_SYNC_PACKET_COMMAND)
+    {
+        HandleCommand(packet, receive_time_us);
+    }
+}
+
+void GroupSync::HandleBeacon(const GroupSyncPacket& packet, int64_t receive_time_us)
+{
+    std::lock_guard<std::mutex> lock(_stateMutex);
+
+    if (_clock.OnBeacon(packet.sender_id, packet.sender_group_time_us, receive_time_us))
+    {
+        // The group time follows the new leader's clock and may jump back
+        ESP_LOGI(_TAG, "New leader %08lx", packet.sender_id);
+        _apply_queue.ForgetLastApplied();
+    }
+}
+
+void GroupSync::HandleCommand(const GroupSyncPacket& packet, int64_t receive_time_us)
+{
+    int64_t group_deadline_us = 0;
+    int64_t local_deadline_us = 0;
+    {
+        std::lock_guard<std::mutex> lock(_stateMutex);
+
+        uint32_t lost_count = 0;
+        if (!_sequences.Track(packet.sender_id, packet.boot_id, packet.sequence, receive_time_us, lost_count))
+        {
+            // Repeated copy of a command we already scheduled
+            _statistics.duplicate_count++;
+            return;
+        }
+        _statistics.commands_lost += lost_count;
+        _statistics.commands_received++;
+
+        // Clients without a group clock leave the deadline to the receivers
+        if (packet.deadline_group_time_us == 0)
+        {
+            local_deadline_us = receive_time_us + (int64_t)_lead_time_ms * 1000;
+            group_deadline_us = local_deadline_us + _clock.GetOffsetUs();
+        }
+        else
+        {
+            group_deadline_us = packet.deadline_group_time_us;
+            local_deadline_us = group_deadline_us - _clock.GetOffsetUs();
+        }
+    }
+
+    ScheduleApply(packet.state, group_deadline_us, local_deadline_us);
+}
+
+void GroupSync::SendBeacon()
+{
+    GroupSyncPacket packet = {};
+    {
+        std::lock_guard<std::mutex> lock(_stateMutex);
+        if (!_is_enabled || !_clock.IsLeader(esp_timer_get_time()))
+        {
+            return;
+        }
+
+        packet.type = GROUP_SYNC_PACKET_BEACON;
+        packet.sequence = _sequence;
+    }
+
+    SendPacket(packet, 1);
+}
+
+void GroupSync::SendPacket(GroupSyncPacket& packet, int repeat_count)
+{
+    struct sockaddr_in destination = {};
+    destination.sin_family = AF_INET;
+    destination.sin_port = htons(_port);
+    destination.sin_addr.s_addr = inet_addr(_multicast_address);
+
+    packet.magic = GROUP_SYNC_PACKET_MAGIC;
+    packet.version = 1;
+    packet.sender_id = _sender_id;
+    packet.boot_id = _boot_id;
+    {
+        std::lock_guard<std::mutex> lock(_stateMutex);
+        packet.group_id = _group_id;
+    }
+
+    for (int i = 0; i < repeat_count; i++)
+    {
+        // Beacons are stamped as late as possible to keep the offset estimate tight
+        if (packet.type == GROUP_SYNC_PACKET_BEACON)
+        {
+            packet.sender_group_time_us = GetGroupTime();
+        }
+
+        if (sendto(_socket, &packet, sizeof(packet), 0, (struct sockaddr*)&destination, sizeof(destination)) < 0)
+        {
+            ESP_LOGW(_TAG, "Failed to send packet type %d", packet.type);
+        }
+    }
+}
+
+void GroupSync::ScheduleApply(int state, int64_t group_deadline_us, int64_t local_deadline_us)
+{
+    std::lock_guard<std::mutex> lock(_stateMutex);
+    if (local_deadline_us <= esp_timer_get_time())
+    {
+        _statistics.late_count++;
+    }
+
+    PendingApply apply = {group_deadline_us, local_deadline_us, (uint8_t)state};
+    if (!_apply_queue.Push(apply))
+    {
+        ESP_LOGW(_TAG, "Dropped a command due at %lld, later commands override it", group_deadline_us);
+        return;
+    }
+
+    ArmApplyTimer();
+}
+
+void GroupSync::ArmApplyTimer()
+{
+    PendingApply next_apply = {};
+    if (!_apply_timer || !_apply_queue.Peek(next_apply))
+    {
+        return;
+    }
+
+    esp_timer_stop(_apply_timer);
+    int64_t delay_us = std::max<int64_t>(next_apply.local_deadline_us - esp_timer_get_time(), 0);
+    esp_timer_start_once(_apply_timer, delay_us);
+}
+
+void GroupSync::OnApplyTimer()
+{
+    std::lock_guard<std::mutex> lock(_stateMutex);
+    if (_apply_task)
+    {
+        xTaskNotifyGive(_apply_task);
+    }
+}
+
+void GroupSync::ApplyPendingState()
+{
+    // Apply every command that is due, in deadline order, then wait for the next one
+    while (true)
+    {
+        int state = LED_OFF;
+        {
+            std::lock_guard<std::mutex> lock(_stateMutex);
+            PendingApply apply = {};
+            if (!_apply_queue.Peek(apply))
+            {
+                return;
+            }
+
+            int64_t lateness_us = esp_timer_get_time() - apply.local_deadline_us;
+            if (lateness_us < 0)
+            {
+                ArmApplyTimer();
+                return;
+            }
+            _apply_queue.Pop();
+
+            _statistics.last_apply_group_time_us = apply.group_deadline_us + lateness_us;
+            _statistics.last_apply_lateness_us = lateness_us;
+            _statistics.max_apply_lateness_us = std::max(_statistics.max_apply_lateness_us, lateness_us);
+            state = apply.state;
+        }
+
+        if (state == LED_ON)
+        {
+            _led->TurnOn();
+        }
+        else
+        {
+            _led->TurnOff();
+        }
+    }
+}
+
+/* Static Handler Wrapper */
+void GroupSync::ReceiveTaskStatic(void* parameters)
+{
+    auto* group_sync = reinterpret_cast<GroupSync*>(parameters);
+    group_sync->ReceiveTask();
+}
+
+void GroupSync::ApplyTaskStatic(void* parameters)
+{
+    auto* group_sync = reinterpret_cast<GroupSync*>(parameters);
+    group_sync->ApplyTask();
+}
+
+void GroupSync::ApplyTimerStatic(void* arg)
+{
+    auto* group_sync = reinterpret_cast<GroupSync*>(arg);
+    group_sync->OnApplyTimer();
+}
\ No newline at end of file
@@ -0,0 +1,129 @@
+#ifndef GROUPSYNC_HPP
+#define GROUPSYNC_HPP
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <memory>
+#include <mutex>
+#include "GroupClock.hpp"
+#include "LedControl.hpp"
+
+/// @brief Switches a group of controllers together.
+/// A command is one multicast packet carrying a deadline in group time. The group time is the clock
+/// of the member with the lowest id (the leader), which multicasts beacons; every other member keeps
+/// a min-delay filtered offset between its own clock and the leader's and schedules the command at
+/// the converted local deadline.
+class GroupSync
+{
+public:
+    struct Statistics
+    {
+        uint16_t group_id;
+        bool is_enabled;
+        bool is_leader;
+        uint32_t leader_id;
+        uint32_t lead_time_ms;
+        int64_t clock_offset_us;
+        uint32_t commands_sent;
+        uint32_t commands_received;
+        uint32_t commands_lost;
+        uint32_t duplicate_count;
+        uint32_t forgotten_sender_count;
+        uint32_t late_count;
+        uint32_t dropped_apply_count;
+        int64_t last_apply_group_time_us;
+        int64_t last_apply_lateness_us;
+        int64_t max_apply_lateness_us;
+    };
+
+private:
+    std::shared_ptr<LedControl> _led;
+    int _socket = -1;
+    std::mutex _stateMutex;
+
+    // Guarded by _stateMutex. Stop asks the tasks to exit and waits for them to report back,
+    // deleting them from outside could leave _stateMutex locked.
+    TaskHandle_t _receive_task = NULL;
+    TaskHandle_t _apply_task = NULL;
+    TaskHandle_t _stopping_task = NULL;
+    bool _is_stopping = false;
+
+    // Only wakes up the apply task, the LED and its listeners are never driven from the esp_timer task
+    esp_timer_handle_t _apply_timer = NULL;
+
+    // Membership, persisted in NVS
+    uint16_t _group_id = 0;
+    bool _is_enabled = false;
+    uint32_t _lead_time_ms = 150;
+
+    uint32_t _sender_id = 0;
+    uint16_t _boot_id = 0;
+    uint32_t _sequence = 0;
+
+    // Clock offset towards the leader, and the last sequence per sender to count duplicates and lost commands
+    GroupClock _clock;
+    SequenceTracker _sequences;
+    int64_t _last_beacon_time_us = 0;
+
+    // Commands waiting for their deadline, the apply timer is armed for the earliest
+    ApplyQueue _apply_queue;
+
+    Statistics _statistics = {};
+
+    static const char* _TAG;
+
+    static constexpr uint16_t _port = 5007;
+    static constexpr const char* _multicast_address = "239.255.42.99";
+    static constexpr uint32_t _beacon_interval_ms = 1000;
+    // Commands are repeated because multicast frames are never retransmitted by the access point
+    static constexpr int _command_repeat_count = 3;
+
+    esp_err_t LoadMembership();
+    esp_err_t SaveMembership();
+    esp_err_t OpenSocket();
+
+    void ReceiveTask();
+    void ApplyTask();
+    /// @brief Tell Stop this task is done. Nothing of the group sync is touched after it.
+    void ReportTaskStopped(TaskHandle_t& task);
+    void HandlePacket(const GroupSyncPacket& packet, int64_t receive_time_us);
+    void HandleBeacon(const GroupSyncPacket& packet, int64_t receive_time_us);
+    void HandleCommand(const GroupSyncPacket& packet, int64_t receive_time_us);
+    void SendBeacon();
+    void SendPacket(GroupSyncPacket& packet, int repeat_count);
+
+    /// @brief Queue the state for its deadline. Commands are applied in the order of their group
+    /// deadlines, whichever order they arrived in.
+    void ScheduleApply(int state, int64_t group_deadline_us, int64_t local_deadline_us);
+    /// @brief Arm the apply timer for the earliest queued command. Called with _stateMutex held.
+    void ArmApplyTimer();
+    void OnApplyTimer();
+    void ApplyPendingState();
+
+public:
+    GroupSync(std::shared_ptr<LedControl> led);
+    ~GroupSync();
+
+    esp_err_t Start();
+    esp_err_t Stop();
+
+    /// @brief Change the group membership and persist it
+    /// @param group_id Only packets carrying the same group id are accepted
+    /// @param is_enabled A disabled member ignores commands and does not beacon
+    /// @param lead_time_ms How far in the future a command sent from this member is applied
+    esp_err_t SetMembership(uint16_t group_id, bool is_enabled, uint32_t lead_time_ms);
+
+    /// @brief Multicast a state to the group and apply it locally at the same deadline
+    esp_err_t SendCommand(int state);
+
+    int64_t GetGroupTime();
+    Statistics GetStatistics();
+
+    static void ReceiveTaskStatic(void* parameters);
+    static void ApplyTaskStatic(void* parameters);
+    static void ApplyTimerStatic(void* arg);
+};
+
+#endif
\ No newline at end of file
@@ -1,4 +1,41 @@
 #include "HttpServer.hpp"
+#include <esp_app_desc.h>
+#include <cerrno>
+#include <cinttypes>
+#include <climits>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Admission budgets, a browser loading the page needs a handful of requests at once
+#ifndef ADMISSION_SOCKET_RATE_PER_S
+#define ADMISSION_SOCKET_RATE_PER_S 10
+#endif
+
+#ifndef ADMISSION_SOCKET_BURST
+#define ADMISSION_SOCKET_BURST 20
+#endif
+
+#ifndef ADMISSION_ADDRESS_RATE_PER_S
+#define ADMISSION_ADDRESS_RATE_PER_S 20
+#endif
+
+#ifndef ADMISSION_ADDRESS_BURST
+#define ADMISSION_ADDRESS_BURST 40
+#endif
+
+#ifndef ADMISSION_GLOBAL_RATE_PER_S
+#define ADMISSION_GLOBAL_RATE_PER_S 60
+#endif
+
+#ifndef ADMISSION_GLOBAL_BURST
+#define ADMISSION_GLOBAL_BURST 120
+#endif
+
+// GET /history formats the events into a buffer of this size and sends it as one chunk
+#ifndef HISTORY_CHUNK_SIZE
+#define HISTORY_CHUNK_SIZE 1024
+#endif
 
 extern const uint8_t index_html_start[] asm("_binary_index_html_start");
 extern const uint8_t index_html_end[] asm("_binary_index_html_end");
@@ -7,8 +44,17 @@ extern const uint8_t websocket_js_start[] asm("_binary_websocket_js_start");
 extern const uint8_t websocket_js_end[]   asm("_binary_websocket_js_end");
 
 
-HttpServer::HttpServer(httpd_handle_t server, std::shared_ptr<LedControl> led, std::string host_name)
-    : _server(server), _led(led), _host_name(host_name)
+HttpServer::HttpServer(httpd_handle_t server, std::shared_ptr<LedControl> led, std::string host_name, std::shared_ptr<GroupSync> group_sync,
+                       std::shared_ptr<TaskProfiler> task_profiler, std::shared_ptr<ButtonInput> button_input, std::shared_ptr<StateHistory> state_history,
+                       std::shared_ptr<TlsCredentials> tls_credentials)
+    : _server(server), _led(led), _group_sync(group_sync), _task_profiler(task_profiler), _button_input(button_input), _state_history(state_history),
+      _tls_credentials(tls_credentials),
+      _host_name(host_name),
+      _admission_control({
+          {ADMISSION_SOCKET_RATE_PER_S, ADMISSION_SOCKET_BURST},
+          {ADMISSION_ADDRESS_RATE_PER_S, ADMISSION_ADDRESS_BURST},
+          {ADMISSION_GLOBAL_RATE_PER_S, ADMISSION_GLOBAL_BURST}
+      })
 {
 }
 
@@ -25,63 +71,66 @@ esp_err_t HttpServer::Start()
         return ESP_OK;
     }
 
-    // Setup local DNS
-    if (_host_name != "")
-    {
-        mdns_init();
-        mdns_hostname_set(_host_name.c_str());
-        mdns_instance_name_set("ESP32 Web Server");
-
-        ESP_LOGI(_TAG, "Completed MDNS setup");
-    }
+    // Web UI from the assets partition, the embedded files are the fallback
+    _web_assets.Mount();
 
     // Setup http server config
     _server = NULL;
     httpd_config_t server_config = HTTPD_DEFAULT_CONFIG();
     server_config.lru_purge_enable = true;
+    server_config.max_uri_handlers = _route_count;
     server_config.open_fn = OnOpenConnectionStatic;
     server_config.close_fn = OnCloseConnectionStatic;
     server_config.global_user_ctx = this;
     server_config.uri_match_fn = httpd_uri_match_wildcard;
 
+    // HTTPS and WSS once the device is provisioned with credentials, plain HTTP otherwise
+    _is_tls = _tls_credentials && _tls_credentials->IsLoaded();
+    uint16_t port = _is_tls ? HTTP_SERVER_TLS_PORT : server_config.server_port;
+
+    // Setup local DNS
+    if (_host_name != "")
+    {
+        mdns_init();
+        mdns_hostname_set(_host_name.c_str());
+        mdns_instance_name_set("ESP32 Web Server");
+        AdvertiseServices(port);
+
+        ESP_LOGI(_TAG, "Completed MDNS setup");
+    }
+
     ESP_LOGI(_TAG, "Start server");
-    esp_err_t status = httpd_start(&_server, &server_config);
-
-    httpd_uri_t led_endpoint = {
-        .uri = "/led",
-        .method = HTTP_POST,
-        .handler = &LedControlHttpHandlerStatic,
-        .user_ctx = this,
-        .is_websocket = false,
-        .handle_ws_control_frames = false
-    };
+    esp_err_t status = _is_tls ? StartTls(server_config) : httpd_start(&_server, &server_config);
 
-    // Register webocket handlers
-    httpd_uri_t ws = {
-        .uri = "/wsled",
-        .method = HTTP_GET,
-        .handler = &LedControlWebSocketHandlerStatic,
-        .user_ctx = this,
-        .is_websocket = true
-    };
+    // Every state change reaches the dashboards, whichever source issued the command
+    _listener_id = _led->AddStateChangeListener([this](int) { OnStateChanged(); });
 
-    // Register url handlers
-    httpd_uri_t root = {
-        .uri = "/*",
-        .method = HTTP_GET,
-        .handler = &RootHandlerStatic,
-        .user_ctx = this,
-        .is_websocket = false,
-        .handle_ws_control_frames = false
-    };
+    // Register the routes in table order, the wildcard root handler comes last
+    for (size_t i = 0; i < _route_count; i++)
+    {
+        const Route& route = _routes[i];
+        if (((route.flags & ROUTE_FLAG_REQUIRES_GROUP_SYNC) && !_group_sync) ||
+            ((route.flags & ROUTE_FLAG_REQUIRES_TASK_PROFILER) && !_task_profiler) ||
+            ((route.flags & ROUTE_FLAG_REQUIRES_BUTTON_INPUT) && !_button_input) ||
+            ((route.flags & ROUTE_FLAG_REQUIRES_STATE_HISTORY) && !_state_history))
+        {
+            continue;
+        }
 
-    httpd_register_uri_handler(_server, &led_endpoint);
-    httpd_register_uri_handler(_server, &ws);
-    httpd_register_uri_handler(_server, &root);
+        _route_contexts[i] = {this, &route};
+        httpd_uri_t uri_handler = {
+            .uri = route.uri,
+            .method = route.method,
+            .handler = &DispatchStatic,
+            .user_ctx = &_route_contexts[i],
+            .is_websocket = (route.flags & ROUTE_FLAG_WEBSOCKET) != 0,
+            .handle_ws_control_frames = false
+        };
+        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_register_uri_handler(_server, &uri_handler));
+    }
 
-    // httpd_register_uri_handler(_server, &ws);
     httpd_register_err_handler(_server, HTTPD_404_NOT_FOUND, &NotFoundHandlerStatic);
-    ESP_LOGI(_TAG, "Registered Led Handler");
+    ESP_LOGI(_TAG, "Registered %zu routes", _route_count);
 
     return status;
 }
@@ -90,16 +139,59 @@ esp_err_t HttpServer::Stop()
 {
     ESP_LOGI(_TAG, "Stop server");
 
+    if (_listener_id != 0)
+    {
+        _led->RemoveStateChangeListener(_listener_id);
+        _listener_id = 0;
+    }
+
     esp_err_t stop_status = ESP_OK;
     if (_server)
     {
         // _status = ESP_ERR_INVALID_STATE;
-        stop_status = httpd_stop(_server);
+        stop_status = _is_tls ? httpd_ssl_stop(_server) : httpd_stop(_server);
     }
 
     return stop_status;
 }
 
+esp_err_t HttpServer::StartTls(const httpd_config_t& server_config)
+{
+    // Same server as the plain one, except for the TLS defaults of the task stack, the handshake
+    // runs on the httpd task, and of the control port
+    httpd_ssl_config_t ssl_config = HTTPD_SSL_CONFIG_DEFAULT();
+    const httpd_config_t tls_defaults = ssl_config.httpd;
+    ssl_config.httpd = server_config;
+    ssl_config.httpd.stack_size = tls_defaults.stack_size;
+    ssl_config.httpd.ctrl_port = tls_defaults.ctrl_port;
+    ssl_config.port_secure = HTTP_SERVER_TLS_PORT;
+
+    // esp_https_server installs its own open_fn and calls ours only once the handshake has
+    // completed. Admission control therefore refuses a flooding address after its handshake,
+    // not before: every refused connection still costs a full handshake on the httpd task.
+#if CONFIG_ESP_TLS_SERVER_SESSION_TICKETS
+    // A returning client resumes with its ticket and skips the key exchange and the signature
+    ssl_config.session_tickets = true;
+#endif
+
+#if CONFIG_ESP_HTTPS_SERVER_CERT_SELECT_HOOK
+    // esp-tls sets up every connection from scratch and would parse the credentials each time,
+    // the hook hands it the ones parsed at boot instead. The buffers stay NULL, so esp-tls has
+    // nothing to parse per connection.
+    _tls_credentials->Activate();
+    ssl_config.cert_select_cb = &TlsCredentials::SelectCertificateStatic;
+#else
+    // DER, so esp-tls skips the base64 decoding, and the key carries its public point
+    ssl_config.servercert = _tls_credentials->GetCertificateDer();
+    ssl_config.servercert_len = _tls_credentials->GetCertificateDerLength();
+    ssl_config.prvtkey_pem = _tls_credentials->GetPrivateKeyDer().data();
+    ssl_config.prvtkey_len = _tls_credentials->GetPrivateKeyDer().size();
+#endif
+
+    ESP_LOGI(_TAG, "Start HTTPS server with an %s key", _tls_credentials->IsEcdsa() ? "ECDSA" : "RSA");
+    return httpd_ssl_start(&_server, &ssl_config);
+}
+
 httpd_handle_t HttpServer::GetServer()
 {
     return _server;
@@ -107,8 +199,119 @@ httpd_handle_t HttpServer::GetServer()
 
 const char* HttpServer::_TAG = "HttpServer";
 
+esp_err_t HttpServer::Dispatch(httpd_req_t* req, const Route& route)
+{
+    // Admission comes first, a throttled request costs a few bucket updates and a precomputed reply.
+    // httpd has already answered the handshake with 101 before it calls the handler, so even the GET
+    // on a websocket route is on an upgraded stream and only a close frame can go out on it.
+    bool is_websocket = (route.flags & ROUTE_FLAG_WEBSOCKET) != 0;
+    if (_admission_control.Admit(httpd_req_to_sockfd(req), esp_timer_get_time()) != ADMISSION_RESULT_ADMITTED)
+    {
+        return RejectThrottledRequest(req, is_websocket);
+    }
+
+    // Websocket frames are not HTTP requests, the handshake was already validated by httpd
+    if (!(route.flags & ROUTE_FLAG_WEBSOCKET))
+    {
+        const PrecomputedResponse* rejection = ValidateRequest(req, route);
+        if (rejection)
+        {
+            return SendPrecomputedResponse(req, *rejection);
+        }
+    }
+
+    return (this->*route.handler)(req);
+}
+
+esp_err_t HttpServer::RejectThrottledRequest(httpd_req_t* req, bool is_websocket)
+{
+    if (!is_websocket)
+    {
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return SendPrecomputedResponse(req, _too_many_requests_response);
+    }
+
+    // A websocket has no error status, the client is told why and disconnected
+    httpd_ws_frame_t close_frame = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_CLOSE,
+        .payload = const_cast<uint8_t*>(_rate_limited_close_payload),
+        .len = sizeof(_rate_limited_close_payload)
+    };
+    httpd_ws_send_frame(req, &close_frame);
+    _throttled_websocket_close_count++;
+
+    ESP_LOGW(_TAG, "Closing the websocket id: %d, it exceeded its request rate", httpd_req_to_sockfd(req));
+
+    // An error makes httpd close the session
+    return ESP_FAIL;
+}
+
+const PrecomputedResponse* HttpServer::ValidateRequest(httpd_req_t* req, const Route& route)
+{
+    RequestLimits limits = {route.content_types, route.max_body_size};
+    if (route.flags & ROUTE_FLAG_ASSET_SLOT_BODY)
+    {
+        limits.max_body_size = _web_assets.GetPartitionSize();
+    }
+
+    // Fixed stack buffer, a value that does not fit cannot be one of the accepted types anyway
+    char content_type[REQUEST_CONTENT_TYPE_MAX_LENGTH + 1] = "";
+    RequestSummary request = {req->content_len, content_type};
+    if (limits.content_types != CONTENT_TYPE_NONE)
+    {
+        esp_err_t status = httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type));
+        if (status == ESP_ERR_NOT_FOUND)
+        {
+            request.content_type = nullptr;
+        }
+        else if (status != ESP_OK)
+        {
+            content_type[0] = '\0';
+        }
+    }
+
+    return RequestPipeline::Run(request, limits);
+}
+
+bool HttpServer::ParseMilliseconds(const char* text, int64_t& output_milliseconds)
+{
+    char* end = NULL;
+    errno = 0;
+    long long value = strtoll(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE)
+    {
+        return false;
+    }
+
+    output_milliseconds = value;
+    return true;
+}
+
+esp_err_t HttpServer::SendPrecomputedResponse(httpd_req_t* req, const PrecomputedResponse& response)
+{
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_status(req, response.status);
+
+    // A handler error would make httpd drop the connection, the client only sent a bad request
+    return httpd_resp_send(req, response.body, response.body_length);
+}
+
 esp_err_t HttpServer::RootHandler(httpd_req_t* req)
 {
+    // Served straight out of the mapped flash, nothing is copied into RAM
+    const char* asset_path = strcmp(req->uri, "/") == 0 ? "/index.html" : req->uri;
+    const AssetArchiveEntry* asset = _web_assets.Find(asset_path);
+    if (asset)
+    {
+        httpd_resp_set_type(req, asset->content_type);
+        if (asset->flags & ASSET_ENTRY_FLAG_GZIP)
+        {
+            httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+        }
+        return httpd_resp_send(req, (const char*)_web_assets.GetData(*asset), asset->length);
+    }
+
     if (strcmp(req->uri, "/") == 0 || strcmp(req->uri, "/index.html") == 0)
     {
         // Serve HTML
@@ -139,116 +342,90 @@ esp_err_t HttpServer::RootHandler(httpd_req_t* req)
     return ESP_OK;
 }
 
-esp_err_t HttpServer::LedControlHttpHandler(httpd_req_t* req)
+esp_err_t HttpServer::AssetUploadHandler(httpd_req_t* req)
 {
-    // Null check for the request
-    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_type(req, "application/json"));
-
-    esp_err_t status = ESP_OK;
-    if (!req)
+    // Replacing the UI is an administrative action. Over plain HTTP the token crosses the LAN in clear,
+    // provision TLS credentials as well on networks that are not trusted.
+    char authorization[sizeof("Bearer ") + WEB_ASSETS_UPLOAD_TOKEN_MAX_LENGTH] = {};
+    bool has_authorization = httpd_req_get_hdr_value_str(req, "Authorization", authorization, sizeof(authorization)) == ESP_OK;
+    if (!has_authorization || strncmp(authorization, "Bearer ", 7) != 0 || !_web_assets.IsUploadAuthorized(authorization + 7))
     {
-        ESP_LOGI(_TAG, "The request is null");
-
-        std::string root_string = ConstructFailedJsonResponse(400, "Bad Request", "Invalid Request");
-
-        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_status(req, "400 Bad Request"));
-        status = httpd_resp_send(req, root_string.c_str(), HTTPD_RESP_USE_STRLEN);
-
-        return status;
+        ESP_LOGW(_TAG, "Rejected an asset upload without a valid token");
+        httpd_resp_set_hdr(req, "WWW-Authenticate", "Bearer");
+        return SendPrecomputedResponse(req, _unauthorized_response);
     }
 
-    // check header to ensure it includes the content-type
-    size_t json_header_value_length = httpd_req_get_hdr_value_len(req, "Content-Type");
-    ESP_LOGI(_TAG, "Content-Type header length: %d", json_header_value_length);
-    if (json_header_value_length == 0)
+    if (req->content_len == 0)
     {
-        std::string failed_response_string = ConstructFailedJsonResponse(400, "Bad Request", "Must have header Content-Type");
-
-        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_status(req, "400 Bad Request"));
-        status = httpd_resp_send(req, failed_response_string.c_str(), HTTPD_RESP_USE_STRLEN);
-
-        return status;
+        return SendJsonResponse(req, "411 Length Required", ConstructFailedJsonResponse(411, "Length Required", "The archive size must be sent as Content-Length"));
     }
 
-    std::unique_ptr<char[]> json_header_value(new char[json_header_value_length + 1]);
-    esp_err_t get_json_header_status =
-        httpd_req_get_hdr_value_str(
-            req,
-            "Content-Type",
-            json_header_value.get(),
-            json_header_value_length + 1
-        );
-
-    if (get_json_header_status != ESP_OK)
+    esp_err_t status = _web_assets.BeginUpdate(req->content_len);
+    if (status == ESP_ERR_NOT_FOUND)
     {
-        ESP_LOGI(_TAG, "Cannot get the header Content-Type: Error Code: %s", esp_err_to_name(get_json_header_status));
-        std::string failed_response_string = ConstructFailedJsonResponse(400, "Bad Request", "Must have header Content-Type");
-
-        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_status(req, "400 Bad Request"));
-        status = httpd_resp_send(req, failed_response_string.c_str(), HTTPD_RESP_USE_STRLEN);
-
-        return status;
+        return SendJsonResponse(req, "404 Not Found", ConstructFailedJsonResponse(404, "Not Found", "There is no assets partition"));
     }
-
-    ESP_LOGI(_TAG, "Content-Type value: %s", json_header_value.get());
-
-    // Ensure the content type is json
-    if (strcmp(json_header_value.get(), "application/json") != 0)
+    if (status != ESP_OK)
     {
-        ESP_LOGI(_TAG, "The Content-Type is not application/json");
-        std::string failed_response_string = ConstructFailedJsonResponse(400, "Bad Request", "Type must be application json");
-
-        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_status(req, "400 Bad Request"));
-
-        status = httpd_resp_send(req, failed_response_string.c_str(), HTTPD_RESP_USE_STRLEN);
-
-        return status;
+        std::string message = "The archive must fit in " + std::to_string(_web_assets.GetPartitionSize()) + " bytes";
+        return SendJsonResponse(req, "413 Payload Too Large", ConstructFailedJsonResponse(413, "Payload Too Large", message));
     }
 
-    // check buffer length
-    size_t content_buffer_length = req->content_len + 1;
-    std::unique_ptr<char[]> content_buffer(new char[content_buffer_length]);
-    ESP_LOGI(_TAG, "The content length: %d", content_buffer_length);
-
-    int http_read_content_status = httpd_req_recv(req, content_buffer.get(), content_buffer_length);
-    if (http_read_content_status <= 0)
+    // Stream the body into flash one chunk at a time
+    const size_t chunk_size = 2048;
+    std::unique_ptr<uint8_t[]> chunk(new uint8_t[chunk_size]);
+    size_t remaining_length = req->content_len;
+    while (remaining_length > 0)
     {
-        ESP_LOGI(_TAG, "Reading the request content is not successul");
-        unsigned int error_status = 500;
-        std::string error_code = "Internal Server Error";
-        std::string error_message = "Internal Server Error";
+        int received_length = httpd_req_recv(req, (char*)chunk.get(), std::min(remaining_length, chunk_size));
+        if (received_length == HTTPD_SOCK_ERR_TIMEOUT)
+        {
+            continue;
+        }
 
-        if (http_read_content_status == 0)
+        if (received_length <= 0)
         {
-            error_status = 400;
-            error_code = "Bad Request";
-            error_message = "Buffer length parameter is 0 or connection closed by peer";
+            _web_assets.AbortUpdate();
+            ESP_LOGW(_TAG, "The asset upload was interrupted with %zu bytes left", remaining_length);
+            return ESP_FAIL;
         }
-        //TODO: should timeout be internal server error?
 
-        std::string failed_response_string = ConstructFailedJsonResponse(error_status, error_code, error_message);
+        // WriteChunk aborts the update itself. The rest of the body is not read, httpd would purge it
+        // all before the next request, so the connection is closed after the response instead.
+        status = _web_assets.WriteChunk(chunk.get(), received_length);
+        if (status != ESP_OK)
+        {
+            ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_hdr(req, "Connection", "close"));
+            SendJsonResponse(req, "500 Internal Server Error", ConstructFailedJsonResponse(500, "Internal Server Error", "Cannot write the assets partition"));
+            return ESP_FAIL;
+        }
+        remaining_length -= received_length;
+    }
 
-        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_status(req, "500 Internal Server Error"));
+    status = _web_assets.FinishUpdate();
+    if (status != ESP_OK)
+    {
+        return SendJsonResponse(req, "400 Bad Request", ConstructFailedJsonResponse(400, "Bad Request", "The uploaded file is not a valid asset archive"));
+    }
 
-        status = httpd_resp_send(req, failed_response_string.c_str(), HTTPD_RESP_USE_STRLEN);
+    return SendJsonResponse(req, "200 OK", ConstructCurrentSstateMessage("updated"));
+}
 
+esp_err_t HttpServer::LedControlHttpHandler(httpd_req_t* req)
+{
+    // Method, Content-Type and body size were checked by the middlewares
+    std::unique_ptr<char[]> content_buffer;
+    esp_err_t status = ReceiveRequestBody(req, content_buffer);
+    if (status != ESP_OK)
+    {
         return status;
     }
 
-    // parse the buffer json object
-    ESP_LOGI(_TAG, "Start deserializing the object");
-    cJSON* root = cJSON_Parse(content_buffer.get());
     std::string parsed_result = "";
     bool is_parse_successful = ParseStateRequestJson(content_buffer.get(), parsed_result);
-
     if (!is_parse_successful)
     {
-        std::string failed_error_string = ConstructFailedJsonResponse(400, "Bad Request", parsed_result);
-
-        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_status(req, "400 Bad Request"));
-        status = httpd_resp_send(req, failed_error_string.c_str(), HTTPD_RESP_USE_STRLEN);
-
-        return status;
+        return SendJsonResponse(req, "400 Bad Request", ConstructFailedJsonResponse(400, "Bad Request", parsed_result));
     }
 
     // TODO: this should be a critical section. hence it can't be turned on and off at the same time
@@ -264,12 +441,8 @@ esp_err_t HttpServer::LedControlHttpHandler(httpd_req_t* req)
         _led->TurnOff();
     }
 
-    std::string response_string = ConstructCurrentSstateMessage("on");
-
-    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_status(req, "200 OK"));
-    status = httpd_resp_send(req, response_string.c_str(), HTTPD_RESP_USE_STRLEN);
-
-    return status;
+    std::string current_led_state_string = _led->GetState() == 1 ? "on" : "off";
+    return SendJsonResponse(req, "200 OK", ConstructCurrentSstateMessage(current_led_state_string));
 }
 
 esp_err_t HttpServer::LedControlWebsocketHandler(httpd_req_t* req)
@@ -380,12 +553,375 @@ esp_err_t HttpServer::LedControlWebsocketHandler(httpd_req_t* req)
 
     current_led_state = _led->GetState();
     current_led_state_string = current_led_state == 1 ? "on" : "off";
-    std::string success_response_string = ConstructCurrentSstateMessage(current_led_state_string);
+    std::string success_response_string = ConstructCommandReplyMessage(current_led_state_string, (char*)buffer.get());
     status = SendWebsocketTextMessage(req, success_response_string);
-    BroadCastMessage();
     return status;
 }
 
+esp_err_t HttpServer::GroupHandler(httpd_req_t* req)
+{
+    if (req->method == HTTP_POST)
+    {
+        std::unique_ptr<char[]> body;
+        esp_err_t status = ReceiveRequestBody(req, body);
+        if (status != ESP_OK)
+        {
+            return status;
+        }
+
+        cJSON* request = cJSON_Parse(body.get());
+        if (!request)
+        {
+            return SendJsonResponse(req, "400 Bad Request", ConstructFailedJsonResponse(400, "Bad Request", "The request message must be a valid json"));
+        }
+
+        // Members that are left out keep their current value
+        GroupSync::Statistics current = _group_sync->GetStatistics();
+        uint16_t group_id = current.group_id;
+        bool is_enabled = current.is_enabled;
+        uint32_t lead_time_ms = current.lead_time_ms;
+
+        cJSON* group_id_item = cJSON_GetObjectItem(request, "group_id");
+        cJSON* enabled_item = cJSON_GetObjectItem(request, "enabled");
+        cJSON* lead_time_item = cJSON_GetObjectItem(request, "lead_time_ms");
+
+        std::string error_message = "";
+        if (group_id_item && (!cJSON_IsNumber(group_id_item) || group_id_item->valueint < 0 || group_id_item->valueint > UINT16_MAX))
+        {
+            error_message = "\"group_id\" must be a number between 0 and 65535";
+        }
+        else if (enabled_item && !cJSON_IsBool(enabled_item))
+        {
+            error_message = "\"enabled\" must be a boolean";
+        }
+        else if (lead_time_item && (!cJSON_IsNumber(lead_time_item) || lead_time_item->valueint < 10 || lead_time_item->valueint > 10000))
+        {
+            error_message = "\"lead_time_ms\" must be a number between 10 and 10000";
+        }
+
+        if (error_message == "")
+        {
+            group_id = group_id_item ? group_id_item->valueint : group_id;
+            is_enabled = enabled_item ? cJSON_IsTrue(enabled_item) : is_enabled;
+            lead_time_ms = lead_time_item ? lead_time_item->valueint : lead_time_ms;
+        }
+        cJSON_Delete(request);
+
+        if (error_message != "")
+        {
+            return SendJsonResponse(req, "400 Bad Request", ConstructFailedJsonResponse(400, "Bad Request", error_message));
+        }
+
+        status = _group_sync->SetMembership(group_id, is_enabled, lead_time_ms);
+        if (status != ESP_OK)
+        {
+            return SendJsonResponse(req, "500 Internal Server Error", ConstructFailedJsonResponse(500, "Internal Server Error", "Cannot save the group membership"));
+        }
+    }
+
+    // Both methods answer with the membership and the sync statistics
+    GroupSync::Statistics statistics = _group_sync->GetStatistics();
+    cJSON* response = cJSON_CreateObject();
+    cJSON_AddNumberToObject(response, "group_id", statistics.group_id);
+    cJSON_AddBoolToObject(response, "enabled", statistics.is_enabled);
+    cJSON_AddNumberToObject(response, "lead_time_ms", statistics.lead_time_ms);
+    cJSON_AddBoolToObject(response, "is_leader", statistics.is_leader);
+    cJSON_AddNumberToObject(response, "leader_id", statistics.leader_id);
+    cJSON_AddNumberToObject(response, "clock_offset_us", statistics.clock_offset_us);
+    cJSON_AddNumberToObject(response, "group_time_us", _group_sync->GetGroupTime());
+    cJSON_AddNumberToObject(response, "commands_sent", statistics.commands_sent);
+    cJSON_AddNumberToObject(response, "commands_received", statistics.commands_received);
+    cJSON_AddNumberToObject(response, "commands_lost", statistics.commands_lost);
+    cJSON_AddNumberToObject(response, "duplicates", statistics.duplicate_count);
+    cJSON_AddNumberToObject(response, "forgotten_senders", statistics.forgotten_sender_count);
+    cJSON_AddNumberToObject(response, "late", statistics.late_count);
+    cJSON_AddNumberToObject(response, "dropped_applies", statistics.dropped_apply_count);
+    cJSON_AddNumberToObject(response, "last_apply_group_time_us", statistics.last_apply_group_time_us);
+    cJSON_AddNumberToObject(response, "last_apply_lateness_us", statistics.last_apply_lateness_us);
+    cJSON_AddNumberToObject(response, "max_apply_lateness_us", statistics.max_apply_lateness_us);
+    char* response_string = cJSON_Print(response);
+    cJSON_Delete(response);
+
+    esp_err_t status = SendJsonResponse(req, "200 OK", response_string);
+    cJSON_free(response_string);
+    return status;
+}
+
+esp_err_t HttpServer::GroupLedHandler(httpd_req_t* req)
+{
+    std::unique_ptr<char[]> body;
+    esp_err_t status = ReceiveRequestBody(req, body);
+    if (status != ESP_OK)
+    {
+        return status;
+    }
+
+    std::string parsed_result = "";
+    bool is_parse_successful = ParseStateRequestJson(body.get(), parsed_result);
+    if (!is_parse_successful)
+    {
+        return SendJsonResponse(req, "400 Bad Request", ConstructFailedJsonResponse(400, "Bad Request", parsed_result));
+    }
+
+    status = _group_sync->SendCommand(parsed_result.compare("on") == 0 ? LED_ON : LED_OFF);
+    if (status == ESP_ERR_INVALID_STATE)
+    {
+        return SendJsonResponse(req, "409 Conflict", ConstructFailedJsonResponse(409, "Conflict", "Group mode is disabled"));
+    }
+
+    // The state is applied at the group deadline, after this response is sent
+    return SendJsonResponse(req, "202 Accepted", ConstructCurrentSstateMessage(parsed_result));
+}
+
+esp_err_t HttpServer::AdmissionHandler(httpd_req_t* req)
+{
+    AdmissionControl::Statistics statistics = _admission_control.GetStatistics();
+    const AdmissionControl::Config& config = _admission_control.GetConfig();
+
+    cJSON* response = cJSON_CreateObject();
+    cJSON_AddNumberToObject(response, "admitted", statistics.admitted_count);
+    cJSON_AddNumberToObject(response, "socket_limited", statistics.socket_limited_count);
+    cJSON_AddNumberToObject(response, "address_limited", statistics.address_limited_count);
+    cJSON_AddNumberToObject(response, "global_limited", statistics.global_limited_count);
+    cJSON_AddNumberToObject(response, "rejected_connections", statistics.rejected_connection_count);
+    cJSON_AddNumberToObject(response, "websocket_closes", _throttled_websocket_close_count);
+    cJSON_AddNumberToObject(response, "untracked_sockets", statistics.untracked_socket_count);
+    cJSON_AddNumberToObject(response, "open_sockets", statistics.open_socket_count);
+    cJSON_AddNumberToObject(response, "tracked_addresses", statistics.tracked_address_count);
+    cJSON_AddNumberToObject(response, "socket_rate_per_s", config.socket.rate_per_s);
+    cJSON_AddNumberToObject(response, "address_rate_per_s", config.address.rate_per_s);
+    cJSON_AddNumberToObject(response, "global_rate_per_s", config.global.rate_per_s);
+    char* response_string = cJSON_Print(response);
+    cJSON_Delete(response);
+
+    esp_err_t status = SendJsonResponse(req, "200 OK", response_string);
+    cJSON_free(response_string);
+    return status;
+}
+
+esp_err_t HttpServer::TaskProfileHandler(httpd_req_t* req)
+{
+    const TaskSampler& sampler = _task_profiler->GetSampler();
+
+    // Copied out first, the sampler task must not wait on the formatting or a slow client.
+    // The window is too large for the httpd stack.
+    std::unique_ptr<TaskSample[]> samples(new TaskSample[TASK_SAMPLER_WINDOW]);
+    size_t sample_count = sampler.CopySamples(samples.get(), TASK_SAMPLER_WINDOW);
+
+    cJSON* summary = cJSON_CreateObject();
+    cJSON_AddNumberToObject(summary, "interval_ms", _task_profiler->GetIntervalMs());
+    cJSON_AddNumberToObject(summary, "cores", _task_profiler->GetCoreCount());
+    cJSON_AddNumberToObject(summary, "skipped_samples", sampler.GetSkippedSampleCount());
+    char* summary_string = cJSON_PrintUnformatted(summary);
+    cJSON_Delete(summary);
+    if (!summary_string)
+    {
+        return SendPrecomputedResponse(req, _out_of_memory_response);
+    }
+
+    // Streamed one sample per chunk, the whole window as a single cJSON tree would not fit the heap
+    std::string header_string = summary_string;
+    cJSON_free(summary_string);
+    header_string.back() = ',';
+    header_string += "\"samples\":[";
+
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_type(req, "application/json"));
+    esp_err_t status = httpd_resp_send_chunk(req, header_string.c_str(), header_string.length());
+
+    for (size_t sample_index = 0; sample_index < sample_count && status == ESP_OK; sample_index++)
+    {
+        const TaskSample& sample = samples[sample_index];
+        cJSON* sample_object = cJSON_CreateObject();
+        cJSON_AddNumberToObject(sample_object, "time_us", sample.time_us);
+        cJSON_AddNumberToObject(sample_object, "heap_free", sample.heap.free_bytes);
+        cJSON_AddNumberToObject(sample_object, "heap_minimum_free", sample.heap.minimum_free_bytes);
+        cJSON_AddNumberToObject(sample_object, "heap_largest_free_block", sample.heap.largest_free_block_bytes);
+        cJSON_AddNumberToObject(sample_object, "heap_fragmentation_percent", sample.heap_fragmentation_percent);
+
+        cJSON* tasks = cJSON_AddArrayToObject(sample_object, "tasks");
+        for (uint8_t i = 0; i < sample.task_count; i++)
+        {
+            const TaskUsage& usage = sample.tasks[i];
+            cJSON* task = cJSON_CreateObject();
+            cJSON_AddStringToObject(task, "name", usage.name);
+            cJSON_AddNumberToObject(task, "cpu_percent", usage.cpu_permille / 10.0);
+            cJSON_AddNumberToObject(task, "stack_free_bytes", usage.stack_free_bytes);
+            cJSON_AddNumberToObject(task, "priority", usage.priority);
+            cJSON_AddNumberToObject(task, "core", usage.core_id);
+            cJSON_AddItemToArray(tasks, task);
+        }
+
+        char* sample_string = cJSON_PrintUnformatted(sample_object);
+        cJSON_Delete(sample_object);
+        if (!sample_string)
+        {
+            // The headers are gone already, the only way to tell the client is to cut the body short
+            status = ESP_ERR_NO_MEM;
+            break;
+        }
+
+        if (sample_index > 0)
+        {
+            status = httpd_resp_send_chunk(req, ",", 1);
+        }
+        if (status == ESP_OK)
+        {
+            status = httpd_resp_send_chunk(req, sample_string, HTTPD_RESP_USE_STRLEN);
+        }
+        cJSON_free(sample_string);
+    }
+
+    if (status != ESP_OK)
+    {
+        ESP_LOGW(_TAG, "Failed to stream the task samples %s", esp_err_to_name(status));
+        return status;
+    }
+
+    status = httpd_resp_send_chunk(req, "]}", 2);
+    if (status != ESP_OK)
+    {
+        return status;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+esp_err_t HttpServer::ButtonHandler(httpd_req_t* req)
+{
+    ButtonInput::Statistics statistics = _button_input->GetStatistics();
+
+    cJSON* response = cJSON_CreateObject();
+    cJSON_AddNumberToObject(response, "presses", statistics.press_count);
+    cJSON_AddNumberToObject(response, "releases", statistics.release_count);
+    cJSON_AddNumberToObject(response, "bounces", statistics.bounce_count);
+    cJSON_AddNumberToObject(response, "dropped_edges", statistics.dropped_edge_count);
+    cJSON_AddNumberToObject(response, "last_latency_us", statistics.last_latency_us);
+    cJSON_AddNumberToObject(response, "min_latency_us", statistics.min_latency_us);
+    cJSON_AddNumberToObject(response, "mean_latency_us", statistics.mean_latency_us);
+    cJSON_AddNumberToObject(response, "max_latency_us", statistics.max_latency_us);
+    char* response_string = cJSON_Print(response);
+    cJSON_Delete(response);
+
+    esp_err_t status = SendJsonResponse(req, "200 OK", response_string);
+    cJSON_free(response_string);
+    return status;
+}
+
+esp_err_t HttpServer::HistoryHandler(httpd_req_t* req)
+{
+    // GET /history?from=<ms>&to=<ms>&format=json|binary, times in milliseconds since the Unix epoch
+    int64_t from_ms = 0;
+    int64_t to_ms = INT64_MAX;
+    bool is_binary = false;
+
+    size_t query_length = httpd_req_get_url_query_len(req);
+    if (query_length > 0)
+    {
+        char query[128];
+        char value[24];
+        bool is_valid = query_length < sizeof(query) && httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK;
+        if (is_valid && httpd_query_key_value(query, "from", value, sizeof(value)) == ESP_OK)
+        {
+            is_valid = ParseMilliseconds(value, from_ms);
+        }
+        if (is_valid && httpd_query_key_value(query, "to", value, sizeof(value)) == ESP_OK)
+        {
+            is_valid = ParseMilliseconds(value, to_ms);
+        }
+        if (is_valid && httpd_query_key_value(query, "format", value, sizeof(value)) == ESP_OK)
+        {
+            is_binary = strcmp(value, "binary") == 0;
+            is_valid = is_binary || strcmp(value, "json") == 0;
+        }
+
+        if (!is_valid)
+        {
+            return SendJsonResponse(req, "400 Bad Request", ConstructFailedJsonResponse(400, "Bad Request", "Expected from and to in milliseconds and format json or binary"));
+        }
+    }
+
+    if (from_ms > to_ms)
+    {
+        return SendJsonResponse(req, "400 Bad Request", ConstructFailedJsonResponse(400, "Bad Request", "from is after to"));
+    }
+
+    // Streamed from one flash chunk at a time, the matching events are never held in memory.
+    // A binary record is the time in milliseconds (int64 little endian) followed by the state byte.
+    std::unique_ptr<char[]> chunk(new char[HISTORY_CHUNK_SIZE]);
+    size_t chunk_length = 0;
+    if (is_binary)
+    {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_type(req, "application/octet-stream"));
+    }
+    else
+    {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_type(req, "application/json"));
+        chunk_length = snprintf(chunk.get(), HISTORY_CHUNK_SIZE, "{\"from\":%" PRId64 ",\"to\":%" PRId64 ",\"events\":[", from_ms, to_ms);
+    }
+
+    esp_err_t status = ESP_OK;
+    uint32_t sent_count = 0;
+    StateHistoryLog::QueryResult result = _state_history->GetLog().Query(from_ms, to_ms, [&](const HistoryEvent& event) {
+        // Room for the longest JSON event
+        if (chunk_length + 32 > HISTORY_CHUNK_SIZE)
+        {
+            status = httpd_resp_send_chunk(req, chunk.get(), chunk_length);
+            chunk_length = 0;
+            if (status != ESP_OK)
+            {
+                return false;
+            }
+        }
+
+        if (is_binary)
+        {
+            memcpy(chunk.get() + chunk_length, &event.time_ms, sizeof(event.time_ms));
+            chunk[chunk_length + sizeof(event.time_ms)] = event.state;
+            chunk_length += sizeof(event.time_ms) + 1;
+        }
+        else
+        {
+            chunk_length += snprintf(chunk.get() + chunk_length, HISTORY_CHUNK_SIZE - chunk_length, "%s[%" PRId64 ",%d]",
+                                     sent_count > 0 ? "," : "", event.time_ms, event.state);
+        }
+        sent_count++;
+        return true;
+    });
+
+    if (status != ESP_OK)
+    {
+        ESP_LOGW(_TAG, "Failed to stream the history after %lu events %s", sent_count, esp_err_to_name(status));
+        return status;
+    }
+
+    if (!is_binary)
+    {
+        // The state before the range is only known once the query is done
+        char initial_state[8] = "null";
+        if (result.initial_state >= 0)
+        {
+            snprintf(initial_state, sizeof(initial_state), "%d", result.initial_state);
+        }
+
+        if (chunk_length + 64 > HISTORY_CHUNK_SIZE)
+        {
+            status = httpd_resp_send_chunk(req, chunk.get(), chunk_length);
+            chunk_length = 0;
+        }
+        chunk_length += snprintf(chunk.get() + chunk_length, HISTORY_CHUNK_SIZE - chunk_length, "],\"count\":%lu,\"initial_state\":%s}",
+                                 result.event_count, initial_state);
+    }
+
+    if (status == ESP_OK && chunk_length > 0)
+    {
+        status = httpd_resp_send_chunk(req, chunk.get(), chunk_length);
+    }
+    if (status != ESP_OK)
+    {
+        return status;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
 esp_err_t HttpServer::NotFoundHandler(httpd_req_t* req, httpd_err_code_t error)
 {
     // Set up the JSON object
@@ -419,15 +955,105 @@ void HttpServer::BroadCastMessage()
         .len = message.length()
     };
 
+    std::lock_guard<std::mutex> lock(_clientsMutex);
     for (std::unordered_map<int, int>::iterator it = _clients.begin(); it != _clients.end(); it++)
     {
+        // Plain HTTP connections are tracked too, they must not receive websocket frames
+        if (httpd_ws_get_fd_info(_server, it->first) != HTTPD_WS_CLIENT_WEBSOCKET)
+        {
+            continue;
+        }
+
         ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_ws_send_frame_async(_server, it->first, &ws_packet));
     }
 }
 
+void HttpServer::AdvertiseServices(uint16_t port)
+{
+    esp_timer_create_args_t txt_update_timer_args = {};
+    txt_update_timer_args.callback = &TxtUpdateTimerStatic;
+    txt_update_timer_args.arg = this;
+    txt_update_timer_args.name = "mdns_txt_update";
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_create(&txt_update_timer_args, &_txt_update_timer));
+
+    // A single browse for _ledctl._tcp returns the capabilities and state of the whole fleet
+    std::string state = _led->GetState() == 1 ? "on" : "off";
+    std::string state_version = std::to_string(_state_version);
+    mdns_txt_item_t led_control_txt_records[] = {
+        {"fw", esp_app_get_description()->version},
+        {"ch", "1"},
+        {"proto", _is_tls ? "https,wss" : "http,ws"},
+        {"path", "/led"},
+        {"ws", "/wsled"},
+        {"sv", state_version.c_str()},
+        {"state", state.c_str()}
+    };
+
+    ESP_ERROR_CHECK_WITHOUT_ABORT(mdns_service_add(NULL, _is_tls ? "_https" : "_http", "_tcp", port, NULL, 0));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(mdns_service_add(NULL, "_ledctl", "_tcp", port, led_control_txt_records,
+        sizeof(led_control_txt_records) / sizeof(led_control_txt_records[0])));
+
+    _last_txt_update_time_us = esp_timer_get_time();
+}
+
+void HttpServer::OnStateChanged()
+{
+    BroadCastMessage();
+
+    if (!_txt_update_timer)
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_txtRecordsMutex);
+    _state_version++;
+    if (_is_txt_update_pending)
+    {
+        // The pending update will pick up the latest state
+        return;
+    }
+
+    int64_t elapsed_time_us = esp_timer_get_time() - _last_txt_update_time_us;
+    int64_t min_interval_us = (int64_t)_min_txt_update_interval_ms * 1000;
+    if (elapsed_time_us < min_interval_us)
+    {
+        _is_txt_update_pending = true;
+        esp_timer_start_once(_txt_update_timer, min_interval_us - elapsed_time_us);
+        return;
+    }
+
+    lock.unlock();
+    UpdateStateTxtRecords();
+}
+
+void HttpServer::UpdateStateTxtRecords()
+{
+    std::string state_version;
+    {
+        std::lock_guard<std::mutex> lock(_txtRecordsMutex);
+        _is_txt_update_pending = false;
+        _last_txt_update_time_us = esp_timer_get_time();
+        state_version = std::to_string(_state_version);
+    }
+
+    std::string state = _led->GetState() == 1 ? "on" : "off";
+    ESP_ERROR_CHECK_WITHOUT_ABORT(mdns_service_txt_item_set("_ledctl", "_tcp", "state", state.c_str()));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(mdns_service_txt_item_set("_ledctl", "_tcp", "sv", state_version.c_str()));
+
+    ESP_LOGI(_TAG, "Updated mDNS TXT records, state version: %s", state_version.c_str());
+}
+
+// Under TLS this runs after the handshake, see StartTls
 esp_err_t HttpServer::OnOpenConnection(int socket_file_descriptor)
 {
     ESP_LOGI(_TAG, "A new connection is made ID: %d", socket_file_descriptor);
+    if (!_admission_control.OnOpen(socket_file_descriptor, GetPeerAddress(socket_file_descriptor), esp_timer_get_time()))
+    {
+        // httpd closes the socket when the open callback fails
+        ESP_LOGW(_TAG, "Refused the connection id: %d, its address opens connections too fast", socket_file_descriptor);
+        return ESP_FAIL;
+    }
+
     AddClient(socket_file_descriptor, socket_file_descriptor);
     return ESP_OK;
 }
@@ -436,10 +1062,35 @@ esp_err_t HttpServer::OnCloseConnection(int socket_file_descriptor)
 {
     ESP_LOGI(_TAG, "The connection is closed id: %d", socket_file_descriptor);
     RemoveClient(socket_file_descriptor);
+    _admission_control.OnClose(socket_file_descriptor);
     close(socket_file_descriptor);
     return ESP_OK;
 }
 
+uint32_t HttpServer::GetPeerAddress(int socket_file_descriptor)
+{
+    struct sockaddr_storage peer_address = {};
+    socklen_t peer_address_length = sizeof(peer_address);
+    if (getpeername(socket_file_descriptor, reinterpret_cast<struct sockaddr*>(&peer_address), &peer_address_length) != 0)
+    {
+        return 0;
+    }
+
+    if (peer_address.ss_family == AF_INET)
+    {
+        return reinterpret_cast<struct sockaddr_in*>(&peer_address)->sin_addr.s_addr;
+    }
+
+    // httpd listens on an IPv6 socket, IPv4 clients show up as ::ffff:a.b.c.d
+    uint32_t address_words[4];
+    memcpy(address_words, &reinterpret_cast<struct sockaddr_in6*>(&peer_address)->sin6_addr, sizeof(address_words));
+    if (address_words[0] == 0 && address_words[1] == 0 && address_words[2] == htonl(0xFFFF))
+    {
+        return address_words[3];
+    }
+    return address_words[0] ^ address_words[1] ^ address_words[2] ^ address_words[3];
+}
+
 void HttpServer::AddClient(const int& client_id, const int& file_descriptor)
 {
     std::lock_guard<std::mutex> lock(_clientsMutex);
@@ -482,29 +1133,50 @@ esp_err_t HttpServer::SendWebsocketTextMessage(httpd_req_t* req, const std::stri
     return status;
 }
 
-/* Static Handler Wrapper */
-esp_err_t HttpServer::RootHandlerStatic(httpd_req_t* req)
+esp_err_t HttpServer::SendJsonResponse(httpd_req_t* req, const char* status, const std::string& body)
 {
-    auto* http_server = reinterpret_cast<HttpServer*>(req->user_ctx);
-    return http_server->RootHandler(req);
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_type(req, "application/json"));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_set_status(req, status));
+    return httpd_resp_send(req, body.c_str(), body.length());
 }
 
-esp_err_t HttpServer::LedControlHttpHandlerStatic(httpd_req_t* req)
+esp_err_t HttpServer::ReceiveRequestBody(httpd_req_t* req, std::unique_ptr<char[]>& output_body)
 {
-    auto* http_server = reinterpret_cast<HttpServer*>(req->user_ctx);
-    return http_server->LedControlHttpHandler(req);
+    output_body.reset(new char[req->content_len + 1]);
+
+    size_t received_length = 0;
+    while (received_length < req->content_len)
+    {
+        int http_read_content_status = httpd_req_recv(req, output_body.get() + received_length, req->content_len - received_length);
+        if (http_read_content_status == HTTPD_SOCK_ERR_TIMEOUT)
+        {
+            continue;
+        }
+
+        if (http_read_content_status <= 0)
+        {
+            ESP_LOGI(_TAG, "Reading the request content is not successul");
+            SendJsonResponse(req, "400 Bad Request", ConstructFailedJsonResponse(400, "Bad Request", "Connection closed before the body was received"));
+            return ESP_FAIL;
+        }
+        received_length += http_read_content_status;
+    }
+
+    output_body[received_length] = '\0';
+    return ESP_OK;
 }
 
+/* Static Handler Wrapper */
 esp_err_t HttpServer::NotFoundHandlerStatic(httpd_req_t* req, httpd_err_code_t error)
 {
     auto* http_server = reinterpret_cast<HttpServer*>(req->user_ctx);
     return http_server->NotFoundHandler(req, error);
 }
 
-esp_err_t HttpServer::LedControlWebSocketHandlerStatic(httpd_req_t* req)
+esp_err_t HttpServer::DispatchStatic(httpd_req_t* req)
 {
-    auto* http_server = reinterpret_cast<HttpServer*>(req->user_ctx);
-    return http_server->LedControlWebsocketHandler(req);
+    auto* route_context = reinterpret_cast<RouteContext*>(req->user_ctx);
+    return route_context->server->Dispatch(req, *route_context->route);
 }
 
 esp_err_t HttpServer::OnOpenConnectionStatic(httpd_handle_t server_handle, int socket_file_descriptor)
@@ -519,6 +1191,12 @@ void HttpServer::OnCloseConnectionStatic(httpd_handle_t server_handle, int socke
     http_server->OnCloseConnection(socket_file_descriptor);
 }
 
+void HttpServer::TxtUpdateTimerStatic(void* arg)
+{
+    auto* http_server = reinterpret_cast<HttpServer*>(arg);
+    http_server->UpdateStateTxtRecords();
+}
+
 /* Helper Methods Implementation */
 std::string HttpServer::ConstructFailedJsonResponse(const uint16_t& error_status, const std::string& error_code, const std::string& error_message)
 {
@@ -544,6 +1222,28 @@ std::string HttpServer::ConstructCurrentSstateMessage(const std::string& current
     return respones_string;
 }
 
+std::string HttpServer::ConstructCommandReplyMessage(const std::string& current_state, const char* request)
+{
+    cJSON* request_json = cJSON_Parse(request);
+    cJSON* id_item = cJSON_GetObjectItem(request_json, "id");
+    if (!cJSON_IsNumber(id_item))
+    {
+        cJSON_Delete(request_json);
+        return ConstructCurrentSstateMessage(current_state);
+    }
+
+    cJSON* response = cJSON_CreateObject();
+    cJSON_AddStringToObject(response, "status", current_state.c_str());
+    cJSON_AddNumberToObject(response, "id", id_item->valuedouble);
+    char* response_buffer = cJSON_PrintUnformatted(response);
+    std::string response_string = response_buffer ? response_buffer : ConstructCurrentSstateMessage(current_state);
+
+    cJSON_free(response_buffer);
+    cJSON_Delete(response);
+    cJSON_Delete(request_json);
+    return response_string;
+}
+
 bool HttpServer::ParseStateRequestJson(const char* request, std::string& output_parsed_state)
 {
     cJSON* recevied_payload_json = cJSON_Parse(request);
@@ -563,17 +1263,16 @@ bool HttpServer::ParseStateRequestJson(const char* request, std::string& output_
     {
         ESP_LOGW(_TAG, "The state item cannot be parsed");
         output_parsed_state = "Must contain member \"state\"";
+        cJSON_Delete(recevied_payload_json);
         return false;
     }
     ESP_LOGI(_TAG, "Got the state item");
 
+    // The string belongs to the tree, copy it out before the tree is deleted
     const char* state = state_item->valuestring;
-    if (strcmp(state, "on") != 0 && strcmp(state, "off") != 0)
-    {
-        output_parsed_state = "State doesn't contain the correct command";
-        return false;
-    }
+    bool is_known_state = strcmp(state, "on") == 0 || strcmp(state, "off") == 0;
+    output_parsed_state = is_known_state ? state : "State doesn't contain the correct command";
 
-    output_parsed_state = state;
-    return true;
+    cJSON_Delete(recevied_payload_json);
+    return is_known_state;
 }
\ No newline at end of file
@@ -3,51 +3,199 @@
 
 #include <esp_log.h>
 #include <esp_http_server.h>
+#include <esp_https_server.h>
+#include <esp_timer.h>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <unordered_map>
 #include <vector>
 #include <cJSON.h>
 #include <mdns.h>
 #include "LedControl.hpp"
+#include "GroupSync.hpp"
+#include "WebAssets.hpp"
+#include "AdmissionControl.hpp"
+#include "TaskProfiler.hpp"
+#include "ButtonInput.hpp"
+#include "StateHistory.hpp"
+#include "TlsCredentials.hpp"
+#include "RequestPipeline.hpp"
+
+#ifndef ROUTE_FLAG_NONE
+#define ROUTE_FLAG_NONE 0x0
+#endif
+
+#ifndef ROUTE_FLAG_WEBSOCKET
+#define ROUTE_FLAG_WEBSOCKET 0x1
+#endif
+
+// Only registered when the server was given a GroupSync
+#ifndef ROUTE_FLAG_REQUIRES_GROUP_SYNC
+#define ROUTE_FLAG_REQUIRES_GROUP_SYNC 0x2
+#endif
+
+// Only registered when the server was given a TaskProfiler
+#ifndef ROUTE_FLAG_REQUIRES_TASK_PROFILER
+#define ROUTE_FLAG_REQUIRES_TASK_PROFILER 0x4
+#endif
+
+// Only registered when the server was given a ButtonInput
+#ifndef ROUTE_FLAG_REQUIRES_BUTTON_INPUT
+#define ROUTE_FLAG_REQUIRES_BUTTON_INPUT 0x8
+#endif
+
+// Only registered when the server was given a StateHistory
+#ifndef ROUTE_FLAG_REQUIRES_STATE_HISTORY
+#define ROUTE_FLAG_REQUIRES_STATE_HISTORY 0x10
+#endif
+
+// The body limit is the size of the assets slot an upload writes, looked up at dispatch
+#ifndef ROUTE_FLAG_ASSET_SLOT_BODY
+#define ROUTE_FLAG_ASSET_SLOT_BODY 0x20
+#endif
+
+// Port of the HTTPS and WSS server, used instead of the plain one when TLS credentials are given
+#ifndef HTTP_SERVER_TLS_PORT
+#define HTTP_SERVER_TLS_PORT 443
+#endif
 
 class HttpServer
 {
 private:
+    struct Route
+    {
+        const char* uri;
+        httpd_method_t method;
+        uint32_t content_types;
+        size_t max_body_size;
+        esp_err_t (HttpServer::*handler)(httpd_req_t* req);
+        uint32_t flags;
+    };
+
+    struct RouteContext
+    {
+        HttpServer* server;
+        const Route* route;
+    };
+
     httpd_handle_t _server = NULL;
     std::shared_ptr<LedControl> _led;
+    uint32_t _listener_id = 0;
+    std::shared_ptr<GroupSync> _group_sync;
+    std::shared_ptr<TaskProfiler> _task_profiler;
+    std::shared_ptr<ButtonInput> _button_input;
+    std::shared_ptr<StateHistory> _state_history;
+    std::shared_ptr<TlsCredentials> _tls_credentials;
+    bool _is_tls = false;
+    WebAssets _web_assets;
     std::string _host_name;
+
+    // Only used from the httpd task: connection callbacks and the dispatch
+    AdmissionControl _admission_control;
+    uint32_t _throttled_websocket_close_count = 0;
     std::unordered_map<int, int> _clients;
     std::mutex _clientsMutex;
 
+    // mDNS TXT records, the state version increments on every LED state change
+    std::mutex _txtRecordsMutex;
+    uint32_t _state_version = 0;
+    int64_t _last_txt_update_time_us = 0;
+    bool _is_txt_update_pending = false;
+    esp_timer_handle_t _txt_update_timer = NULL;
+
     static const char* _TAG;
 
+    static constexpr PrecomputedResponse _unauthorized_response = MakePrecomputedResponse(
+        "401 Unauthorized", "{\"status\":401,\"error\":\"Unauthorized\",\"message\":\"A valid bearer token is required\"}");
+
+    // Sending it needs no heap, which is what ran out
+    static constexpr PrecomputedResponse _out_of_memory_response = MakePrecomputedResponse(
+        "500 Internal Server Error", "{\"status\":500,\"error\":\"Internal Server Error\",\"message\":\"Out of memory\"}");
+
+    static constexpr PrecomputedResponse _too_many_requests_response = MakePrecomputedResponse(
+        "429 Too Many Requests", "{\"status\":429,\"error\":\"Too Many Requests\",\"message\":\"The request rate limit was exceeded\"}");
+
+    // Close frame payload: status 1008 (policy violation) and the reason
+    static constexpr uint8_t _rate_limited_close_payload[] = {0x03, 0xF0, 'r', 'a', 't', 'e', ' ', 'l', 'i', 'm', 'i', 't', 'e', 'd'};
+
+    // Browsers of a large fleet see every TXT update, so they are sent at most this often
+    static constexpr uint32_t _min_txt_update_interval_ms = 1000;
+
     esp_err_t RootHandler(httpd_req_t* req);
+    esp_err_t AssetUploadHandler(httpd_req_t* req);
     esp_err_t LedControlHttpHandler(httpd_req_t* req);
     esp_err_t NotFoundHandler(httpd_req_t* req, httpd_err_code_t error);
     esp_err_t LedControlWebsocketHandler(httpd_req_t* req);
+    esp_err_t GroupHandler(httpd_req_t* req);
+    esp_err_t GroupLedHandler(httpd_req_t* req);
+    esp_err_t AdmissionHandler(httpd_req_t* req);
+    esp_err_t TaskProfileHandler(httpd_req_t* req);
+    esp_err_t ButtonHandler(httpd_req_t* req);
+    esp_err_t HistoryHandler(httpd_req_t* req);
     void BroadCastMessage();
 
+    esp_err_t StartTls(const httpd_config_t& server_config);
+
+    void AdvertiseServices(uint16_t port);
+    void OnStateChanged();
+    void UpdateStateTxtRecords();
+
     void AddClient(const int& client_id, const int& file_descriptor);
     void RemoveClient(const int& client_id);
 
     esp_err_t SendWebsocketTextMessage(httpd_req_t* req, const std::string& message);
+    esp_err_t SendJsonResponse(httpd_req_t* req, const char* status, const std::string& body);
+
+    /// @brief Read the whole request body into a null terminated buffer
+    /// @return ESP_OK, or an error after the error response was already sent
+    esp_err_t ReceiveRequestBody(httpd_req_t* req, std::unique_ptr<char[]>& output_body);
 
     esp_err_t OnOpenConnection(int socket_file_descriptor);
     esp_err_t OnCloseConnection(int socket_file_descriptor);
+    static uint32_t GetPeerAddress(int socket_file_descriptor);
+
+    esp_err_t Dispatch(httpd_req_t* req, const Route& route);
+    esp_err_t RejectThrottledRequest(httpd_req_t* req, bool is_websocket);
+    /// @brief Run the shared RequestPipeline stages with the limits of the route
+    /// @return nullptr to run the handler, otherwise the response to send instead
+    const PrecomputedResponse* ValidateRequest(httpd_req_t* req, const Route& route);
+    static bool ParseMilliseconds(const char* text, int64_t& output_milliseconds);
+    static esp_err_t SendPrecomputedResponse(httpd_req_t* req, const PrecomputedResponse& response);
+
+    // Registered in this order, httpd matches the first fitting entry so the wildcard stays last.
+    // httpd only calls a handler for its method, the pipeline checks the body and its type.
+    static constexpr Route _routes[] = {
+        // uri           method     content types              max body  handler                                   flags
+        {"/led",         HTTP_POST, CONTENT_TYPE_JSON,         256,      &HttpServer::LedControlHttpHandler,       ROUTE_FLAG_NONE},
+        {"/wsled",       HTTP_GET,  CONTENT_TYPE_NONE,         0,        &HttpServer::LedControlWebsocketHandler,  ROUTE_FLAG_WEBSOCKET},
+        {"/assets",      HTTP_PUT,  CONTENT_TYPE_OCTET_STREAM, 0,        &HttpServer::AssetUploadHandler,          ROUTE_FLAG_ASSET_SLOT_BODY},
+        {"/group",       HTTP_GET,  CONTENT_TYPE_NONE,         0,        &HttpServer::GroupHandler,                ROUTE_FLAG_REQUIRES_GROUP_SYNC},
+        {"/group",       HTTP_POST, CONTENT_TYPE_JSON,         256,      &HttpServer::GroupHandler,                ROUTE_FLAG_REQUIRES_GROUP_SYNC},
+        {"/group/led",   HTTP_POST, CONTENT_TYPE_JSON,         256,      &HttpServer::GroupLedHandler,             ROUTE_FLAG_REQUIRES_GROUP_SYNC},
+        {"/admission",   HTTP_GET,  CONTENT_TYPE_NONE,         0,        &HttpServer::AdmissionHandler,            ROUTE_FLAG_NONE},
+        {"/debug/tasks", HTTP_GET,  CONTENT_TYPE_NONE,         0,        &HttpServer::TaskProfileHandler,          ROUTE_FLAG_REQUIRES_TASK_PROFILER},
+        {"/buttons",     HTTP_GET,  CONTENT_TYPE_NONE,         0,        &HttpServer::ButtonHandler,               ROUTE_FLAG_REQUIRES_BUTTON_INPUT},
+        {"/history",     HTTP_GET,  CONTENT_TYPE_NONE,         0,        &HttpServer::HistoryHandler,              ROUTE_FLAG_REQUIRES_STATE_HISTORY},
+        {"/*",           HTTP_GET,  CONTENT_TYPE_NONE,         0,        &HttpServer::RootHandler,                 ROUTE_FLAG_NONE}
+    };
+    static constexpr size_t _route_count = sizeof(_routes) / sizeof(_routes[0]);
+
+    RouteContext _route_contexts[_route_count] = {};
 public:
-    HttpServer(httpd_handle_t server, std::shared_ptr<LedControl> led, std::string host_name = "");
+    HttpServer(httpd_handle_t server, std::shared_ptr<LedControl> led, std::string host_name = "", std::shared_ptr<GroupSync> group_sync = nullptr,
+               std::shared_ptr<TaskProfiler> task_profiler = nullptr, std::shared_ptr<ButtonInput> button_input = nullptr,
+               std::shared_ptr<StateHistory> state_history = nullptr, std::shared_ptr<TlsCredentials> tls_credentials = nullptr);
     ~HttpServer();
 
     esp_err_t Start();
     esp_err_t Stop();
 
-    static esp_err_t RootHandlerStatic(httpd_req_t* req);
-    static esp_err_t LedControlHttpHandlerStatic(httpd_req_t* req);
+    static esp_err_t DispatchStatic(httpd_req_t* req);
     static esp_err_t NotFoundHandlerStatic(httpd_req_t* req, httpd_err_code_t error);
-    static esp_err_t LedControlWebSocketHandlerStatic(httpd_req_t* req);
     static esp_err_t OnOpenConnectionStatic(httpd_handle_t server_handle, int socket_file_descriptor);
     static void OnCloseConnectionStatic(httpd_handle_t server_handle, int socket_file_descriptor);
+    static void TxtUpdateTimerStatic(void* arg);
 
     httpd_handle_t GetServer();
 
@@ -55,6 +203,11 @@ public:
     static std::string ConstructFailedJsonResponse(const uint16_t& error_status, const std::string& error_code, const std::string& error_message);
     static std::string ConstructCurrentSstateMessage(const std::string& current_state);
 
+    /// @brief The state message answering a websocket command. A numeric "id" in the command is echoed
+    /// back, so the client can tell its reply from the broadcasts of the same state.
+    /// @param request The command as received
+    static std::string ConstructCommandReplyMessage(const std::string& current_state, const char* request);
+
     
     /// @brief Parse the JSON request for the state
     /// {
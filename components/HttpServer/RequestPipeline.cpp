@@ -0,0 +1,53 @@
+#include "RequestPipeline.hpp"
+#include <cstring>
+#include <strings.h>
+
+const PrecomputedResponse* RequestPipeline::Run(const RequestSummary& request, const RequestLimits& limits)
+{
+    for (const Stage& stage : _stages)
+    {
+        const PrecomputedResponse* rejection = stage(request, limits);
+        if (rejection)
+        {
+            return rejection;
+        }
+    }
+    return nullptr;
+}
+
+const PrecomputedResponse* RequestPipeline::ValidateBodySize(const RequestSummary& request, const RequestLimits& limits)
+{
+    return request.content_length > limits.max_body_size ? &_payload_too_large_response : nullptr;
+}
+
+const PrecomputedResponse* RequestPipeline::ValidateContentType(const RequestSummary& request, const RequestLimits& limits)
+{
+    if (limits.content_types == CONTENT_TYPE_NONE)
+    {
+        return nullptr;
+    }
+
+    if (!request.content_type)
+    {
+        return &_missing_content_type_response;
+    }
+
+    if (!(MatchContentType(request.content_type) & limits.content_types))
+    {
+        return &_unsupported_content_type_response;
+    }
+    return nullptr;
+}
+
+uint32_t RequestPipeline::MatchContentType(const char* content_type)
+{
+    size_t media_type_length = strcspn(content_type, "; \t");
+    for (const ContentTypeName& content_type_name : _content_type_names)
+    {
+        if (content_type_name.name_length == media_type_length && strncasecmp(content_type, content_type_name.name, media_type_length) == 0)
+        {
+            return content_type_name.content_type;
+        }
+    }
+    return CONTENT_TYPE_NONE;
+}
\ No newline at end of file
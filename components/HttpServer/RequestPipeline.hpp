@@ -0,0 +1,104 @@
+#ifndef REQUESTPIPELINE_HPP
+#define REQUESTPIPELINE_HPP
+
+// Validation every HTTP route shares before its handler runs. This file has no ESP-IDF dependency:
+// HttpServer reads the few request fields the stages need out of httpd once and passes the route
+// limits, so tools/RequestPipelineBench measures the per request cost on the host.
+//
+// Nothing here allocates, every rejection is a response built at compile time.
+
+#include <cstddef>
+#include <cstdint>
+
+// Content types a route accepts, checked once before its handler runs
+#ifndef CONTENT_TYPE_NONE
+#define CONTENT_TYPE_NONE 0x0
+#endif
+
+#ifndef CONTENT_TYPE_JSON
+#define CONTENT_TYPE_JSON 0x1
+#endif
+
+#ifndef CONTENT_TYPE_OCTET_STREAM
+#define CONTENT_TYPE_OCTET_STREAM 0x2
+#endif
+
+// Longest Content-Type value the pipeline looks at, anything longer cannot be an accepted type
+#ifndef REQUEST_CONTENT_TYPE_MAX_LENGTH
+#define REQUEST_CONTENT_TYPE_MAX_LENGTH 39
+#endif
+
+/// @brief Error response built at compile time, sending it needs no formatting or allocation
+struct PrecomputedResponse
+{
+    const char* status;
+    const char* body;
+    size_t body_length;
+};
+
+template <size_t body_size>
+constexpr PrecomputedResponse MakePrecomputedResponse(const char* status, const char (&body)[body_size])
+{
+    return {status, body, body_size - 1};
+}
+
+/// @brief The request fields the stages look at
+struct RequestSummary
+{
+    size_t content_length;
+    // nullptr without the header, an empty string if the value was too long to read
+    const char* content_type;
+};
+
+/// @brief What a route accepts. The body limit is resolved at dispatch, it may depend on the device.
+struct RequestLimits
+{
+    uint32_t content_types;
+    size_t max_body_size;
+};
+
+class RequestPipeline
+{
+public:
+    /// @brief Run every stage in order
+    /// @return nullptr to run the handler, otherwise the response to send instead
+    static const PrecomputedResponse* Run(const RequestSummary& request, const RequestLimits& limits);
+
+    static const PrecomputedResponse* ValidateBodySize(const RequestSummary& request, const RequestLimits& limits);
+    static const PrecomputedResponse* ValidateContentType(const RequestSummary& request, const RequestLimits& limits);
+
+    /// @brief Look the media type up, parameters such as "; charset=utf-8" are ignored
+    /// @return One of the CONTENT_TYPE_ values, CONTENT_TYPE_NONE if it is not known
+    static uint32_t MatchContentType(const char* content_type);
+
+    static constexpr PrecomputedResponse _payload_too_large_response = MakePrecomputedResponse(
+        "413 Payload Too Large", "{\"status\":413,\"error\":\"Payload Too Large\",\"message\":\"The request body is too large\"}");
+    static constexpr PrecomputedResponse _missing_content_type_response = MakePrecomputedResponse(
+        "400 Bad Request", "{\"status\":400,\"error\":\"Bad Request\",\"message\":\"Must have header Content-Type\"}");
+    static constexpr PrecomputedResponse _unsupported_content_type_response = MakePrecomputedResponse(
+        "415 Unsupported Media Type", "{\"status\":415,\"error\":\"Unsupported Media Type\",\"message\":\"The Content-Type is not accepted by this resource\"}");
+
+private:
+    /// @brief Returns nullptr to continue, otherwise the error response to send
+    typedef const PrecomputedResponse* (*Stage)(const RequestSummary& request, const RequestLimits& limits);
+
+    struct ContentTypeName
+    {
+        uint32_t content_type;
+        const char* name;
+        size_t name_length;
+    };
+
+    // The cheap size check first, it needs no header
+    static constexpr Stage _stages[] = {
+        &ValidateBodySize,
+        &ValidateContentType
+    };
+
+    static constexpr ContentTypeName _content_type_names[] = {
+        {CONTENT_TYPE_JSON, "application/json", sizeof("application/json") - 1},
+        {CONTENT_TYPE_OCTET_STREAM, "application/octet-stream", sizeof("application/octet-stream") - 1}
+    };
+};
+
+#endif
\ No newline at end of file
@@ -1,5 +1,6 @@
 // Establishing WebSocket connection
-const SERVER_ENDPOINT = 'ws://baobao.local/wsled';
+// Same host and scheme as the page, wss:// when it was loaded over HTTPS
+const SERVER_ENDPOINT = (location.protocol === 'https:' ? 'wss://' : 'ws://') + location.host + '/wsled';
 const socket = new WebSocket(SERVER_ENDPOINT);
 
 // Sends a message to the http server
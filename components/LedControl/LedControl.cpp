@@ -16,13 +16,22 @@ LedControl::LedControl(gpio_num_t led_pin_number)
 void LedControl::TurnOn()
 {
     ESP_LOGI("LedControl", "Turn on Led Pin: %d", _led_pin_number);
-    gpio_set_level(_led_pin_number, LED_ON);
+    SetLevel(LED_ON);
 }
 
 void LedControl::TurnOff()
 {
     ESP_LOGI("LedControl", "Turn off Led Pin: %d", _led_pin_number);
-    gpio_set_level(_led_pin_number, LED_OFF);
+    SetLevel(LED_OFF);
+}
+
+int LedControl::Toggle()
+{
+    std::lock_guard<std::mutex> lock(_stateMutex);
+    int level = gpio_get_level(_led_pin_number) == LED_ON ? LED_OFF : LED_ON;
+    ESP_LOGI("LedControl", "Toggle Led Pin: %d to %d", _led_pin_number, level);
+    ApplyLevel(level);
+    return level;
 }
 
 int LedControl::GetState()
@@ -31,4 +40,48 @@ int LedControl::GetState()
     ESP_LOGI("LedControl", "Get current state %d", level);
 
     return level;
+}
+
+uint32_t LedControl::AddStateChangeListener(std::function<void(int)> listener)
+{
+    std::lock_guard<std::mutex> lock(_stateMutex);
+    uint32_t listener_id = _next_listener_id++;
+    _state_change_listeners.push_back({listener_id, listener});
+    return listener_id;
+}
+
+void LedControl::RemoveStateChangeListener(uint32_t listener_id)
+{
+    std::lock_guard<std::mutex> lock(_stateMutex);
+    for (std::vector<StateChangeListener>::iterator it = _state_change_listeners.begin(); it != _state_change_listeners.end(); it++)
+    {
+        if (it->id == listener_id)
+        {
+            _state_change_listeners.erase(it);
+            return;
+        }
+    }
+}
+
+void LedControl::SetLevel(int level)
+{
+    // Held through the notification, so the listeners see the changes in the order they happened
+    std::lock_guard<std::mutex> lock(_stateMutex);
+    ApplyLevel(level);
+}
+
+void LedControl::ApplyLevel(int level)
+{
+    int previous_level = gpio_get_level(_led_pin_number);
+    gpio_set_level(_led_pin_number, level);
+
+    if (previous_level == level)
+    {
+        return;
+    }
+
+    for (const StateChangeListener& listener : _state_change_listeners)
+    {
+        listener.callback(level);
+    }
 }
\ No newline at end of file
@@ -2,6 +2,9 @@
 #define LEDCONTROL_HPP
 #include <driver/gpio.h>
 #include <esp_log.h>
+#include <functional>
+#include <mutex>
+#include <vector>
 
 #ifndef LED_ON
 #define LED_ON 1
@@ -26,12 +29,43 @@ class LedControl {
     void TurnOn();
     void TurnOff();
 
+    /// @brief Switch to the other state. The read and the write happen under one lock, so a command
+    /// from another source cannot slip in between and be undone.
+    /// @return The new state (LED_ON or LED_OFF)
+    int Toggle();
+
     /// @brief Get the current LED's state. true => on false => off
     /// @return 
     int GetState();
 
+    /// @brief Register a callback that is invoked after the LED level actually changes.
+    /// Listeners run in the context of whoever issued the command (httpd task, MQTT task, ...),
+    /// in the order of the changes. They must not block and must not issue LED commands.
+    /// Listeners can be added and removed while the command sources are running.
+    /// @param listener Called with the new state (LED_ON or LED_OFF)
+    /// @return Id for RemoveStateChangeListener, never 0
+    uint32_t AddStateChangeListener(std::function<void(int)> listener);
+
+    /// @brief Unregister a listener. Once this returns the listener is not running and will not be called again,
+    /// so an object can remove the listener capturing it from its destructor.
+    void RemoveStateChangeListener(uint32_t listener_id);
+
     private:
+    struct StateChangeListener
+    {
+        uint32_t id;
+        std::function<void(int)> callback;
+    };
+
     gpio_num_t _led_pin_number;
+    // Guards the read-modify-write of the level and the listeners, held while they are notified
+    std::mutex _stateMutex;
+    std::vector<StateChangeListener> _state_change_listeners;
+    uint32_t _next_listener_id = 1;
+
+    void SetLevel(int level);
+    /// @brief Set the level and notify the listeners, the caller holds _stateMutex
+    void ApplyLevel(int level);
 };
 
 #endif
\ No newline at end of file
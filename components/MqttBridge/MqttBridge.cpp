@@ -0,0 +1,368 @@
+#include "MqttBridge.hpp"
+#include "HttpServer.hpp"
+#include <esp_random.h>
+
+const char* MqttBridge::_TAG = "MqttBridge";
+
+MqttBridge::MqttBridge(std::shared_ptr<LedControl> led, std::string broker_uri, std::string topic_prefix)
+    : _led(led), _broker_uri(broker_uri), _outbound_queue(_max_queue_length),
+      _reconnect_backoff(_initial_reconnect_delay_ms, _max_reconnect_delay_ms)
+{
+    _command_topic = topic_prefix + "/set";
+    _state_topic = topic_prefix + "/state";
+    _telemetry_topic = topic_prefix + "/telemetry";
+}
+
+MqttBridge::~MqttBridge()
+{
+    Stop();
+}
+
+esp_err_t MqttBridge::Start()
+{
+    if (_client)
+    {
+        ESP_LOGI(_TAG, "Bridge already started");
+        return ESP_OK;
+    }
+
+    if (_broker_uri == "")
+    {
+        ESP_LOGI(_TAG, "No broker configured, the bridge stays disabled");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // esp-mqtt keeps reconnecting on its own, only the delay between attempts comes from our backoff
+    _mqtt_config = {};
+    _mqtt_config.broker.address.uri = _broker_uri.c_str();
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        _reconnect_backoff.Reset();
+        _mqtt_config.network.reconnect_timeout_ms = _reconnect_backoff.NextDelayMs(esp_random());
+    }
+
+    _client = esp_mqtt_client_init(&_mqtt_config);
+    if (!_client)
+    {
+        ESP_LOGE(_TAG, "Failed to initialize the mqtt client");
+        return ESP_FAIL;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        _is_stopping = false;
+        if (xTaskCreate(&PublishTaskStatic, "mqtt_publish", 4096, this, 5, &_publish_task) != pdPASS)
+        {
+            ESP_LOGE(_TAG, "Failed to create the publish task");
+            _publish_task = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    _listener_id = _led->AddStateChangeListener([this](int state) { OnLedStateChanged(state); });
+
+    ESP_ERROR_CHECK(esp_mqtt_client_register_event(_client, MQTT_EVENT_ANY, &OnMqttEventStatic, this));
+
+    ESP_LOGI(_TAG, "Connecting to %s", _broker_uri.c_str());
+    return esp_mqtt_client_start(_client);
+}
+
+esp_err_t MqttBridge::Stop()
+{
+    if (!_client)
+    {
+        return ESP_OK;
+    }
+
+    ESP_LOGI(_TAG, "Stop bridge");
+
+    // Once this returns the listener is not running, nothing enqueues from the LED side anymore
+    if (_listener_id != 0)
+    {
+        _led->RemoveStateChangeListener(_listener_id);
+        _listener_id = 0;
+    }
+
+    esp_err_t stop_status = esp_mqtt_client_stop(_client);
+
+    // The task exits at its next wake up, outside of any lock, and notifies us
+    bool is_task_running = false;
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        is_task_running = _publish_task != NULL;
+        if (is_task_running)
+        {
+            _is_stopping = true;
+            _stopping_task = xTaskGetCurrentTaskHandle();
+            xTaskNotifyGive(_publish_task);
+        }
+    }
+    if (is_task_running)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+
+    esp_mqtt_client_destroy(_client);
+    _client = NULL;
+    _is_connected = false;
+
+    return stop_status;
+}
+
+MqttBridge::Statistics MqttBridge::GetStatistics()
+{
+    std::lock_guard<std::mutex> lock(_queueMutex);
+    Statistics statistics = {};
+    statistics.queue = _outbound_queue.GetStatistics();
+    statistics.reconnect_count = _reconnect_count;
+    return statistics;
+}
+
+void MqttBridge::OnMqttEvent(esp_mqtt_event_handle_t event)
+{
+    switch (event->event_id)
+    {
+    case MQTT_EVENT_CONNECTED:
+    {
+        ESP_LOGI(_TAG, "Connected to the broker");
+        {
+            std::lock_guard<std::mutex> lock(_queueMutex);
+            _is_connected = true;
+            _reconnect_backoff.Reset();
+            // Messages in flight on the old session will never be acknowledged
+            _outbound_queue.OnSessionLost();
+        }
+        ScheduleReconnect();
+
+        esp_mqtt_client_subscribe_single(_client, _command_topic.c_str(), 1);
+
+        // Refresh the retained state in case it changed while we were offline
+        std::string state = _led->GetState() == LED_ON ? "on" : "off";
+        Enqueue(_state_topic, HttpServer::ConstructCurrentSstateMessage(state), 1, true);
+        break;
+    }
+    case MQTT_EVENT_DISCONNECTED:
+    {
+        ESP_LOGW(_TAG, "Disconnected from the broker");
+        {
+            std::lock_guard<std::mutex> lock(_queueMutex);
+            _is_connected = false;
+            _reconnect_count++;
+        }
+        ScheduleReconnect();
+        break;
+    }
+    case MQTT_EVENT_PUBLISHED:
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        _outbound_queue.OnAcknowledged(event->msg_id, esp_timer_get_time());
+        break;
+    }
+    case MQTT_EVENT_DATA:
+    {
+        // Commands are tiny, a fragmented message cannot be a valid command
+        if (event->data_len != event->total_data_len)
+        {
+            ESP_LOGW(_TAG, "Ignoring fragmented message of %d bytes", event->total_data_len);
+            break;
+        }
+
+        std::string topic(event->topic, event->topic_len);
+        if (topic != _command_topic)
+        {
+            break;
+        }
+
+        OnCommandReceived(std::string(event->data, event->data_len));
+        break;
+    }
+    case MQTT_EVENT_ERROR:
+    {
+        ESP_LOGW(_TAG, "Mqtt error type: %d", event->error_handle->error_type);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void MqttBridge::OnCommandReceived(const std::string& payload)
+{
+    std::string parsed_result = "";
+    bool is_parse_successful = HttpServer::ParseStateRequestJson(payload.c_str(), parsed_result);
+
+    if (!is_parse_successful)
+    {
+        ESP_LOGW(_TAG, "Rejected command: %s", parsed_result.c_str());
+        return;
+    }
+
+    if (parsed_result.compare("on") == 0)
+    {
+        ESP_LOGI(_TAG, "Turn on the led");
+        _led->TurnOn();
+    }
+
+    if (parsed_result.compare("off") == 0)
+    {
+        ESP_LOGI(_TAG, "Turn off the led");
+        _led->TurnOff();
+    }
+}
+
+void MqttBridge::OnLedStateChanged(int state)
+{
+    std::string state_string = state == LED_ON ? "on" : "off";
+    Enqueue(_state_topic, HttpServer::ConstructCurrentSstateMessage(state_string), 1, true);
+}
+
+bool MqttBridge::Enqueue(const std::string& topic, const std::string& payload, int qos, bool retain)
+{
+    std::lock_guard<std::mutex> lock(_queueMutex);
+    if (!_outbound_queue.Enqueue(topic, payload, qos, retain, esp_timer_get_time()))
+    {
+        ESP_LOGW(_TAG, "Outbound queue is full, dropped message for %s", topic.c_str());
+        return false;
+    }
+
+    if (_publish_task)
+    {
+        xTaskNotifyGive(_publish_task);
+    }
+    return true;
+}
+
+void MqttBridge::FlushQueue()
+{
+    while (true)
+    {
+        OutboundMessage message;
+        {
+            std::lock_guard<std::mutex> lock(_queueMutex);
+            if (!_is_connected || _is_stopping || !_outbound_queue.Pop(message))
+            {
+                return;
+            }
+        }
+
+        int message_id = esp_mqtt_client_publish(
+            _client,
+            message.topic.c_str(),
+            message.payload.c_str(),
+            message.payload.length(),
+            message.qos,
+            message.retain
+        );
+
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        if (message_id < 0)
+        {
+            ESP_LOGW(_TAG, "Failed to publish to %s", message.topic.c_str());
+            _outbound_queue.OnPublishFailed(message);
+            return;
+        }
+
+        _outbound_queue.OnPublished(message, message_id, esp_timer_get_time());
+    }
+}
+
+void MqttBridge::PublishTask()
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(_telemetry_interval_ms));
+
+        {
+            std::lock_guard<std::mutex> lock(_queueMutex);
+            if (_is_stopping)
+            {
+                break;
+            }
+        }
+
+        // Give bursts of state changes a moment to coalesce before sending
+        vTaskDelay(pdMS_TO_TICKS(_batch_window_ms));
+
+        if (esp_timer_get_time() - _last_telemetry_time_us >= (int64_t)_telemetry_interval_ms * 1000)
+        {
+            EnqueueTelemetry();
+        }
+
+        FlushQueue();
+    }
+
+    // Stop waits for this notification, nothing of the bridge is touched after it
+    TaskHandle_t stopping_task = NULL;
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        stopping_task = _stopping_task;
+        _publish_task = NULL;
+        _stopping_task = NULL;
+    }
+    xTaskNotifyGive(stopping_task);
+    vTaskDelete(NULL);
+}
+
+void MqttBridge::EnqueueTelemetry()
+{
+    Statistics statistics = GetStatistics();
+    _last_telemetry_time_us = esp_timer_get_time();
+
+    const OutboundQueueStatistics& queue = statistics.queue;
+    ESP_LOGI(_TAG, "Queue depth: %d (max %d), published: %lu, dropped: %lu, max latency: %lld us",
+        queue.queue_depth, queue.max_queue_depth, queue.published_count,
+        queue.dropped_count, queue.max_publish_latency_us);
+
+    // QoS 1 messages waiting for their acknowledgement have no latency yet
+    uint32_t latency_sample_count = queue.completed_count > 0 ? queue.completed_count : 1;
+
+    cJSON* telemetry = cJSON_CreateObject();
+    cJSON_AddNumberToObject(telemetry, "queue_depth", queue.queue_depth);
+    cJSON_AddNumberToObject(telemetry, "max_queue_depth", queue.max_queue_depth);
+    cJSON_AddNumberToObject(telemetry, "published", queue.published_count);
+    cJSON_AddNumberToObject(telemetry, "completed", queue.completed_count);
+    cJSON_AddNumberToObject(telemetry, "dropped", queue.dropped_count);
+    cJSON_AddNumberToObject(telemetry, "coalesced", queue.coalesced_count);
+    cJSON_AddNumberToObject(telemetry, "reconnects", statistics.reconnect_count);
+    cJSON_AddNumberToObject(telemetry, "last_latency_us", queue.last_publish_latency_us);
+    cJSON_AddNumberToObject(telemetry, "max_latency_us", queue.max_publish_latency_us);
+    cJSON_AddNumberToObject(telemetry, "avg_latency_us", queue.total_publish_latency_us / latency_sample_count);
+
+    char* telemetry_string = cJSON_PrintUnformatted(telemetry);
+    cJSON_Delete(telemetry);
+    if (!telemetry_string)
+    {
+        return;
+    }
+
+    Enqueue(_telemetry_topic, telemetry_string, 0, false);
+    cJSON_free(telemetry_string);
+}
+
+void MqttBridge::ScheduleReconnect()
+{
+    uint32_t delay_ms = 0;
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        delay_ms = _reconnect_backoff.NextDelayMs(esp_random());
+    }
+
+    // esp-mqtt copies the timeout when the connection drops, before it dispatches the event.
+    // The delay set here is the one it waits after the next drop or failed attempt.
+    ESP_LOGD(_TAG, "Next reconnect delay %lu ms", delay_ms);
+    _mqtt_config.network.reconnect_timeout_ms = delay_ms;
+    esp_mqtt_set_config(_client, &_mqtt_config);
+}
+
+/* Static Handler Wrapper */
+void MqttBridge::OnMqttEventStatic(void* handler_args, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+    auto* mqtt_bridge = reinterpret_cast<MqttBridge*>(handler_args);
+    mqtt_bridge->OnMqttEvent(reinterpret_cast<esp_mqtt_event_handle_t>(event_data));
+}
+
+void MqttBridge::PublishTaskStatic(void* parameters)
+{
+    auto* mqtt_bridge = reinterpret_cast<MqttBridge*>(parameters);
+    mqtt_bridge->PublishTask();
+}
\ No newline at end of file
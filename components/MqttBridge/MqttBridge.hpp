@@ -0,0 +1,94 @@
+#ifndef MQTTBRIDGE_HPP
+#define MQTTBRIDGE_HPP
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <mqtt_client.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "LedControl.hpp"
+#include "OutboundQueue.hpp"
+
+/// @brief Bridges the LED command path to an MQTT broker.
+/// Commands received on "<prefix>/set" go through the same parser as /led and /wsled.
+/// State changes are published to "<prefix>/state" through a bounded outbound queue that
+/// coalesces messages per topic and is flushed in batches by a dedicated task.
+class MqttBridge
+{
+public:
+    struct Statistics
+    {
+        OutboundQueueStatistics queue;
+        uint32_t reconnect_count;
+    };
+
+private:
+    esp_mqtt_client_handle_t _client = NULL;
+    // Kept for the client's lifetime, the reconnect delay is updated through esp_mqtt_set_config
+    esp_mqtt_client_config_t _mqtt_config = {};
+    std::shared_ptr<LedControl> _led;
+    std::string _broker_uri;
+    std::string _command_topic;
+    std::string _state_topic;
+    std::string _telemetry_topic;
+    uint32_t _listener_id = 0;
+
+    // Outbound queue, at most one pending message per topic
+    OutboundQueue _outbound_queue;
+    ReconnectBackoff _reconnect_backoff;
+    std::mutex _queueMutex;
+    bool _is_connected = false;
+    uint32_t _reconnect_count = 0;
+
+    // Guarded by _queueMutex. Stop asks the task to exit and waits for it to report back,
+    // deleting it from outside could leave _queueMutex locked.
+    TaskHandle_t _publish_task = NULL;
+    TaskHandle_t _stopping_task = NULL;
+    bool _is_stopping = false;
+    int64_t _last_telemetry_time_us = 0;
+
+    static const char* _TAG;
+
+    // Configuration for the outbound queue
+    static constexpr size_t _max_queue_length = 16;
+    static constexpr uint32_t _batch_window_ms = 50;
+    static constexpr uint32_t _telemetry_interval_ms = 10000;
+
+    // Configuration for the reconnect backoff
+    static constexpr uint32_t _initial_reconnect_delay_ms = 1000;
+    static constexpr uint32_t _max_reconnect_delay_ms = 60000;
+
+    void OnMqttEvent(esp_mqtt_event_handle_t event);
+    void OnCommandReceived(const std::string& payload);
+    void OnLedStateChanged(int state);
+
+    /// @brief Add a message to the outbound queue and wake up the publish task
+    /// @return False if the message was dropped
+    bool Enqueue(const std::string& topic, const std::string& payload, int qos, bool retain);
+    void FlushQueue();
+    void PublishTask();
+    void EnqueueTelemetry();
+
+    /// @brief Draw the delay esp-mqtt waits after the next connection drop or failed attempt
+    void ScheduleReconnect();
+
+public:
+    /// @param led The LED driven by the received commands
+    /// @param broker_uri e.g. "mqtt://192.168.1.10:1883". An empty uri keeps the bridge disabled
+    /// @param topic_prefix Prefix for the command, state and telemetry topics e.g. "baobao"
+    MqttBridge(std::shared_ptr<LedControl> led, std::string broker_uri, std::string topic_prefix);
+    ~MqttBridge();
+
+    esp_err_t Start();
+    esp_err_t Stop();
+
+    Statistics GetStatistics();
+
+    static void OnMqttEventStatic(void* handler_args, esp_event_base_t event_base, int32_t event_id, void* event_data);
+    static void PublishTaskStatic(void* parameters);
+};
+
+#endif
\ No newline at end of file
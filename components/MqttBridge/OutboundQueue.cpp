@@ -0,0 +1,162 @@
+#include "OutboundQueue.hpp"
+#include <algorithm>
+
+OutboundQueue::OutboundQueue(size_t max_length)
+    : _max_length(std::max<size_t>(max_length, 1))
+{
+}
+
+bool OutboundQueue::Enqueue(const std::string& topic, const std::string& payload, int qos, bool retain, int64_t now_us)
+{
+    // Coalesce: only the latest value of a topic is worth sending
+    for (OutboundMessage& pending_message : _messages)
+    {
+        if (pending_message.topic == topic)
+        {
+            pending_message.payload = payload;
+            pending_message.qos = std::max(pending_message.qos, qos);
+            pending_message.retain = pending_message.retain || retain;
+            _statistics.coalesced_count++;
+            return true;
+        }
+    }
+
+    if (_messages.size() >= _max_length)
+    {
+        std::deque<OutboundMessage>::iterator evicted_message = _messages.begin();
+        while (evicted_message != _messages.end() && evicted_message->qos != 0)
+        {
+            evicted_message++;
+        }
+
+        _statistics.dropped_count++;
+        if (evicted_message == _messages.end())
+        {
+            return false;
+        }
+        _messages.erase(evicted_message);
+    }
+
+    _messages.push_back({topic, payload, qos, retain, now_us});
+    _statistics.max_queue_depth = std::max(_statistics.max_queue_depth, _messages.size());
+    return true;
+}
+
+bool OutboundQueue::Pop(OutboundMessage& output_message)
+{
+    if (_messages.empty())
+    {
+        return false;
+    }
+
+    output_message = std::move(_messages.front());
+    _messages.pop_front();
+    return true;
+}
+
+void OutboundQueue::OnPublished(const OutboundMessage& message, int message_id, int64_t now_us)
+{
+    _statistics.published_count++;
+    if (message.qos == 0)
+    {
+        RecordLatency(message.enqueued_time_us, now_us);
+    }
+    else
+    {
+        _in_flight_messages[message_id] = message.enqueued_time_us;
+    }
+}
+
+void OutboundQueue::OnPublishFailed(const OutboundMessage& message)
+{
+    bool has_newer_message = false;
+    for (const OutboundMessage& pending_message : _messages)
+    {
+        has_newer_message = has_newer_message || pending_message.topic == message.topic;
+    }
+
+    if (message.qos > 0 && !has_newer_message)
+    {
+        _messages.push_front(message);
+    }
+    else
+    {
+        _statistics.dropped_count++;
+    }
+}
+
+void OutboundQueue::OnAcknowledged(int message_id, int64_t now_us)
+{
+    std::unordered_map<int, int64_t>::iterator found_message = _in_flight_messages.find(message_id);
+    if (found_message != _in_flight_messages.end())
+    {
+        RecordLatency(found_message->second, now_us);
+        _in_flight_messages.erase(found_message);
+    }
+}
+
+void OutboundQueue::OnSessionLost()
+{
+    _in_flight_messages.clear();
+}
+
+size_t OutboundQueue::GetLength() const
+{
+    return _messages.size();
+}
+
+size_t OutboundQueue::GetInFlightCount() const
+{
+    return _in_flight_messages.size();
+}
+
+OutboundQueueStatistics OutboundQueue::GetStatistics() const
+{
+    OutboundQueueStatistics statistics = _statistics;
+    statistics.queue_depth = _messages.size();
+    return statistics;
+}
+
+void OutboundQueue::RecordLatency(int64_t enqueued_time_us, int64_t now_us)
+{
+    int64_t latency = now_us - enqueued_time_us;
+    _statistics.completed_count++;
+    _statistics.last_publish_latency_us = latency;
+    _statistics.max_publish_latency_us = std::max(_statistics.max_publish_latency_us, latency);
+    _statistics.total_publish_latency_us += latency;
+}
+
+/* ReconnectBackoff */
+ReconnectBackoff::ReconnectBackoff(uint32_t initial_delay_ms, uint32_t max_delay_ms)
+    : _initial_delay_ms(std::max<uint32_t>(initial_delay_ms, 1)), _max_delay_ms(std::max(initial_delay_ms, max_delay_ms))
+{
+}
+
+uint32_t ReconnectBackoff::NextDelayMs(uint32_t random)
+{
+    uint32_t delay_ms = _max_delay_ms;
+    // Past 16 doublings any sane initial delay is above the maximum, and the shift stays defined
+    if (_attempt_count < 16)
+    {
+        delay_ms = (uint32_t)std::min<uint64_t>(_max_delay_ms, (uint64_t)_initial_delay_ms << _attempt_count);
+    }
+    _attempt_count++;
+    _total_attempt_count++;
+
+    return delay_ms / 2 + random % (delay_ms / 2 + 1);
+}
+
+void ReconnectBackoff::Reset()
+{
+    _attempt_count = 0;
+}
+
+uint32_t ReconnectBackoff::GetAttemptCount() const
+{
+    return _attempt_count;
+}
+
+uint32_t ReconnectBackoff::GetTotalAttemptCount() const
+{
+    return _total_attempt_count;
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+#ifndef OUTBOUNDQUEUE_HPP
+#define OUTBOUNDQUEUE_HPP
+
+// Outbound queue and reconnect backoff of the MQTT bridge.
+// This file has no ESP-IDF dependency: the caller passes the time and the random values, so the
+// coalescing, eviction and backoff are checked on Linux by tools/MqttBridgeHost.
+//
+// Not thread safe. MqttBridge holds its queue mutex around every call.
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+struct OutboundMessage
+{
+    std::string topic;
+    std::string payload;
+    int qos;
+    bool retain;
+    int64_t enqueued_time_us;
+};
+
+struct OutboundQueueStatistics
+{
+    // Handed to the client, QoS 1 messages may still wait for their acknowledgement
+    uint32_t published_count;
+    // QoS 0 messages handed to the client and acknowledged QoS 1 messages, the latency samples
+    uint32_t completed_count;
+    uint32_t dropped_count;
+    uint32_t coalesced_count;
+    size_t queue_depth;
+    size_t max_queue_depth;
+    int64_t last_publish_latency_us;
+    int64_t max_publish_latency_us;
+    int64_t total_publish_latency_us;
+};
+
+/// @brief Bounded queue holding at most one pending message per topic
+class OutboundQueue
+{
+public:
+    OutboundQueue(size_t max_length);
+
+    /// @brief Add a message. A pending message for the same topic is replaced in place. When the queue
+    /// is full the oldest QoS 0 message is evicted; if there is none, the new message is dropped.
+    /// @return False if the message was dropped
+    bool Enqueue(const std::string& topic, const std::string& payload, int qos, bool retain, int64_t now_us);
+
+    /// @brief Take the oldest message
+    /// @return False if the queue is empty
+    bool Pop(OutboundMessage& output_message);
+
+    /// @brief The client accepted the popped message
+    /// @param message_id Id returned by the client, QoS 1 messages wait for its acknowledgement
+    void OnPublished(const OutboundMessage& message, int message_id, int64_t now_us);
+
+    /// @brief The client refused the popped message. A QoS 1 message goes back to the front unless a
+    /// newer value for its topic arrived meanwhile.
+    void OnPublishFailed(const OutboundMessage& message);
+
+    /// @brief The broker acknowledged a QoS 1 message
+    void OnAcknowledged(int message_id, int64_t now_us);
+
+    /// @brief The session ended, its messages in flight will never be acknowledged
+    void OnSessionLost();
+
+    size_t GetLength() const;
+    size_t GetInFlightCount() const;
+    OutboundQueueStatistics GetStatistics() const;
+
+private:
+    size_t _max_length;
+    std::deque<OutboundMessage> _messages;
+    // QoS 1 message id => enqueued time
+    std::unordered_map<int, int64_t> _in_flight_messages;
+    OutboundQueueStatistics _statistics = {};
+
+    void RecordLatency(int64_t enqueued_time_us, int64_t now_us);
+};
+
+/// @brief Exponential reconnect delay with jitter
+class ReconnectBackoff
+{
+public:
+    ReconnectBackoff(uint32_t initial_delay_ms, uint32_t max_delay_ms);
+
+    /// @brief Delay before the next attempt, drawn from [delay / 2, delay] so a fleet does not
+    /// reconnect in lockstep after a broker restart. The delay doubles with every attempt.
+    /// @param random Any uniformly distributed value, esp_random() on the device
+    uint32_t NextDelayMs(uint32_t random);
+
+    /// @brief Connected, the next failure starts from the initial delay again
+    void Reset();
+
+    uint32_t GetAttemptCount() const;
+    uint32_t GetTotalAttemptCount() const;
+
+private:
+    uint32_t _initial_delay_ms;
+    uint32_t _max_delay_ms;
+    uint32_t _attempt_count = 0;
+    uint32_t _total_attempt_count = 0;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include "StateHistory.hpp"
+#include <esp_sntp.h>
+#include <sys/time.h>
+
+// Custom data subtype of the "history" entry in partitions.csv
+#ifndef STATE_HISTORY_PARTITION_SUBTYPE
+#define STATE_HISTORY_PARTITION_SUBTYPE ((esp_partition_subtype_t)0x41)
+#endif
+
+const char* StateHistory::_TAG = "StateHistory";
+
+/* PartitionHistoryStorage */
+esp_err_t PartitionHistoryStorage::Open()
+{
+    _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, STATE_HISTORY_PARTITION_SUBTYPE, "history");
+    return _partition ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+size_t PartitionHistoryStorage::GetSectorSize() const
+{
+    return _partition ? _partition->erase_size : 0;
+}
+
+size_t PartitionHistoryStorage::GetSectorCount() const
+{
+    return _partition ? _partition->size / _partition->erase_size : 0;
+}
+
+bool PartitionHistoryStorage::Read(size_t offset, void* output_data, size_t length)
+{
+    return esp_partition_read(_partition, offset, output_data, length) == ESP_OK;
+}
+
+bool PartitionHistoryStorage::Write(size_t offset, const void* data, size_t length)
+{
+    return esp_partition_write(_partition, offset, data, length) == ESP_OK;
+}
+
+bool PartitionHistoryStorage::EraseSector(size_t sector_index)
+{
+    return esp_partition_erase_range(_partition, sector_index * _partition->erase_size, _partition->erase_size) == ESP_OK;
+}
+
+/* StateHistory */
+StateHistory::StateHistory(std::shared_ptr<LedControl> led)
+    : _led(led), _log(_storage)
+{
+}
+
+StateHistory::~StateHistory()
+{
+    Stop();
+    if (_flush_timer)
+    {
+        esp_timer_delete(_flush_timer);
+    }
+}
+
+esp_err_t StateHistory::Start()
+{
+    if (_flush_timer)
+    {
+        return ESP_OK;
+    }
+
+    esp_err_t status = _storage.Open();
+    if (status != ESP_OK)
+    {
+        ESP_LOGW(_TAG, "No history partition, state changes are not recorded");
+        return status;
+    }
+
+    if (!_log.Mount())
+    {
+        ESP_LOGE(_TAG, "Failed to mount the history partition");
+        return ESP_FAIL;
+    }
+
+    esp_timer_create_args_t timer_args = {
+        .callback = &FlushTimerStatic,
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "history_flush",
+        .skip_unhandled_events = true
+    };
+    status = esp_timer_create(&timer_args, &_flush_timer);
+    if (status != ESP_OK)
+    {
+        ESP_LOGE(_TAG, "Failed to create the flush timer %s", esp_err_to_name(status));
+        return status;
+    }
+
+    // The log is only useful in wall clock time, SNTP may already run for another component
+    if (!esp_sntp_enabled())
+    {
+        esp_sntp_setoperatingmode(ESP_SNTP_OPMODE_POLL);
+        esp_sntp_setservername(0, STATE_HISTORY_NTP_SERVER);
+        esp_sntp_init();
+    }
+
+    _listener_id = _led->AddStateChangeListener([this](int state) { OnStateChanged(state); });
+
+    // Marks the restart, the LED comes up in this state whatever it was before
+    OnStateChanged(_led->GetState());
+
+    StateHistoryLog::Statistics statistics = _log.GetStatistics();
+    ESP_LOGI(_TAG, "Mounted %lu sectors at sequence %lu", statistics.sector_count, statistics.sequence);
+    return ESP_OK;
+}
+
+void StateHistory::Stop()
+{
+    if (_listener_id != 0)
+    {
+        _led->RemoveStateChangeListener(_listener_id);
+        _listener_id = 0;
+    }
+
+    if (_flush_timer)
+    {
+        esp_timer_stop(_flush_timer);
+    }
+    _log.Flush();
+}
+
+StateHistoryLog& StateHistory::GetLog()
+{
+    return _log;
+}
+
+int64_t StateHistory::GetTimeMs()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+void StateHistory::OnStateChanged(int state)
+{
+    // Only a RAM append, the listener runs on the task that issued the command
+    bool is_flush_due = _log.Append(GetTimeMs(), state == LED_ON);
+    if (is_flush_due)
+    {
+        esp_timer_stop(_flush_timer);
+        esp_timer_start_once(_flush_timer, 0);
+    }
+    else if (!esp_timer_is_active(_flush_timer))
+    {
+        esp_timer_start_once(_flush_timer, (uint64_t)STATE_HISTORY_FLUSH_INTERVAL_MS * 1000);
+    }
+}
+
+void StateHistory::OnFlushTimer()
+{
+    if (!_log.Flush())
+    {
+        StateHistoryLog::Statistics statistics = _log.GetStatistics();
+        ESP_LOGW(_TAG, "Failed to flush the history, %lu changes dropped so far", statistics.dropped_count);
+    }
+}
+
+void StateHistory::FlushTimerStatic(void* arg)
+{
+    auto* state_history = reinterpret_cast<StateHistory*>(arg);
+    state_history->OnFlushTimer();
+}
\ No newline at end of file
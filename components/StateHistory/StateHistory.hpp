@@ -0,0 +1,74 @@
+#ifndef STATEHISTORY_HPP
+#define STATEHISTORY_HPP
+
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include <memory>
+#include "LedControl.hpp"
+#include "StateHistoryLog.hpp"
+
+// A power cut loses at most this much of the history, every flush programs flash
+#ifndef STATE_HISTORY_FLUSH_INTERVAL_MS
+#define STATE_HISTORY_FLUSH_INTERVAL_MS (10 * 60 * 1000)
+#endif
+
+#ifndef STATE_HISTORY_NTP_SERVER
+#define STATE_HISTORY_NTP_SERVER "pool.ntp.org"
+#endif
+
+/// @brief The "history" data partition as a ring of erase sectors
+class PartitionHistoryStorage : public HistoryStorage
+{
+private:
+    const esp_partition_t* _partition = NULL;
+
+public:
+    /// @return ESP_ERR_NOT_FOUND if partitions.csv has no history entry
+    esp_err_t Open();
+
+    size_t GetSectorSize() const override;
+    size_t GetSectorCount() const override;
+    bool Read(size_t offset, void* output_data, size_t length) override;
+    bool Write(size_t offset, const void* data, size_t length) override;
+    bool EraseSector(size_t sector_index) override;
+};
+
+/// @brief Records every LED state change with a wall clock timestamp for auditing and energy reports.
+/// Changes are batched in RAM and written to flash when the batch fills or STATE_HISTORY_FLUSH_INTERVAL_MS
+/// after the first unflushed change, from the esp_timer task so no command source waits on flash.
+/// Times come from SNTP, changes before the first synchronization are stamped from 1970 plus the uptime.
+class StateHistory
+{
+private:
+    std::shared_ptr<LedControl> _led;
+    uint32_t _listener_id = 0;
+    PartitionHistoryStorage _storage;
+    StateHistoryLog _log;
+    esp_timer_handle_t _flush_timer = NULL;
+
+    static const char* _TAG;
+
+    void OnStateChanged(int state);
+    void OnFlushTimer();
+
+public:
+    StateHistory(std::shared_ptr<LedControl> led);
+    ~StateHistory();
+
+    /// @brief Mount the log, start SNTP and record the state at boot.
+    /// Must run before the command sources are started, like every state change listener.
+    esp_err_t Start();
+
+    /// @brief Write the unflushed changes, e.g. before a planned restart
+    void Stop();
+
+    StateHistoryLog& GetLog();
+
+    /// @brief Milliseconds since the Unix epoch, the timestamp unit of the history
+    static int64_t GetTimeMs();
+
+    static void FlushTimerStatic(void* arg);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,492 @@
+#include "StateHistoryLog.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+
+static size_t GetChunkSize(uint16_t payload_length)
+{
+    return (sizeof(HistoryChunkHeader) + payload_length + 3) & ~(size_t)3;
+}
+
+StateHistoryLog::StateHistoryLog(HistoryStorage& storage)
+    : _storage(storage)
+{
+}
+
+bool StateHistoryLog::Mount()
+{
+    std::lock_guard<std::mutex> lock(_logMutex);
+
+    _is_mounted = false;
+    _sector_size = _storage.GetSectorSize();
+    _sector_count = _storage.GetSectorCount();
+    if (_sector_count < 2 || _sector_size < sizeof(HistorySectorHeader) + GetChunkSize(STATE_HISTORY_BATCH_BYTES))
+    {
+        return false;
+    }
+
+    _sector_sequences.assign(_sector_count, 0);
+    _sequence = 0;
+    for (size_t sector = 0; sector < _sector_count; sector++)
+    {
+        HistorySectorHeader header;
+        if (!_storage.Read(sector * _sector_size, &header, sizeof(header)))
+        {
+            return false;
+        }
+
+        if (header.magic != STATE_HISTORY_SECTOR_MAGIC || header.sequence == 0 || header.sequence == UINT32_MAX)
+        {
+            continue;
+        }
+
+        _sector_sequences[sector] = header.sequence;
+        if (header.sequence > _sequence)
+        {
+            _sequence = header.sequence;
+            _current_sector = sector;
+        }
+    }
+
+    _batch_header = {};
+    _statistics.sector_count = _sector_count;
+    _statistics.sequence = _sequence;
+    _current_summary = {INT64_MAX, INT64_MIN, 0, 0};
+    _is_mounted = true;
+
+    if (_sequence == 0)
+    {
+        // Empty log, the first flush opens sector 0
+        _current_sector = _sector_count - 1;
+        _write_offset = _sector_size;
+        _is_current_sealed = true;
+        return true;
+    }
+
+    size_t sector_offset = _current_sector * _sector_size;
+    HistorySectorHeader header;
+    if (!_storage.Read(sector_offset, &header, sizeof(header)))
+    {
+        _is_mounted = false;
+        return false;
+    }
+
+    _is_current_sealed = IsSealValid(header.seal);
+    if (_is_current_sealed)
+    {
+        _write_offset = _sector_size;
+        return true;
+    }
+
+    // Resume after the last valid chunk of the open sector, its summary is needed for the seal
+    std::unique_ptr<uint8_t[]> payload(new uint8_t[STATE_HISTORY_BATCH_BYTES]);
+    size_t offset = sizeof(HistorySectorHeader);
+    while (offset + sizeof(HistoryChunkHeader) <= _sector_size)
+    {
+        HistoryChunkHeader chunk_header;
+        if (!ReadChunkLocked(sector_offset, offset, chunk_header, payload.get()) ||
+            Crc32(0, payload.get(), chunk_header.payload_length) != chunk_header.payload_crc32)
+        {
+            break;
+        }
+
+        SectorSummary chunk_summary = {INT64_MAX, INT64_MIN, 0, 0};
+        bool is_decoded = DecodeChunk(chunk_header, payload.get(), [&](const HistoryEvent& event) {
+            MergeSummary(chunk_summary, {event.time_ms, event.time_ms, 1, event.state});
+        });
+        if (!is_decoded)
+        {
+            break;
+        }
+
+        MergeSummary(_current_summary, chunk_summary);
+        offset += GetChunkSize(chunk_header.payload_length);
+    }
+
+    // A torn flush left bytes that can no longer be programmed, continue in the next sector
+    _write_offset = IsRestErasedLocked(sector_offset, offset) ? offset : _sector_size;
+    return true;
+}
+
+bool StateHistoryLog::Append(int64_t time_ms, uint8_t state)
+{
+    std::lock_guard<std::mutex> lock(_logMutex);
+
+    state = state ? 1 : 0;
+    if (_batch_header.event_count > 0 &&
+        (time_ms < _batch_last_time_ms ||
+         _batch_header.payload_length + STATE_HISTORY_MAX_VARINT_BYTES > STATE_HISTORY_BATCH_BYTES ||
+         _batch_header.event_count == UINT16_MAX))
+    {
+        FlushLocked();
+    }
+
+    if (_batch_header.event_count == 0)
+    {
+        _batch_header.base_time_ms = time_ms;
+        _batch_last_time_ms = time_ms;
+        _batch_summary = {time_ms, time_ms, 0, state};
+    }
+
+    uint64_t value = ((uint64_t)(time_ms - _batch_last_time_ms) << 1) | state;
+    do
+    {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (value)
+        {
+            byte |= 0x80;
+        }
+        _batch[_batch_header.payload_length++] = byte;
+    } while (value);
+
+    _batch_header.event_count++;
+    _batch_last_time_ms = time_ms;
+    _batch_summary.max_time_ms = time_ms;
+    _batch_summary.event_count++;
+    _batch_summary.last_state = state;
+    _statistics.appended_count++;
+
+    return _batch_header.payload_length >= STATE_HISTORY_FLUSH_THRESHOLD_BYTES;
+}
+
+bool StateHistoryLog::Flush()
+{
+    std::lock_guard<std::mutex> lock(_logMutex);
+    return FlushLocked();
+}
+
+bool StateHistoryLog::FlushLocked()
+{
+    if (_batch_header.event_count == 0)
+    {
+        return true;
+    }
+
+    bool is_written = false;
+    size_t chunk_size = GetChunkSize(_batch_header.payload_length);
+    if (_is_mounted && (_write_offset + chunk_size <= _sector_size || StartNextSectorLocked()))
+    {
+        _batch_header.payload_crc32 = Crc32(0, _batch, _batch_header.payload_length);
+
+        size_t chunk_offset = _current_sector * _sector_size + _write_offset;
+        is_written = _storage.Write(chunk_offset + sizeof(HistoryChunkHeader), _batch, _batch_header.payload_length) &&
+                     _storage.Write(chunk_offset, &_batch_header, sizeof(HistoryChunkHeader));
+        if (is_written)
+        {
+            _write_offset += chunk_size;
+            MergeSummary(_current_summary, _batch_summary);
+            _statistics.flushed_count += _batch_header.event_count;
+            _statistics.flush_count++;
+            _statistics.flash_bytes_written += chunk_size;
+        }
+        else
+        {
+            // The sector is sealed with what it holds, the next flush moves on
+            _statistics.write_error_count++;
+            _write_offset = _sector_size;
+        }
+    }
+
+    // A batch that cannot be written is dropped, keeping it would stall every later append
+    if (!is_written)
+    {
+        _statistics.dropped_count += _batch_header.event_count;
+    }
+
+    _batch_header = {};
+    return is_written;
+}
+
+bool StateHistoryLog::StartNextSectorLocked()
+{
+    SealCurrentSectorLocked();
+
+    size_t next_sector = (_current_sector + 1) % _sector_count;
+    _sector_sequences[next_sector] = 0;
+    if (!_storage.EraseSector(next_sector))
+    {
+        _statistics.write_error_count++;
+        return false;
+    }
+    _statistics.erase_count++;
+
+    HistorySectorHeader header;
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = STATE_HISTORY_SECTOR_MAGIC;
+    header.sequence = _sequence + 1;
+    if (!_storage.Write(next_sector * _sector_size, &header, offsetof(HistorySectorHeader, seal)))
+    {
+        _statistics.write_error_count++;
+        return false;
+    }
+
+    _sequence++;
+    _sector_sequences[next_sector] = _sequence;
+    _current_sector = next_sector;
+    _write_offset = sizeof(HistorySectorHeader);
+    _is_current_sealed = false;
+    _current_summary = {INT64_MAX, INT64_MIN, 0, 0};
+    _statistics.sequence = _sequence;
+    return true;
+}
+
+void StateHistoryLog::SealCurrentSectorLocked()
+{
+    if (_is_current_sealed)
+    {
+        return;
+    }
+
+    HistorySectorSeal seal = {};
+    if (_current_summary.event_count > 0)
+    {
+        seal.min_time_ms = _current_summary.min_time_ms;
+        seal.max_time_ms = _current_summary.max_time_ms;
+        seal.event_count = _current_summary.event_count;
+        seal.last_state = _current_summary.last_state;
+    }
+    seal.crc32 = Crc32(0, reinterpret_cast<const uint8_t*>(&seal), offsetof(HistorySectorSeal, crc32));
+
+    size_t seal_offset = _current_sector * _sector_size + offsetof(HistorySectorHeader, seal);
+    if (!_storage.Write(seal_offset, &seal, sizeof(seal)))
+    {
+        // Only costs speed, a query decodes an unsealed sector
+        _statistics.write_error_count++;
+    }
+    _is_current_sealed = true;
+}
+
+bool StateHistoryLog::IsRestErasedLocked(size_t sector_offset, size_t offset)
+{
+    uint8_t block[64];
+    while (offset < _sector_size)
+    {
+        size_t length = std::min(sizeof(block), _sector_size - offset);
+        if (!_storage.Read(sector_offset + offset, block, length))
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < length; i++)
+        {
+            if (block[i] != 0xFF)
+            {
+                return false;
+            }
+        }
+        offset += length;
+    }
+    return true;
+}
+
+bool StateHistoryLog::ReadChunkLocked(size_t sector_offset, size_t offset, HistoryChunkHeader& output_header, uint8_t* output_payload)
+{
+    if (!_storage.Read(sector_offset + offset, &output_header, sizeof(output_header)))
+    {
+        return false;
+    }
+
+    // An erased header has a length of 0xFFFF and ends the sector
+    if (output_header.payload_length == 0 || output_header.payload_length > STATE_HISTORY_BATCH_BYTES ||
+        output_header.event_count == 0 || offset + GetChunkSize(output_header.payload_length) > _sector_size)
+    {
+        return false;
+    }
+
+    return _storage.Read(sector_offset + offset + sizeof(HistoryChunkHeader), output_payload, output_header.payload_length);
+}
+
+StateHistoryLog::QueryResult StateHistoryLog::Query(int64_t from_ms, int64_t to_ms, const std::function<bool(const HistoryEvent&)>& visitor)
+{
+    QueryResult result = {-1, 0, true};
+    std::unique_ptr<uint8_t[]> payload(new uint8_t[STATE_HISTORY_BATCH_BYTES]);
+
+    auto visit_chunk = [&](const HistoryChunkHeader& chunk_header) {
+        // Times only grow inside a chunk
+        if (chunk_header.base_time_ms > to_ms)
+        {
+            return;
+        }
+
+        DecodeChunk(chunk_header, payload.get(), [&](const HistoryEvent& event) {
+            if (!result.is_complete)
+            {
+                return;
+            }
+
+            if (event.time_ms < from_ms)
+            {
+                result.initial_state = event.state;
+            }
+            else if (event.time_ms <= to_ms)
+            {
+                result.event_count++;
+                result.is_complete = visitor(event);
+            }
+        });
+    };
+
+    size_t first_sector = 0;
+    size_t sector_count = 0;
+    size_t sector_size = 0;
+    uint32_t query_sequence = 0;
+    {
+        std::lock_guard<std::mutex> lock(_logMutex);
+        if (_is_mounted)
+        {
+            first_sector = (_current_sector + 1) % _sector_count;
+            sector_count = _sector_count;
+            sector_size = _sector_size;
+            query_sequence = _sequence;
+        }
+    }
+
+    // Oldest sector first. Sectors opened after the query started are left to the next query.
+    for (size_t i = 0; i < sector_count && result.is_complete; i++)
+    {
+        size_t sector = (first_sector + i) % sector_count;
+        size_t sector_offset = sector * sector_size;
+
+        uint32_t sequence = 0;
+        HistorySectorHeader sector_header;
+        {
+            std::lock_guard<std::mutex> lock(_logMutex);
+            sequence = _sector_sequences[sector];
+            if (sequence == 0 || sequence > query_sequence || !_storage.Read(sector_offset, &sector_header, sizeof(sector_header)))
+            {
+                continue;
+            }
+        }
+
+        if (IsSealValid(sector_header.seal))
+        {
+            const HistorySectorSeal& seal = sector_header.seal;
+            if (seal.event_count == 0 || seal.min_time_ms > to_ms)
+            {
+                continue;
+            }
+
+            if (seal.max_time_ms < from_ms)
+            {
+                result.initial_state = seal.last_state;
+                continue;
+            }
+        }
+
+        size_t offset = sizeof(HistorySectorHeader);
+        while (result.is_complete)
+        {
+            HistoryChunkHeader chunk_header;
+            {
+                std::lock_guard<std::mutex> lock(_logMutex);
+                bool is_end = _sector_sequences[sector] != sequence || (sector == _current_sector && offset >= _write_offset);
+                if (is_end || offset + sizeof(HistoryChunkHeader) > sector_size || !ReadChunkLocked(sector_offset, offset, chunk_header, payload.get()))
+                {
+                    break;
+                }
+            }
+
+            offset += GetChunkSize(chunk_header.payload_length);
+            if (Crc32(0, payload.get(), chunk_header.payload_length) != chunk_header.payload_crc32)
+            {
+                break;
+            }
+            visit_chunk(chunk_header);
+        }
+    }
+
+    // The newest events are still in the RAM batch
+    if (result.is_complete)
+    {
+        HistoryChunkHeader chunk_header;
+        {
+            std::lock_guard<std::mutex> lock(_logMutex);
+            chunk_header = _batch_header;
+            memcpy(payload.get(), _batch, _batch_header.payload_length);
+        }
+
+        if (chunk_header.event_count > 0)
+        {
+            visit_chunk(chunk_header);
+        }
+    }
+
+    return result;
+}
+
+StateHistoryLog::Statistics StateHistoryLog::GetStatistics() const
+{
+    std::lock_guard<std::mutex> lock(_logMutex);
+    Statistics statistics = _statistics;
+    statistics.pending_count = _batch_header.event_count;
+    return statistics;
+}
+
+bool StateHistoryLog::IsSealValid(const HistorySectorSeal& seal)
+{
+    return seal.event_count != UINT32_MAX &&
+           seal.crc32 == Crc32(0, reinterpret_cast<const uint8_t*>(&seal), offsetof(HistorySectorSeal, crc32));
+}
+
+void StateHistoryLog::MergeSummary(SectorSummary& summary, const SectorSummary& other)
+{
+    if (other.event_count == 0)
+    {
+        return;
+    }
+
+    summary.min_time_ms = std::min(summary.min_time_ms, other.min_time_ms);
+    summary.max_time_ms = std::max(summary.max_time_ms, other.max_time_ms);
+    summary.event_count += other.event_count;
+    summary.last_state = other.last_state;
+}
+
+template <typename EventVisitor>
+bool StateHistoryLog::DecodeChunk(const HistoryChunkHeader& header, const uint8_t* payload, EventVisitor visitor)
+{
+    int64_t time_ms = header.base_time_ms;
+    size_t position = 0;
+    for (uint16_t i = 0; i < header.event_count; i++)
+    {
+        uint64_t value = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            if (position >= header.payload_length || shift > 63)
+            {
+                return false;
+            }
+
+            uint8_t byte = payload[position++];
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                break;
+            }
+        }
+
+        time_ms += (int64_t)(value >> 1);
+        visitor(HistoryEvent{time_ms, (uint8_t)(value & 1)});
+    }
+
+    return position == header.payload_length;
+}
+
+uint32_t StateHistoryLog::Crc32(uint32_t crc, const uint8_t* data, size_t length)
+{
+    // CRC-32 (IEEE) a nibble at a time, every query checks each chunk it reads
+    static const uint32_t nibble_table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ nibble_table[crc & 0xF];
+        crc = (crc >> 4) ^ nibble_table[crc & 0xF];
+    }
+    return ~crc;
+}
\ No newline at end of file
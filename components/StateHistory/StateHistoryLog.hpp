@@ -0,0 +1,190 @@
+#ifndef STATEHISTORYLOG_HPP
+#define STATEHISTORYLOG_HPP
+
+// Append only log of LED state changes kept in a ring of flash sectors.
+// This file has no ESP-IDF dependency: the flash comes from a HistoryStorage, a data partition on
+// the device and a RAM model of NOR flash in tools/StateHistoryBench.
+//
+// Sector layout (little endian):
+//   HistorySectorHeader   the seal stays erased until the sector is full
+//   chunk, chunk, ...     4 byte aligned, an erased chunk header ends the sector
+// Chunk:
+//   HistoryChunkHeader    written after the payload, a torn flush never looks valid
+//   payload               one LEB128 varint per event: (milliseconds since the previous event << 1) | state
+//
+// Events are batched in RAM and a whole batch is written as one chunk, so a burst of toggles costs
+// a few bytes of flash each and a sector is erased once per few thousand events.
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifndef STATE_HISTORY_SECTOR_MAGIC
+#define STATE_HISTORY_SECTOR_MAGIC 0x54534853 // "SHST"
+#endif
+
+// Payload bytes of the RAM batch, with the chunk header a flushed batch takes 512 bytes of flash
+#ifndef STATE_HISTORY_BATCH_BYTES
+#define STATE_HISTORY_BATCH_BYTES 496
+#endif
+
+// Append reports a flush as due past this fill level, the batch still has room while it runs
+#ifndef STATE_HISTORY_FLUSH_THRESHOLD_BYTES
+#define STATE_HISTORY_FLUSH_THRESHOLD_BYTES 384
+#endif
+
+#ifndef STATE_HISTORY_MAX_VARINT_BYTES
+#define STATE_HISTORY_MAX_VARINT_BYTES 10
+#endif
+
+// Written once when the sector is full. Lets a query skip the sector or take its last state
+// without decoding it.
+struct HistorySectorSeal
+{
+    int64_t min_time_ms;
+    int64_t max_time_ms;
+    uint32_t event_count;
+    uint8_t last_state;
+    uint8_t reserved[3];
+    uint32_t crc32;
+    uint32_t reserved2;
+};
+static_assert(sizeof(HistorySectorSeal) == 32, "HistorySectorSeal layout is part of the flash format");
+
+struct HistorySectorHeader
+{
+    uint32_t magic;
+    uint32_t sequence;
+    HistorySectorSeal seal;
+};
+static_assert(sizeof(HistorySectorHeader) == 40, "HistorySectorHeader layout is part of the flash format");
+
+struct HistoryChunkHeader
+{
+    uint16_t payload_length;
+    uint16_t event_count;
+    uint32_t payload_crc32;
+    int64_t base_time_ms;
+};
+static_assert(sizeof(HistoryChunkHeader) == 16, "HistoryChunkHeader layout is part of the flash format");
+
+struct HistoryEvent
+{
+    int64_t time_ms;
+    uint8_t state;
+};
+
+/// @brief Erase block addressed flash with NOR semantics: a write can only clear bits
+class HistoryStorage
+{
+public:
+    virtual ~HistoryStorage() = default;
+
+    virtual size_t GetSectorSize() const = 0;
+    virtual size_t GetSectorCount() const = 0;
+    virtual bool Read(size_t offset, void* output_data, size_t length) = 0;
+    virtual bool Write(size_t offset, const void* data, size_t length) = 0;
+    virtual bool EraseSector(size_t sector_index) = 0;
+};
+
+class StateHistoryLog
+{
+public:
+    struct Statistics
+    {
+        uint32_t appended_count;
+        uint32_t flushed_count;
+        uint32_t dropped_count;
+        uint32_t pending_count;
+        uint32_t flush_count;
+        uint32_t erase_count;
+        uint32_t write_error_count;
+        uint64_t flash_bytes_written;
+        uint32_t sector_count;
+        uint32_t sequence;
+    };
+
+    struct QueryResult
+    {
+        // State of the last event before the range in append order, -1 if none is kept
+        int initial_state;
+        uint32_t event_count;
+        // False if the visitor stopped the query
+        bool is_complete;
+    };
+
+    /// @param storage Must outlive the log
+    StateHistoryLog(HistoryStorage& storage);
+
+    /// @brief Find the newest sector and resume after its last valid chunk.
+    /// A sector with a torn write at its end is sealed and the log continues in the next one.
+    /// @return False if the storage is too small or cannot be read
+    bool Mount();
+
+    /// @brief Add an event to the RAM batch. Only writes flash when the batch is full or the clock
+    /// went backwards, every chunk needs non-decreasing times.
+    /// @return True when the batch is past STATE_HISTORY_FLUSH_THRESHOLD_BYTES and should be flushed
+    bool Append(int64_t time_ms, uint8_t state);
+
+    /// @brief Write the RAM batch as one chunk, erasing the oldest sector when the current one is full
+    bool Flush();
+
+    /// @brief Visit the events with from_ms <= time <= to_ms in append order, including the unflushed batch.
+    /// The log is only locked while a chunk is copied, the visitor runs unlocked and may block on a socket.
+    /// @param visitor Returns false to stop the query
+    QueryResult Query(int64_t from_ms, int64_t to_ms, const std::function<bool(const HistoryEvent&)>& visitor);
+
+    Statistics GetStatistics() const;
+
+    static uint32_t Crc32(uint32_t crc, const uint8_t* data, size_t length);
+
+private:
+    struct SectorSummary
+    {
+        int64_t min_time_ms;
+        int64_t max_time_ms;
+        uint32_t event_count;
+        uint8_t last_state;
+    };
+
+    HistoryStorage& _storage;
+    size_t _sector_size = 0;
+    size_t _sector_count = 0;
+    bool _is_mounted = false;
+
+    // Sequence of every sector, 0 while it is erased or unused. A query compares it to notice that
+    // a sector it is reading was recycled underneath.
+    std::vector<uint32_t> _sector_sequences;
+    size_t _current_sector = 0;
+    uint32_t _sequence = 0;
+    size_t _write_offset = 0;
+    bool _is_current_sealed = false;
+    SectorSummary _current_summary = {};
+
+    uint8_t _batch[STATE_HISTORY_BATCH_BYTES] = {};
+    HistoryChunkHeader _batch_header = {};
+    int64_t _batch_last_time_ms = 0;
+    SectorSummary _batch_summary = {};
+
+    Statistics _statistics = {};
+    mutable std::mutex _logMutex;
+
+    bool FlushLocked();
+    bool StartNextSectorLocked();
+    void SealCurrentSectorLocked();
+    bool IsRestErasedLocked(size_t sector_offset, size_t offset);
+    bool ReadChunkLocked(size_t sector_offset, size_t offset, HistoryChunkHeader& output_header, uint8_t* output_payload);
+
+    static bool IsSealValid(const HistorySectorSeal& seal);
+    static void MergeSummary(SectorSummary& summary, const SectorSummary& other);
+
+    /// @brief Decode a verified chunk payload
+    /// @return False if the payload does not hold exactly the events of the header
+    template <typename EventVisitor>
+    static bool DecodeChunk(const HistoryChunkHeader& header, const uint8_t* payload, EventVisitor visitor);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include "TaskProfiler.hpp"
+#include <esp_heap_caps.h>
+#include <cstring>
+
+const char* FreeRtosTaskSource::_TAG = "FreeRtosTaskSource";
+const char* TaskProfiler::_TAG = "TaskProfiler";
+
+/* FreeRtosTaskSource */
+size_t FreeRtosTaskSource::ReadTasks(TaskCounters* output_tasks, size_t capacity, uint32_t& output_total_runtime)
+{
+    // Suspends the scheduler while the task list is walked, a few tens of microseconds
+    configRUN_TIME_COUNTER_TYPE total_runtime = 0;
+    UBaseType_t task_count = uxTaskGetSystemState(_task_status, TASK_SAMPLER_MAX_TASKS, &total_runtime);
+    if (task_count == 0 || task_count > capacity)
+    {
+        if (!_is_overflow_logged)
+        {
+            ESP_LOGW(_TAG, "%d tasks do not fit in TASK_SAMPLER_MAX_TASKS %d", uxTaskGetNumberOfTasks(), TASK_SAMPLER_MAX_TASKS);
+            _is_overflow_logged = true;
+        }
+        return 0;
+    }
+
+    for (UBaseType_t i = 0; i < task_count; i++)
+    {
+        const TaskStatus_t& status = _task_status[i];
+        TaskCounters& counters = output_tasks[i];
+
+        strncpy(counters.name, status.pcTaskName, sizeof(counters.name) - 1);
+        counters.name[sizeof(counters.name) - 1] = 0;
+        counters.task_number = status.xTaskNumber;
+        counters.runtime_counter = status.ulRunTimeCounter;
+        // The ESP-IDF port counts the stack in bytes
+        counters.stack_free_bytes = status.usStackHighWaterMark;
+        counters.priority = status.uxCurrentPriority;
+#if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+        counters.core_id = status.xCoreID == tskNO_AFFINITY ? -1 : status.xCoreID;
+#else
+        counters.core_id = -1;
+#endif
+    }
+
+    output_total_runtime = total_runtime;
+    return task_count;
+}
+
+HeapCounters FreeRtosTaskSource::ReadHeap()
+{
+    HeapCounters heap = {};
+    heap.free_bytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    heap.minimum_free_bytes = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    heap.largest_free_block_bytes = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    return heap;
+}
+
+/* TaskProfiler */
+TaskProfiler::TaskProfiler(uint32_t interval_ms)
+    : _sampler(_source), _interval_ms(interval_ms)
+{
+}
+
+TaskProfiler::~TaskProfiler()
+{
+    Stop();
+}
+
+esp_err_t TaskProfiler::Start()
+{
+    if (_sampler_task)
+    {
+        return ESP_OK;
+    }
+
+    // Lowest priority above idle, the sampler must not disturb what it measures
+    if (xTaskCreate(&SamplerTaskStatic, "task_profiler", 3072, this, 1, &_sampler_task) != pdPASS)
+    {
+        ESP_LOGE(_TAG, "Failed to create the sampler task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(_TAG, "Sampling %d tasks at most every %lu ms", TASK_SAMPLER_MAX_TASKS, _interval_ms);
+    return ESP_OK;
+}
+
+void TaskProfiler::Stop()
+{
+    if (_sampler_task)
+    {
+        vTaskDelete(_sampler_task);
+        _sampler_task = NULL;
+    }
+}
+
+const TaskSampler& TaskProfiler::GetSampler() const
+{
+    return _sampler;
+}
+
+uint32_t TaskProfiler::GetIntervalMs() const
+{
+    return _interval_ms;
+}
+
+int TaskProfiler::GetCoreCount() const
+{
+    return portNUM_PROCESSORS;
+}
+
+void TaskProfiler::SamplerTask()
+{
+    TickType_t last_wake_time = xTaskGetTickCount();
+    while (true)
+    {
+        _sampler.Sample(esp_timer_get_time());
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(_interval_ms));
+    }
+}
+
+void TaskProfiler::SamplerTaskStatic(void* parameters)
+{
+    auto* task_profiler = reinterpret_cast<TaskProfiler*>(parameters);
+    task_profiler->SamplerTask();
+}
\ No newline at end of file
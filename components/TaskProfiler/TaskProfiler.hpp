@@ -0,0 +1,58 @@
+#ifndef TASKPROFILER_HPP
+#define TASKPROFILER_HPP
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "TaskSampler.hpp"
+
+#ifndef TASK_PROFILER_INTERVAL_MS
+#define TASK_PROFILER_INTERVAL_MS 5000
+#endif
+
+/// @brief Reads the FreeRTOS task list and the 8 bit capable heap.
+/// Needs CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS.
+class FreeRtosTaskSource : public TaskSampleSource
+{
+private:
+    // Filled by uxTaskGetSystemState, kept as a member so sampling never allocates
+    TaskStatus_t _task_status[TASK_SAMPLER_MAX_TASKS];
+    bool _is_overflow_logged = false;
+
+    static const char* _TAG;
+
+public:
+    size_t ReadTasks(TaskCounters* output_tasks, size_t capacity, uint32_t& output_total_runtime) override;
+    HeapCounters ReadHeap() override;
+};
+
+/// @brief Samples every task periodically on a low priority task, so a field device can tell which
+/// task eats the CPU and how close each stack is to overflowing
+class TaskProfiler
+{
+private:
+    FreeRtosTaskSource _source;
+    TaskSampler _sampler;
+    uint32_t _interval_ms;
+    TaskHandle_t _sampler_task = NULL;
+
+    static const char* _TAG;
+
+    void SamplerTask();
+
+public:
+    TaskProfiler(uint32_t interval_ms = TASK_PROFILER_INTERVAL_MS);
+    ~TaskProfiler();
+
+    esp_err_t Start();
+    void Stop();
+
+    const TaskSampler& GetSampler() const;
+    uint32_t GetIntervalMs() const;
+    int GetCoreCount() const;
+
+    static void SamplerTaskStatic(void* parameters);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "TaskSampler.hpp"
+#include <cstring>
+
+TaskSampler::TaskSampler(TaskSampleSource& source)
+    : _source(source)
+{
+}
+
+bool TaskSampler::Sample(int64_t now_us)
+{
+    uint32_t total_runtime = 0;
+    size_t task_count = _source.ReadTasks(_counters, TASK_SAMPLER_MAX_TASKS, total_runtime);
+    HeapCounters heap = _source.ReadHeap();
+    if (task_count == 0)
+    {
+        std::lock_guard<std::mutex> lock(_samplesMutex);
+        _skipped_sample_count++;
+        return false;
+    }
+
+    bool is_primed = _is_primed;
+    uint32_t previous_total_runtime = _previous_total_runtime;
+
+    // Unsigned differences stay correct when the 32 bit runtime counter wraps between samples
+    uint32_t interval_runtime = total_runtime - previous_total_runtime;
+    if (is_primed && interval_runtime > 0)
+    {
+        std::lock_guard<std::mutex> lock(_samplesMutex);
+        TaskSample& sample = _samples[_next_sample_index];
+        sample.time_us = now_us;
+        sample.interval_runtime = interval_runtime;
+        sample.heap = heap;
+        sample.heap_fragmentation_percent = heap.free_bytes == 0 ? 0 : 100 - (uint8_t)((uint64_t)heap.largest_free_block_bytes * 100 / heap.free_bytes);
+        sample.task_count = task_count;
+
+        for (size_t i = 0; i < task_count; i++)
+        {
+            const TaskCounters& counters = _counters[i];
+            TaskUsage& usage = sample.tasks[i];
+
+            // A task created since the previous sample has run for at most its whole counter
+            bool is_found = false;
+            uint32_t previous_runtime = FindPreviousRuntime(counters, is_found);
+            uint32_t task_runtime = is_found ? counters.runtime_counter - previous_runtime : counters.runtime_counter;
+            uint64_t cpu_permille = (uint64_t)task_runtime * 1000 / interval_runtime;
+
+            memcpy(usage.name, counters.name, sizeof(usage.name));
+            usage.name[sizeof(usage.name) - 1] = 0;
+            usage.stack_free_bytes = counters.stack_free_bytes;
+            usage.cpu_permille = cpu_permille > 1000 ? 1000 : cpu_permille;
+            usage.priority = counters.priority;
+            usage.core_id = counters.core_id;
+        }
+
+        _next_sample_index = (_next_sample_index + 1) % TASK_SAMPLER_WINDOW;
+        if (_sample_count < TASK_SAMPLER_WINDOW)
+        {
+            _sample_count++;
+        }
+    }
+
+    memcpy(_previous_counters, _counters, task_count * sizeof(TaskCounters));
+    _previous_count = task_count;
+    _previous_total_runtime = total_runtime;
+    _is_primed = true;
+    return is_primed && interval_runtime > 0;
+}
+
+size_t TaskSampler::CopySamples(TaskSample* output_samples, size_t capacity) const
+{
+    std::lock_guard<std::mutex> lock(_samplesMutex);
+    size_t copy_count = _sample_count < capacity ? _sample_count : capacity;
+
+    // The newest ones when they do not all fit
+    size_t first_index = (_next_sample_index + TASK_SAMPLER_WINDOW - copy_count) % TASK_SAMPLER_WINDOW;
+    for (size_t i = 0; i < copy_count; i++)
+    {
+        output_samples[i] = _samples[(first_index + i) % TASK_SAMPLER_WINDOW];
+    }
+    return copy_count;
+}
+
+size_t TaskSampler::GetSampleCount() const
+{
+    std::lock_guard<std::mutex> lock(_samplesMutex);
+    return _sample_count;
+}
+
+uint32_t TaskSampler::GetSkippedSampleCount() const
+{
+    std::lock_guard<std::mutex> lock(_samplesMutex);
+    return _skipped_sample_count;
+}
+
+uint32_t TaskSampler::FindPreviousRuntime(const TaskCounters& counters, bool& output_is_found) const
+{
+    // Task numbers are unique for the lifetime of the scheduler, a name could be reused
+    for (size_t i = 0; i < _previous_count; i++)
+    {
+        if (_previous_counters[i].task_number == counters.task_number)
+        {
+            output_is_found = true;
+            return _previous_counters[i].runtime_counter;
+        }
+    }
+
+    output_is_found = false;
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#ifndef TASKSAMPLER_HPP
+#define TASKSAMPLER_HPP
+
+// Rolling window of per task CPU usage, stack head room and heap fragmentation.
+// This file has no ESP-IDF dependency: the counters come from a TaskSampleSource, FreeRTOS on the
+// device and a scripted fake in tools/TaskProfilerHost, so the math is checked on Linux.
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// uxTaskGetSystemState needs room for every task, a sample with more tasks is skipped
+#ifndef TASK_SAMPLER_MAX_TASKS
+#define TASK_SAMPLER_MAX_TASKS 20
+#endif
+
+#ifndef TASK_SAMPLER_WINDOW
+#define TASK_SAMPLER_WINDOW 10
+#endif
+
+// configMAX_TASK_NAME_LEN of ESP-IDF
+#ifndef TASK_SAMPLER_NAME_LENGTH
+#define TASK_SAMPLER_NAME_LENGTH 16
+#endif
+
+struct TaskCounters
+{
+    char name[TASK_SAMPLER_NAME_LENGTH];
+    uint32_t task_number;
+    uint32_t runtime_counter;
+    uint32_t stack_free_bytes;
+    uint8_t priority;
+    int8_t core_id;
+};
+
+struct HeapCounters
+{
+    uint32_t free_bytes;
+    uint32_t minimum_free_bytes;
+    uint32_t largest_free_block_bytes;
+};
+
+class TaskSampleSource
+{
+public:
+    virtual ~TaskSampleSource() = default;
+
+    /// @brief Read the counters of every task
+    /// @param output_total_runtime The runtime clock, in the unit of TaskCounters::runtime_counter
+    /// @return Number of tasks written, 0 if they do not fit in capacity
+    virtual size_t ReadTasks(TaskCounters* output_tasks, size_t capacity, uint32_t& output_total_runtime) = 0;
+    virtual HeapCounters ReadHeap() = 0;
+};
+
+struct TaskUsage
+{
+    char name[TASK_SAMPLER_NAME_LENGTH];
+    uint32_t stack_free_bytes;
+    // Share of one core since the previous sample, the tasks of a dual core chip add up to 2000
+    uint16_t cpu_permille;
+    uint8_t priority;
+    int8_t core_id;
+};
+
+struct TaskSample
+{
+    int64_t time_us;
+    uint32_t interval_runtime;
+    HeapCounters heap;
+    uint8_t heap_fragmentation_percent;
+    uint8_t task_count;
+    TaskUsage tasks[TASK_SAMPLER_MAX_TASKS];
+};
+
+class TaskSampler
+{
+public:
+    TaskSampler(TaskSampleSource& source);
+
+    /// @brief Read the counters and store the usage since the previous call.
+    /// The first call only primes the runtime counters.
+    /// @return True if a sample was added to the window
+    bool Sample(int64_t now_us);
+
+    /// @brief Copy the samples out oldest first, so the window is only locked for the copy
+    /// @return Number of samples written, at most capacity
+    size_t CopySamples(TaskSample* output_samples, size_t capacity) const;
+    size_t GetSampleCount() const;
+    uint32_t GetSkippedSampleCount() const;
+
+private:
+    TaskSampleSource& _source;
+
+    // Only touched by Sample(), which runs on a single task
+    TaskCounters _counters[TASK_SAMPLER_MAX_TASKS] = {};
+    TaskCounters _previous_counters[TASK_SAMPLER_MAX_TASKS] = {};
+    size_t _previous_count = 0;
+    uint32_t _previous_total_runtime = 0;
+    bool _is_primed = false;
+    uint32_t _skipped_sample_count = 0;
+
+    TaskSample _samples[TASK_SAMPLER_WINDOW] = {};
+    size_t _next_sample_index = 0;
+    size_t _sample_count = 0;
+    mutable std::mutex _samplesMutex;
+
+    uint32_t FindPreviousRuntime(const TaskCounters& counters, bool& output_is_found) const;
+};
+
+#endif
\ No newline at end of file
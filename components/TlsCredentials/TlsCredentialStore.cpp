@@ -0,0 +1,60 @@
+#include "TlsCredentialStore.hpp"
+#include <mbedtls/platform_util.h>
+
+const char* TlsCredentialStore::_TAG = "TlsCredentialStore";
+
+esp_err_t TlsCredentialStore::Load(TlsCredentials& output_credentials)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t status = nvs_open(TLS_CREDENTIALS_NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (status != ESP_OK)
+    {
+        ESP_LOGI(_TAG, "No TLS credentials provisioned");
+        return status;
+    }
+
+    std::vector<uint8_t> certificate;
+    std::vector<uint8_t> private_key;
+    status = ReadBlob(nvs_handle, "cert", certificate);
+    if (status == ESP_OK)
+    {
+        status = ReadBlob(nvs_handle, "key", private_key);
+    }
+    nvs_close(nvs_handle);
+
+    if (status != ESP_OK)
+    {
+        ESP_LOGW(_TAG, "Incomplete TLS credentials %s", esp_err_to_name(status));
+        return status;
+    }
+
+    std::string error_message = "";
+    bool is_loaded = output_credentials.Load(certificate.data(), certificate.size(), private_key.data(), private_key.size(), error_message);
+    mbedtls_platform_zeroize(private_key.data(), private_key.size());
+    if (!is_loaded)
+    {
+        ESP_LOGE(_TAG, "TLS credentials not usable: %s", error_message.c_str());
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!output_credentials.IsEcdsa())
+    {
+        ESP_LOGW(_TAG, "The certificate has no EC key, every full handshake signs with RSA");
+    }
+
+    ESP_LOGI(_TAG, "Loaded a %d byte certificate", output_credentials.GetCertificateDerLength());
+    return ESP_OK;
+}
+
+esp_err_t TlsCredentialStore::ReadBlob(nvs_handle_t nvs_handle, const char* key, std::vector<uint8_t>& output_data)
+{
+    size_t length = 0;
+    esp_err_t status = nvs_get_blob(nvs_handle, key, NULL, &length);
+    if (status != ESP_OK)
+    {
+        return status;
+    }
+
+    output_data.resize(length);
+    return nvs_get_blob(nvs_handle, key, output_data.data(), &length);
+}
\ No newline at end of file
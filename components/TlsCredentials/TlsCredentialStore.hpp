@@ -0,0 +1,28 @@
+#ifndef TLSCREDENTIALSTORE_HPP
+#define TLSCREDENTIALSTORE_HPP
+
+#include <esp_log.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+#include "TlsCredentials.hpp"
+
+// Holds the "cert" and "key" blobs, provisioned per device (see tools/TlsHandshakeBench)
+#ifndef TLS_CREDENTIALS_NVS_NAMESPACE
+#define TLS_CREDENTIALS_NVS_NAMESPACE "tls"
+#endif
+
+/// @brief Reads the server certificate and key from NVS, so every device has its own key and none is
+/// built into the firmware image
+class TlsCredentialStore
+{
+public:
+    /// @return ESP_ERR_NVS_NOT_FOUND if the device was not provisioned, ESP_ERR_INVALID_ARG if the blobs do not parse
+    static esp_err_t Load(TlsCredentials& output_credentials);
+
+private:
+    static const char* _TAG;
+
+    static esp_err_t ReadBlob(nvs_handle_t nvs_handle, const char* key, std::vector<uint8_t>& output_data);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "TlsCredentials.hpp"
+#include <cstring>
+#include <mbedtls/error.h>
+#include <mbedtls/platform_util.h>
+
+TlsCredentials* TlsCredentials::_active_credentials = nullptr;
+
+TlsCredentials::TlsCredentials()
+{
+    mbedtls_entropy_init(&_entropy);
+    mbedtls_ctr_drbg_init(&_ctr_drbg);
+    mbedtls_x509_crt_init(&_certificate);
+    mbedtls_pk_init(&_private_key);
+}
+
+TlsCredentials::~TlsCredentials()
+{
+    if (_active_credentials == this)
+    {
+        _active_credentials = nullptr;
+    }
+
+    Clear();
+    mbedtls_x509_crt_free(&_certificate);
+    mbedtls_pk_free(&_private_key);
+    mbedtls_ctr_drbg_free(&_ctr_drbg);
+    mbedtls_entropy_free(&_entropy);
+}
+
+bool TlsCredentials::Load(const uint8_t* certificate, size_t certificate_length, const uint8_t* private_key, size_t private_key_length, std::string& output_error)
+{
+    Clear();
+
+    if (!certificate || certificate_length == 0 || !private_key || private_key_length == 0)
+    {
+        output_error = "The certificate or the key is empty";
+        return false;
+    }
+
+    int error = 0;
+    if (!_is_rng_seeded)
+    {
+        const char* personalization = "TlsCredentials";
+        error = mbedtls_ctr_drbg_seed(&_ctr_drbg, mbedtls_entropy_func, &_entropy,
+                                      reinterpret_cast<const unsigned char*>(personalization), strlen(personalization));
+        if (error != 0)
+        {
+            output_error = GetErrorString("Seeding the random generator", error);
+            return false;
+        }
+        _is_rng_seeded = true;
+    }
+
+    std::vector<uint8_t> certificate_buffer = CopyForParsing(certificate, certificate_length);
+    error = mbedtls_x509_crt_parse(&_certificate, certificate_buffer.data(), certificate_buffer.size());
+    if (error != 0)
+    {
+        output_error = GetErrorString("Parsing the certificate", error);
+        Clear();
+        return false;
+    }
+
+    std::vector<uint8_t> key_buffer = CopyForParsing(private_key, private_key_length);
+    error = mbedtls_pk_parse_key(&_private_key, key_buffer.data(), key_buffer.size(), NULL, 0, mbedtls_ctr_drbg_random, &_ctr_drbg);
+    mbedtls_platform_zeroize(key_buffer.data(), key_buffer.size());
+    if (error != 0)
+    {
+        output_error = GetErrorString("Parsing the private key", error);
+        Clear();
+        return false;
+    }
+
+    error = mbedtls_pk_check_pair(&_certificate.pk, &_private_key, mbedtls_ctr_drbg_random, &_ctr_drbg);
+    if (error != 0)
+    {
+        output_error = GetErrorString("The key does not match the certificate", error);
+        Clear();
+        return false;
+    }
+
+    // mbedtls_pk_write_key_der writes at the end of the buffer
+    std::vector<uint8_t> der_buffer(TLS_CREDENTIALS_MAX_KEY_DER_SIZE);
+    int der_length = mbedtls_pk_write_key_der(&_private_key, der_buffer.data(), der_buffer.size());
+    if (der_length < 0)
+    {
+        output_error = GetErrorString("Writing the private key", der_length);
+        Clear();
+        return false;
+    }
+    _private_key_der.assign(der_buffer.end() - der_length, der_buffer.end());
+    mbedtls_platform_zeroize(der_buffer.data(), der_buffer.size());
+
+    _is_loaded = true;
+    return true;
+}
+
+bool TlsCredentials::IsLoaded() const
+{
+    return _is_loaded;
+}
+
+bool TlsCredentials::IsEcdsa() const
+{
+    return _is_loaded && mbedtls_pk_can_do(&_private_key, MBEDTLS_PK_ECDSA);
+}
+
+const uint8_t* TlsCredentials::GetCertificateDer() const
+{
+    return _is_loaded ? _certificate.raw.p : nullptr;
+}
+
+size_t TlsCredentials::GetCertificateDerLength() const
+{
+    return _is_loaded ? _certificate.raw.len : 0;
+}
+
+const std::vector<uint8_t>& TlsCredentials::GetPrivateKeyDer() const
+{
+    return _private_key_der;
+}
+
+void TlsCredentials::Activate()
+{
+    _active_credentials = this;
+}
+
+int TlsCredentials::SelectCertificateStatic(mbedtls_ssl_context* ssl)
+{
+    TlsCredentials* credentials = _active_credentials;
+    if (!credentials || !credentials->_is_loaded)
+    {
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+
+    return mbedtls_ssl_set_hs_own_cert(ssl, &credentials->_certificate, &credentials->_private_key);
+}
+
+void TlsCredentials::Clear()
+{
+    _is_loaded = false;
+    mbedtls_x509_crt_free(&_certificate);
+    mbedtls_x509_crt_init(&_certificate);
+    mbedtls_pk_free(&_private_key);
+    mbedtls_pk_init(&_private_key);
+
+    if (!_private_key_der.empty())
+    {
+        mbedtls_platform_zeroize(_private_key_der.data(), _private_key_der.size());
+        _private_key_der.clear();
+    }
+}
+
+std::vector<uint8_t> TlsCredentials::CopyForParsing(const uint8_t* data, size_t length)
+{
+    // mbedTLS only takes a PEM with its null terminator counted in the length
+    std::vector<uint8_t> buffer(data, data + length);
+    const char* pem_begin = "-----BEGIN";
+    if (length >= strlen(pem_begin) && memcmp(data, pem_begin, strlen(pem_begin)) == 0 && buffer.back() != 0)
+    {
+        buffer.push_back(0);
+    }
+    return buffer;
+}
+
+std::string TlsCredentials::GetErrorString(const char* operation, int error)
+{
+    char description[96];
+    mbedtls_strerror(error, description, sizeof(description));
+    return std::string(operation) + " failed: " + description;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef TLSCREDENTIALS_HPP
+#define TLSCREDENTIALS_HPP
+
+// Certificate and private key of the HTTPS server, parsed once at boot.
+// This file only depends on mbedTLS, tools/TlsHandshakeBench runs it against the host build.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+
+// Room for the DER form of the private key, an RSA-4096 key needs about 2.4 KB
+#ifndef TLS_CREDENTIALS_MAX_KEY_DER_SIZE
+#define TLS_CREDENTIALS_MAX_KEY_DER_SIZE 2560
+#endif
+
+class TlsCredentials
+{
+public:
+    TlsCredentials();
+    ~TlsCredentials();
+
+    // Owns mbedTLS contexts that cannot be copied
+    TlsCredentials(const TlsCredentials&) = delete;
+    TlsCredentials& operator=(const TlsCredentials&) = delete;
+
+    /// @brief Parse the certificate and its private key and check that they belong together
+    /// @param certificate PEM or DER, a PEM does not need its null terminator
+    /// @param private_key PEM or DER, unencrypted
+    /// @param output_error Reason of the failure when false is returned
+    bool Load(const uint8_t* certificate, size_t certificate_length, const uint8_t* private_key, size_t private_key_length, std::string& output_error);
+    bool IsLoaded() const;
+
+    /// @brief True for an EC key. The server then signs with ECDSA, which costs a fraction of an
+    /// RSA signature of the same strength.
+    bool IsEcdsa() const;
+
+    /// @brief DER forms for a TLS stack that parses the credentials itself. The key is written with
+    /// its public point, so parsing it again skips a scalar multiplication.
+    const uint8_t* GetCertificateDer() const;
+    size_t GetCertificateDerLength() const;
+    const std::vector<uint8_t>& GetPrivateKeyDer() const;
+
+    /// @brief Hand these credentials out from SelectCertificateStatic
+    void Activate();
+
+    /// @brief Certificate selection hook of mbedTLS (mbedtls_ssl_conf_cert_cb). Gives the handshake the
+    /// parsed certificate and key of the active credentials, nothing is parsed per connection.
+    /// The hook carries no context, hence the single active instance.
+    static int SelectCertificateStatic(mbedtls_ssl_context* ssl);
+
+private:
+    mbedtls_entropy_context _entropy;
+    mbedtls_ctr_drbg_context _ctr_drbg;
+    bool _is_rng_seeded = false;
+
+    mbedtls_x509_crt _certificate;
+    mbedtls_pk_context _private_key;
+    std::vector<uint8_t> _private_key_der;
+    bool _is_loaded = false;
+
+    static TlsCredentials* _active_credentials;
+
+    void Clear();
+    static std::vector<uint8_t> CopyForParsing(const uint8_t* data, size_t length);
+    static std::string GetErrorString(const char* operation, int error);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,217 @@
+#include "AssetArchive.hpp"
+#include <algorithm>
+#include <cstring>
+
+bool AssetArchive::Open(const uint8_t* base, size_t available_size, std::string& output_error)
+{
+    Close();
+
+    if (!base || available_size < sizeof(AssetArchiveHeader))
+    {
+        output_error = "The archive is smaller than its header";
+        return false;
+    }
+
+    const AssetArchiveHeader* header = reinterpret_cast<const AssetArchiveHeader*>(base);
+    if (header->magic != ASSET_ARCHIVE_MAGIC)
+    {
+        output_error = "Bad magic, the partition holds no archive";
+        return false;
+    }
+
+    if (header->version != ASSET_ARCHIVE_VERSION)
+    {
+        output_error = "Unsupported archive version " + std::to_string(header->version);
+        return false;
+    }
+
+    size_t index_end = sizeof(AssetArchiveHeader) + (size_t)header->entry_count * sizeof(AssetArchiveEntry);
+    if (header->total_size > available_size || index_end > header->total_size)
+    {
+        output_error = "The archive is truncated";
+        return false;
+    }
+
+    const AssetArchiveEntry* entries = reinterpret_cast<const AssetArchiveEntry*>(base + sizeof(AssetArchiveHeader));
+    for (uint16_t i = 0; i < header->entry_count; i++)
+    {
+        const AssetArchiveEntry& entry = entries[i];
+        bool is_terminated = memchr(entry.path, '\0', sizeof(entry.path)) && memchr(entry.content_type, '\0', sizeof(entry.content_type));
+        bool is_in_bounds = entry.offset >= index_end && entry.offset <= header->total_size && entry.length <= header->total_size - entry.offset;
+        bool is_sorted = i == 0 || strcmp(entries[i - 1].path, entry.path) < 0;
+
+        if (!is_terminated || !is_in_bounds || !is_sorted)
+        {
+            output_error = "Entry " + std::to_string(i) + " is corrupted";
+            return false;
+        }
+    }
+
+    uint32_t crc = Crc32(0, base + sizeof(AssetArchiveHeader), header->total_size - sizeof(AssetArchiveHeader));
+    if (crc != header->data_crc32)
+    {
+        output_error = "Checksum mismatch";
+        return false;
+    }
+
+    _base = base;
+    _header = header;
+    _entries = entries;
+    return true;
+}
+
+void AssetArchive::Close()
+{
+    _base = nullptr;
+    _header = nullptr;
+    _entries = nullptr;
+}
+
+bool AssetArchive::IsOpen() const
+{
+    return _header != nullptr;
+}
+
+const AssetArchiveEntry* AssetArchive::Find(const char* path) const
+{
+    if (!IsOpen() || !path)
+    {
+        return nullptr;
+    }
+
+    size_t path_length = strcspn(path, "?#");
+    if (path_length >= sizeof(AssetArchiveEntry::path))
+    {
+        return nullptr;
+    }
+
+    // Entries are sorted, the index is small enough that a binary search beats any hashing
+    size_t low = 0;
+    size_t high = _header->entry_count;
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+        const char* entry_path = _entries[middle].path;
+
+        int comparison = strncmp(entry_path, path, path_length);
+        if (comparison == 0)
+        {
+            comparison = entry_path[path_length] == '\0' ? 0 : 1;
+        }
+
+        if (comparison == 0)
+        {
+            return &_entries[middle];
+        }
+
+        if (comparison < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return nullptr;
+}
+
+const uint8_t* AssetArchive::GetData(const AssetArchiveEntry& entry) const
+{
+    return _base + entry.offset;
+}
+
+uint16_t AssetArchive::GetEntryCount() const
+{
+    return IsOpen() ? _header->entry_count : 0;
+}
+
+const AssetArchiveEntry* AssetArchive::GetEntries() const
+{
+    return _entries;
+}
+
+uint32_t AssetArchive::GetTotalSize() const
+{
+    return IsOpen() ? _header->total_size : 0;
+}
+
+uint32_t AssetArchive::Crc32(uint32_t crc, const uint8_t* data, size_t length)
+{
+    // Bitwise CRC-32 (IEEE), only run when an archive is opened, a table is not worth the memory
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+/* AssetArchiveBuilder */
+bool AssetArchiveBuilder::AddFile(const std::string& path, const std::string& content_type, const std::vector<uint8_t>& data, uint32_t flags)
+{
+    if (path.empty() || path.size() >= sizeof(AssetArchiveEntry::path) || content_type.size() >= sizeof(AssetArchiveEntry::content_type))
+    {
+        return false;
+    }
+
+    for (const PendingFile& file : _files)
+    {
+        if (file.path == path)
+        {
+            return false;
+        }
+    }
+
+    _files.push_back({path, content_type, data, flags});
+    return true;
+}
+
+std::vector<uint8_t> AssetArchiveBuilder::Build() const
+{
+    std::vector<const PendingFile*> sorted_files;
+    for (const PendingFile& file : _files)
+    {
+        sorted_files.push_back(&file);
+    }
+    std::sort(sorted_files.begin(), sorted_files.end(), [](const PendingFile* left, const PendingFile* right) {
+        return strcmp(left->path.c_str(), right->path.c_str()) < 0;
+    });
+
+    size_t data_offset = sizeof(AssetArchiveHeader) + sorted_files.size() * sizeof(AssetArchiveEntry);
+    std::vector<AssetArchiveEntry> entries(sorted_files.size());
+    for (size_t i = 0; i < sorted_files.size(); i++)
+    {
+        AssetArchiveEntry& entry = entries[i];
+        memset(&entry, 0, sizeof(entry));
+        memcpy(entry.path, sorted_files[i]->path.c_str(), sorted_files[i]->path.size());
+        memcpy(entry.content_type, sorted_files[i]->content_type.c_str(), sorted_files[i]->content_type.size());
+        entry.offset = data_offset;
+        entry.length = sorted_files[i]->data.size();
+        entry.flags = sorted_files[i]->flags;
+
+        data_offset = (data_offset + entry.length + 3) & ~(size_t)3;
+    }
+
+    std::vector<uint8_t> archive(data_offset, 0);
+    memcpy(archive.data() + sizeof(AssetArchiveHeader), entries.data(), entries.size() * sizeof(AssetArchiveEntry));
+    for (size_t i = 0; i < sorted_files.size(); i++)
+    {
+        std::copy(sorted_files[i]->data.begin(), sorted_files[i]->data.end(), archive.begin() + entries[i].offset);
+    }
+
+    AssetArchiveHeader header = {};
+    header.magic = ASSET_ARCHIVE_MAGIC;
+    header.version = ASSET_ARCHIVE_VERSION;
+    header.entry_count = sorted_files.size();
+    header.total_size = archive.size();
+    header.data_crc32 = AssetArchive::Crc32(0, archive.data() + sizeof(AssetArchiveHeader), archive.size() - sizeof(AssetArchiveHeader));
+    memcpy(archive.data(), &header, sizeof(header));
+
+    return archive;
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#ifndef ASSETARCHIVE_HPP
+#define ASSETARCHIVE_HPP
+
+// Read only packed archive of the web assets. This file has no ESP-IDF dependency so the packer
+// in tools/AssetPacker builds it on the host.
+//
+// Layout (little endian, every offset 4 byte aligned):
+//   AssetArchiveHeader
+//   AssetArchiveEntry[entry_count]   sorted by path for binary search
+//   file data
+// data_crc32 covers everything after the header up to total_size.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef ASSET_ARCHIVE_MAGIC
+#define ASSET_ARCHIVE_MAGIC 0x54534157 // "WAST"
+#endif
+
+#ifndef ASSET_ARCHIVE_VERSION
+#define ASSET_ARCHIVE_VERSION 1
+#endif
+
+// The stored data is gzip encoded, serve it with Content-Encoding: gzip
+#ifndef ASSET_ENTRY_FLAG_GZIP
+#define ASSET_ENTRY_FLAG_GZIP 0x1
+#endif
+
+struct AssetArchiveHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_count;
+    uint32_t total_size;
+    uint32_t data_crc32;
+    uint32_t reserved[2];
+};
+static_assert(sizeof(AssetArchiveHeader) == 24, "AssetArchiveHeader layout is part of the archive format");
+
+struct AssetArchiveEntry
+{
+    char path[56];
+    char content_type[28];
+    uint32_t offset;
+    uint32_t length;
+    uint32_t flags;
+};
+static_assert(sizeof(AssetArchiveEntry) == 96, "AssetArchiveEntry layout is part of the archive format");
+
+/// @brief Zero copy view over an archive that is already in memory (e.g. memory mapped flash)
+class AssetArchive
+{
+public:
+    /// @brief Validate the archive and keep a view on it. The memory must outlive the archive.
+    /// @param base Start of the archive
+    /// @param available_size Bytes readable from base, e.g. the partition size
+    /// @param output_error Reason of the failure when false is returned
+    bool Open(const uint8_t* base, size_t available_size, std::string& output_error);
+    void Close();
+    bool IsOpen() const;
+
+    /// @brief Look up a file by request path. A query string after '?' is ignored.
+    /// @return nullptr if the file is not in the archive
+    const AssetArchiveEntry* Find(const char* path) const;
+
+    const uint8_t* GetData(const AssetArchiveEntry& entry) const;
+    uint16_t GetEntryCount() const;
+    const AssetArchiveEntry* GetEntries() const;
+    uint32_t GetTotalSize() const;
+
+    static uint32_t Crc32(uint32_t crc, const uint8_t* data, size_t length);
+
+private:
+    const uint8_t* _base = nullptr;
+    const AssetArchiveHeader* _header = nullptr;
+    const AssetArchiveEntry* _entries = nullptr;
+};
+
+/// @brief Builds an archive in memory, used by the host packer
+class AssetArchiveBuilder
+{
+public:
+    /// @return False if the path or content type does not fit in an entry or the path is a duplicate
+    bool AddFile(const std::string& path, const std::string& content_type, const std::vector<uint8_t>& data, uint32_t flags);
+
+    std::vector<uint8_t> Build() const;
+
+private:
+    struct PendingFile
+    {
+        std::string path;
+        std::string content_type;
+        std::vector<uint8_t> data;
+        uint32_t flags;
+    };
+
+    std::vector<PendingFile> _files;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,305 @@
+#include "WebAssets.hpp"
+#include <cstring>
+
+// Custom data subtype of the "assets_a" and "assets_b" entries in partitions.csv
+#ifndef WEB_ASSETS_PARTITION_SUBTYPE
+#define WEB_ASSETS_PARTITION_SUBTYPE ((esp_partition_subtype_t)0x40)
+#endif
+
+#ifndef WEB_ASSETS_SECTOR_SIZE
+#define WEB_ASSETS_SECTOR_SIZE 4096
+#endif
+
+const char* WebAssets::_TAG = "WebAssets";
+
+WebAssets::WebAssets()
+{
+}
+
+WebAssets::~WebAssets()
+{
+    Unmount();
+}
+
+esp_err_t WebAssets::Mount()
+{
+    Unmount();
+
+    if (!FindSlots())
+    {
+        ESP_LOGW(_TAG, "No assets partitions, serving the embedded files");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    int preferred_slot = 0;
+    LoadSettings(preferred_slot);
+
+    // The other slot may hold the previous archive, it is better than the embedded fallback
+    for (int attempt = 0; attempt < _slot_count; attempt++)
+    {
+        int slot = (preferred_slot + attempt) % _slot_count;
+        if (MapSlot(slot, _mmap_handle, _mapped_memory, _archive) == ESP_OK)
+        {
+            _active_slot = slot;
+            ESP_LOGI(_TAG, "Mounted %d assets from %s, %lu bytes", _archive.GetEntryCount(), _slot_labels[slot], _archive.GetTotalSize());
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_INVALID_STATE;
+}
+
+bool WebAssets::IsMounted() const
+{
+    return _archive.IsOpen();
+}
+
+const AssetArchiveEntry* WebAssets::Find(const char* path) const
+{
+    return _archive.Find(path);
+}
+
+const uint8_t* WebAssets::GetData(const AssetArchiveEntry& entry) const
+{
+    return _archive.GetData(entry);
+}
+
+bool WebAssets::IsUploadAuthorized(const char* token) const
+{
+    if (_upload_token.empty() || !token)
+    {
+        return false;
+    }
+
+    // The time taken does not depend on where the first wrong character is
+    size_t token_length = strnlen(token, WEB_ASSETS_UPLOAD_TOKEN_MAX_LENGTH + 1);
+    uint8_t difference = token_length != _upload_token.size() ? 1 : 0;
+    for (size_t i = 0; i < _upload_token.size(); i++)
+    {
+        difference |= _upload_token[i] ^ (i < token_length ? token[i] : 0);
+    }
+    return difference == 0;
+}
+
+esp_err_t WebAssets::BeginUpdate(size_t total_size)
+{
+    if (!FindSlots())
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    int update_slot = GetUpdateSlot();
+    if (total_size < sizeof(AssetArchiveHeader) || total_size > _slots[update_slot]->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    _is_updating = true;
+    _update_slot = update_slot;
+    _update_size = total_size;
+    _written_size = 0;
+    _erased_size = 0;
+
+    ESP_LOGI(_TAG, "Start updating %s, %zu bytes", _slot_labels[update_slot], total_size);
+    return ESP_OK;
+}
+
+esp_err_t WebAssets::WriteChunk(const uint8_t* data, size_t length)
+{
+    if (!_is_updating)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (length > _update_size - _written_size)
+    {
+        AbortUpdate();
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    const esp_partition_t* partition = _slots[_update_slot];
+    size_t write_end = _written_size + length;
+    if (write_end > _erased_size)
+    {
+        size_t erase_end = (write_end + WEB_ASSETS_SECTOR_SIZE - 1) / WEB_ASSETS_SECTOR_SIZE * WEB_ASSETS_SECTOR_SIZE;
+        esp_err_t erase_status = esp_partition_erase_range(partition, _erased_size, erase_end - _erased_size);
+        if (erase_status != ESP_OK)
+        {
+            ESP_LOGE(_TAG, "Failed to erase %s %s", _slot_labels[_update_slot], esp_err_to_name(erase_status));
+            AbortUpdate();
+            return erase_status;
+        }
+        _erased_size = erase_end;
+    }
+
+    esp_err_t write_status = esp_partition_write(partition, _written_size, data, length);
+    if (write_status != ESP_OK)
+    {
+        ESP_LOGE(_TAG, "Failed to write %s %s", _slot_labels[_update_slot], esp_err_to_name(write_status));
+        AbortUpdate();
+        return write_status;
+    }
+
+    _written_size = write_end;
+    return ESP_OK;
+}
+
+esp_err_t WebAssets::FinishUpdate()
+{
+    if (!_is_updating)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    _is_updating = false;
+    if (_written_size != _update_size)
+    {
+        ESP_LOGW(_TAG, "Update incomplete, %zu of %zu bytes", _written_size, _update_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    esp_partition_mmap_handle_t mmap_handle = 0;
+    const void* mapped_memory = NULL;
+    AssetArchive archive;
+    esp_err_t status = MapSlot(_update_slot, mmap_handle, mapped_memory, archive);
+    if (status != ESP_OK)
+    {
+        ESP_LOGW(_TAG, "Rejected the update, still serving %s", _active_slot >= 0 ? _slot_labels[_active_slot] : "the embedded files");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Switch over only now, the old archive was served until the new one checked out
+    Unmount();
+    _mmap_handle = mmap_handle;
+    _mapped_memory = mapped_memory;
+    _archive = archive;
+    _active_slot = _update_slot;
+
+    if (SaveActiveSlot() != ESP_OK)
+    {
+        ESP_LOGW(_TAG, "Cannot persist the active slot, the previous archive comes back after a restart");
+    }
+
+    ESP_LOGI(_TAG, "Serving %d assets from %s, %lu bytes", _archive.GetEntryCount(), _slot_labels[_active_slot], _archive.GetTotalSize());
+    return ESP_OK;
+}
+
+void WebAssets::AbortUpdate()
+{
+    if (!_is_updating)
+    {
+        return;
+    }
+
+    // The served slot was never touched, the partial archive fails its checksum if it is ever mounted
+    ESP_LOGW(_TAG, "Assets update aborted after %zu bytes", _written_size);
+    _is_updating = false;
+}
+
+size_t WebAssets::GetPartitionSize() const
+{
+    int update_slot = GetUpdateSlot();
+    return _slots[update_slot] ? _slots[update_slot]->size : 0;
+}
+
+bool WebAssets::FindSlots()
+{
+    for (int slot = 0; slot < _slot_count; slot++)
+    {
+        if (!_slots[slot])
+        {
+            _slots[slot] = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, WEB_ASSETS_PARTITION_SUBTYPE, _slot_labels[slot]);
+        }
+    }
+
+    return _slots[0] && _slots[1];
+}
+
+esp_err_t WebAssets::MapSlot(int slot, esp_partition_mmap_handle_t& output_handle, const void*& output_memory, AssetArchive& output_archive)
+{
+    const esp_partition_t* partition = _slots[slot];
+    esp_err_t status = esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &output_memory, &output_handle);
+    if (status != ESP_OK)
+    {
+        ESP_LOGE(_TAG, "Failed to map %s %s", _slot_labels[slot], esp_err_to_name(status));
+        output_memory = NULL;
+        return status;
+    }
+
+    std::string error_message = "";
+    if (!output_archive.Open(reinterpret_cast<const uint8_t*>(output_memory), partition->size, error_message))
+    {
+        ESP_LOGW(_TAG, "%s not usable: %s", _slot_labels[slot], error_message.c_str());
+        esp_partition_munmap(output_handle);
+        output_memory = NULL;
+        output_handle = 0;
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return ESP_OK;
+}
+
+int WebAssets::GetUpdateSlot() const
+{
+    // Never the slot being served
+    return _active_slot == 0 ? 1 : 0;
+}
+
+void WebAssets::LoadSettings(int& output_preferred_slot)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(WEB_ASSETS_NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK)
+    {
+        ESP_LOGW(_TAG, "No upload token provisioned, PUT /assets is disabled");
+        return;
+    }
+
+    uint8_t slot = 0;
+    if (nvs_get_u8(nvs_handle, "slot", &slot) == ESP_OK && slot < _slot_count)
+    {
+        output_preferred_slot = slot;
+    }
+
+    char upload_token[WEB_ASSETS_UPLOAD_TOKEN_MAX_LENGTH + 1] = {};
+    size_t upload_token_length = sizeof(upload_token);
+    if (nvs_get_str(nvs_handle, "upload_token", upload_token, &upload_token_length) == ESP_OK)
+    {
+        _upload_token = upload_token;
+    }
+    else
+    {
+        ESP_LOGW(_TAG, "No upload token provisioned, PUT /assets is disabled");
+    }
+    nvs_close(nvs_handle);
+}
+
+esp_err_t WebAssets::SaveActiveSlot()
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t status = nvs_open(WEB_ASSETS_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (status != ESP_OK)
+    {
+        return status;
+    }
+
+    status = nvs_set_u8(nvs_handle, "slot", (uint8_t)_active_slot);
+    if (status == ESP_OK)
+    {
+        status = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+    return status;
+}
+
+void WebAssets::Unmount()
+{
+    _archive.Close();
+    _active_slot = -1;
+
+    if (_mapped_memory)
+    {
+        esp_partition_munmap(_mmap_handle);
+        _mapped_memory = NULL;
+        _mmap_handle = 0;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+#ifndef WEBASSETS_HPP
+#define WEBASSETS_HPP
+
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <nvs.h>
+#include <string>
+#include "AssetArchive.hpp"
+
+// Holds "slot", the index of the slot being served, and "upload_token", the bearer token an upload
+// must present. The token is provisioned like the TLS credentials, e.g. with the NVS partition generator:
+//   web_assets,namespace,,
+//   upload_token,data,string,<token>
+#ifndef WEB_ASSETS_NVS_NAMESPACE
+#define WEB_ASSETS_NVS_NAMESPACE "web_assets"
+#endif
+
+#ifndef WEB_ASSETS_UPLOAD_TOKEN_MAX_LENGTH
+#define WEB_ASSETS_UPLOAD_TOKEN_MAX_LENGTH 64
+#endif
+
+/// @brief Web UI files served straight from a memory mapped data partition.
+/// Two partitions, "assets_a" and "assets_b", each hold an AssetArchive. An update streams into the
+/// slot that is not served and switches over only once the new archive validated, so a failed,
+/// aborted or corrupted upload leaves the current UI in place.
+class WebAssets
+{
+private:
+    static constexpr int _slot_count = 2;
+
+    const esp_partition_t* _slots[_slot_count] = {};
+    // Slot mapped and served, -1 while no archive is mounted
+    int _active_slot = -1;
+    esp_partition_mmap_handle_t _mmap_handle = 0;
+    const void* _mapped_memory = NULL;
+    AssetArchive _archive;
+    std::string _upload_token;
+
+    // Streaming update state
+    bool _is_updating = false;
+    int _update_slot = -1;
+    size_t _update_size = 0;
+    size_t _written_size = 0;
+    size_t _erased_size = 0;
+
+    static const char* _TAG;
+    static constexpr const char* _slot_labels[_slot_count] = {"assets_a", "assets_b"};
+
+    bool FindSlots();
+    /// @brief Map a slot and validate the archive in it. Nothing is kept mapped on failure.
+    esp_err_t MapSlot(int slot, esp_partition_mmap_handle_t& output_handle, const void*& output_memory, AssetArchive& output_archive);
+    int GetUpdateSlot() const;
+    void LoadSettings(int& output_preferred_slot);
+    esp_err_t SaveActiveSlot();
+    void Unmount();
+
+public:
+    WebAssets();
+    ~WebAssets();
+
+    /// @brief Map the slot served last, or the other one if it holds no valid archive
+    /// @return ESP_ERR_NOT_FOUND without the partitions, ESP_ERR_INVALID_STATE if neither holds a valid archive
+    esp_err_t Mount();
+    bool IsMounted() const;
+
+    /// @brief Zero copy lookup, the returned data points into the mapped flash
+    /// @return nullptr if the archive is not mounted or does not contain the path
+    const AssetArchiveEntry* Find(const char* path) const;
+    const uint8_t* GetData(const AssetArchiveEntry& entry) const;
+
+    /// @brief Check the bearer token of an upload in constant time
+    /// @return False for any token while none is provisioned
+    bool IsUploadAuthorized(const char* token) const;
+
+    /// @brief Start writing a new archive into the slot that is not served. The current archive stays mounted.
+    /// @param total_size Size of the whole archive that will be written
+    esp_err_t BeginUpdate(size_t total_size);
+
+    /// @brief Append the next chunk. Flash sectors are erased just ahead of the write position,
+    /// so the upload never buffers more than one chunk in RAM.
+    esp_err_t WriteChunk(const uint8_t* data, size_t length);
+
+    /// @brief Validate the written archive and serve it from now on
+    /// @return ESP_ERR_INVALID_STATE if the archive does not validate, the current one is still served
+    esp_err_t FinishUpdate();
+    void AbortUpdate();
+
+    /// @brief The largest archive an update accepts
+    size_t GetPartitionSize() const;
+};
+
+#endif
\ No newline at end of file
@@ -9,6 +9,12 @@ extern "C"
 #include "LedControl.hpp"
 #include "WifiControl.hpp"
 #include "HttpServer.hpp"
+#include "MqttBridge.hpp"
+#include "GroupSync.hpp"
+#include "TaskProfiler.hpp"
+#include "ButtonInput.hpp"
+#include "StateHistory.hpp"
+#include "TlsCredentialStore.hpp"
 
 // new
 #include <esp_netif.h>
@@ -35,11 +41,44 @@ void app_main(void)
 
     ESP_LOGI("Main", "The GPIO_NUM_26: %d", GPIO_NUM_26);
     std::shared_ptr<LedControl> led = std::make_shared<LedControl>(GPIO_NUM_26);
+
+    // Records the changes of every command source, so it starts before any of them
+    std::shared_ptr<StateHistory> state_history = std::make_shared<StateHistory>(led);
+    if (state_history->Start() != ESP_OK)
+    {
+        state_history.reset();
+    }
+
+    std::shared_ptr<GroupSync> group_sync = std::make_shared<GroupSync>(led);
+
+    std::shared_ptr<TaskProfiler> task_profiler = std::make_shared<TaskProfiler>();
+    task_profiler->Start();
+
+    // Wall button between GPIO 27 and ground
+    std::shared_ptr<ButtonInput> button_input = std::make_shared<ButtonInput>(led);
+    button_input->AddButton(GPIO_NUM_27);
+
+    // The server speaks HTTPS and WSS when the device was provisioned with a certificate
+    std::shared_ptr<TlsCredentials> tls_credentials = std::make_shared<TlsCredentials>();
+    if (TlsCredentialStore::Load(*tls_credentials) != ESP_OK)
+    {
+        tls_credentials.reset();
+    }
+
     std::string host_name = "Baobao";
     httpd_handle_t server_handle = NULL;
-    HttpServer server(server_handle, led, host_name);
+    HttpServer server(server_handle, led, host_name, group_sync, task_profiler, button_input, state_history, tls_credentials);
     esp_err_t start = server.Start();
 
+    // Command sources start after the server registered its state change listener
+    group_sync->Start();
+    button_input->Start();
+
+    // The bridge stays disabled until a broker uri is configured
+    std::string mqtt_broker_uri = "";
+    MqttBridge mqtt_bridge(led, mqtt_broker_uri, "baobao");
+    mqtt_bridge.Start();
+
     while (server.GetServer())
     {
         sleep(1);
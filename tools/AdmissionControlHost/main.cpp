@@ -0,0 +1,342 @@
+// Drives the firmware admission control with a fake clock and checks what it admits.
+//
+//   AdmissionControlHost
+//
+// Bucket checks: a bucket starts full, refills at its rate without losing sub token remainders to
+// rounding, ignores a clock stepping backwards and is simply full after a long idle time.
+// Admission checks: the socket, address and global limits each stop a client, a rejected request
+// takes no token from any bucket, reconnecting costs an address token, sockets beyond the table only
+// meet the global budget, and the address table evicts only addresses without open sockets.
+// Simulation: with the budgets of the firmware, a flooding client and a browser share the server for
+// a minute of fake time. The flood is held to its socket rate while every browser request gets through.
+// The exit code is non zero if any check fails.
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include "AdmissionControl.hpp"
+
+static int _failure_count = 0;
+
+static void Check(bool condition, const std::string& message)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << message << "\n";
+        _failure_count++;
+    }
+}
+
+/// @brief Stands in for esp_timer_get_time, time only moves when the test says so
+class FakeClock
+{
+public:
+    int64_t Now() const
+    {
+        return _now_us;
+    }
+
+    void Advance(int64_t duration_us)
+    {
+        _now_us += duration_us;
+    }
+
+private:
+    // Not zero, the device calls in long after boot
+    int64_t _now_us = 5000000;
+};
+
+// The budgets HttpServer starts with
+static const AdmissionControl::Config _device_config = {{10, 20}, {20, 40}, {60, 120}};
+
+// Only one limit at a time is small enough to be reached
+static const AdmissionControl::Config _socket_config = {{10, 5}, {1000, 1000}, {1000, 1000}};
+static const AdmissionControl::Config _address_config = {{1000, 1000}, {10, 5}, {1000, 1000}};
+static const AdmissionControl::Config _global_config = {{1000, 1000}, {1000, 1000}, {10, 5}};
+
+static uint32_t Address(uint8_t last_octet)
+{
+    return 0xC0A80100 | last_octet;
+}
+
+/// @return How many requests in a row were admitted before the first rejection, at most limit
+static int CountAdmitted(AdmissionControl& admission_control, int socket_file_descriptor, const FakeClock& clock, int limit, uint8_t& output_result)
+{
+    output_result = ADMISSION_RESULT_ADMITTED;
+    for (int i = 0; i < limit; i++)
+    {
+        output_result = admission_control.Admit(socket_file_descriptor, clock.Now());
+        if (output_result != ADMISSION_RESULT_ADMITTED)
+        {
+            return i;
+        }
+    }
+    return limit;
+}
+
+static void CheckBucket()
+{
+    FakeClock clock;
+    TokenBucket bucket;
+    bucket.Reset({10, 3}, clock.Now());
+
+    int token_count = 0;
+    while (bucket.HasToken() && token_count < 100)
+    {
+        bucket.Take();
+        token_count++;
+    }
+    Check(token_count == 3, "bucket: starts with its burst");
+
+    clock.Advance(99999);
+    bucket.Refill(clock.Now());
+    Check(!bucket.HasToken(), "bucket: no token before 100 ms at 10/s");
+    clock.Advance(1);
+    bucket.Refill(clock.Now());
+    Check(bucket.HasToken(), "bucket: a token after 100 ms at 10/s");
+    bucket.Take();
+
+    // 100000 refills of a microsecond each add up to the same token
+    for (int i = 0; i < 100000; i++)
+    {
+        clock.Advance(1);
+        bucket.Refill(clock.Now());
+    }
+    Check(bucket.HasToken(), "bucket: microsecond refills are not rounded away");
+    bucket.Take();
+
+    bucket.Refill(clock.Now() - 1000000);
+    Check(!bucket.HasToken(), "bucket: a clock stepping backwards adds nothing");
+    clock.Advance(100000);
+    bucket.Refill(clock.Now());
+    Check(bucket.HasToken(), "bucket: refills again after the backwards step");
+
+    clock.Advance(7LL * 24 * 3600 * 1000000);
+    bucket.Refill(clock.Now());
+    token_count = 0;
+    while (bucket.HasToken() && token_count < 100)
+    {
+        bucket.Take();
+        token_count++;
+    }
+    Check(token_count == 3, "bucket: full and not beyond after a week idle");
+
+    TokenBucket closed_bucket;
+    closed_bucket.Reset({0, 2}, clock.Now());
+    closed_bucket.Take();
+    closed_bucket.Take();
+    clock.Advance(3600LL * 1000000);
+    closed_bucket.Refill(clock.Now());
+    Check(!closed_bucket.HasToken(), "bucket: a zero rate never refills");
+}
+
+static void CheckLimits()
+{
+    FakeClock clock;
+    uint8_t result = ADMISSION_RESULT_ADMITTED;
+
+    AdmissionControl socket_limited(_socket_config);
+    Check(socket_limited.OnOpen(3, Address(1), clock.Now()), "socket: opened");
+    Check(socket_limited.OnOpen(4, Address(1), clock.Now()), "socket: second socket opened");
+    Check(CountAdmitted(socket_limited, 3, clock, 100, result) == 5 && result == ADMISSION_RESULT_SOCKET_LIMITED, "socket: burst then limited");
+    Check(CountAdmitted(socket_limited, 4, clock, 100, result) == 5, "socket: the other socket of the address has its own budget");
+    clock.Advance(200000);
+    Check(CountAdmitted(socket_limited, 3, clock, 100, result) == 2, "socket: refilled at its rate");
+
+    AdmissionControl address_limited(_address_config);
+    // Opening costs an address token as well
+    address_limited.OnOpen(3, Address(1), clock.Now());
+    address_limited.OnOpen(4, Address(1), clock.Now());
+    address_limited.OnOpen(5, Address(2), clock.Now());
+    Check(CountAdmitted(address_limited, 3, clock, 100, result) == 3 && result == ADMISSION_RESULT_ADDRESS_LIMITED, "address: burst less the two opens");
+    Check(CountAdmitted(address_limited, 4, clock, 100, result) == 0, "address: shared by the sockets of the address");
+    Check(CountAdmitted(address_limited, 5, clock, 100, result) == 4, "address: another address is not affected");
+
+    AdmissionControl global_limited(_global_config);
+    for (int socket = 3; socket < 8; socket++)
+    {
+        global_limited.OnOpen(socket, Address(socket), clock.Now());
+    }
+    int admitted_count = 0;
+    for (int socket = 3; socket < 8; socket++)
+    {
+        admitted_count += CountAdmitted(global_limited, socket, clock, 100, result);
+    }
+    Check(admitted_count == 5 && result == ADMISSION_RESULT_GLOBAL_LIMITED, "global: shared by every address");
+
+    AdmissionControl::Statistics statistics = global_limited.GetStatistics();
+    Check(statistics.admitted_count == 5 && statistics.global_limited_count == 5, "global: statistics");
+    Check(statistics.open_socket_count == 5 && statistics.tracked_address_count == 5, "global: tracked sockets and addresses");
+}
+
+static void CheckRejectionsTakeNothing()
+{
+    FakeClock clock;
+    uint8_t result = ADMISSION_RESULT_ADMITTED;
+
+    // The flooding socket runs into its own limit, the address and global budgets stay untouched
+    AdmissionControl admission_control({{10, 5}, {10, 14}, {10, 30}});
+    admission_control.OnOpen(3, Address(1), clock.Now());
+    admission_control.OnOpen(4, Address(1), clock.Now());
+    Check(CountAdmitted(admission_control, 3, clock, 5, result) == 5, "rejection: socket burst");
+    for (int i = 0; i < 1000; i++)
+    {
+        admission_control.Admit(3, clock.Now());
+    }
+    // 14 address tokens less 3 opens and the 10 admitted requests leave exactly one
+    int admitted_count = CountAdmitted(admission_control, 4, clock, 5, result);
+    admission_control.OnOpen(5, Address(1), clock.Now());
+    admitted_count += CountAdmitted(admission_control, 5, clock, 100, result);
+    Check(admitted_count == 6 && result == ADMISSION_RESULT_ADDRESS_LIMITED, "rejection: the address lost nothing to the rejected requests");
+
+    admission_control.OnOpen(6, Address(2), clock.Now());
+    Check(CountAdmitted(admission_control, 6, clock, 100, result) == 5 && result == ADMISSION_RESULT_SOCKET_LIMITED, "rejection: global budget left for others");
+    Check(admission_control.GetStatistics().admitted_count == 16, "rejection: admitted count");
+}
+
+static void CheckConnections()
+{
+    FakeClock clock;
+    uint8_t result = ADMISSION_RESULT_ADMITTED;
+
+    // Reconnecting does not refill anything, every open costs an address token
+    AdmissionControl reconnecting(_address_config);
+    int open_count = 0;
+    while (open_count < 100 && reconnecting.OnOpen(3, Address(1), clock.Now()))
+    {
+        reconnecting.OnClose(3);
+        open_count++;
+    }
+    Check(open_count == 5, "reconnect: limited by the address burst");
+    Check(reconnecting.GetStatistics().rejected_connection_count == 1, "reconnect: rejected connection counted");
+    Check(reconnecting.GetStatistics().open_socket_count == 0, "reconnect: nothing left open");
+    clock.Advance(100000);
+    Check(reconnecting.OnOpen(3, Address(1), clock.Now()), "reconnect: allowed again once refilled");
+
+    // Sockets beyond the table are still served, against the global budget only
+    AdmissionControl crowded(_socket_config);
+    for (int socket = 0; socket < ADMISSION_MAX_SOCKETS + 2; socket++)
+    {
+        Check(crowded.OnOpen(100 + socket, Address(socket % 4), clock.Now()), "crowded: opened " + std::to_string(socket));
+    }
+    AdmissionControl::Statistics statistics = crowded.GetStatistics();
+    Check(statistics.open_socket_count == ADMISSION_MAX_SOCKETS && statistics.untracked_socket_count == 2, "crowded: two untracked sockets");
+    Check(CountAdmitted(crowded, 100 + ADMISSION_MAX_SOCKETS, clock, 50, result) == 50, "crowded: an untracked socket meets no socket limit");
+    Check(CountAdmitted(crowded, 100, clock, 50, result) == 5, "crowded: a tracked socket still does");
+
+    // A closed socket frees its entry for the next one
+    crowded.OnClose(100);
+    Check(crowded.OnOpen(200, Address(9), clock.Now()), "crowded: reopened");
+    Check(crowded.GetStatistics().untracked_socket_count == 2, "crowded: the freed entry is reused");
+
+    // A descriptor reused without a close callback does not leak a socket on its old address
+    AdmissionControl reused(_device_config);
+    reused.OnOpen(3, Address(1), clock.Now());
+    reused.OnOpen(3, Address(2), clock.Now());
+    statistics = reused.GetStatistics();
+    Check(statistics.open_socket_count == 1 && statistics.tracked_address_count == 2, "reused: one socket");
+    reused.OnClose(3);
+    reused.OnClose(3);
+    Check(reused.GetStatistics().open_socket_count == 0, "reused: closed once, closing twice is harmless");
+}
+
+static void CheckAddressEviction()
+{
+    FakeClock clock;
+    uint8_t result = ADMISSION_RESULT_ADMITTED;
+    AdmissionControl admission_control(_address_config);
+
+    // Address 1 keeps a socket open, the others connect once and leave
+    admission_control.OnOpen(3, Address(1), clock.Now());
+    CountAdmitted(admission_control, 3, clock, 100, result);
+    for (uint8_t octet = 2; octet < 2 + ADMISSION_MAX_ADDRESSES * 2; octet++)
+    {
+        clock.Advance(1000);
+        admission_control.OnOpen(10, Address(octet), clock.Now());
+        admission_control.OnClose(10);
+    }
+    Check(admission_control.GetStatistics().tracked_address_count == ADMISSION_MAX_ADDRESSES, "eviction: table stays full");
+
+    // Still the drained bucket, the address with an open socket was never evicted
+    Check(CountAdmitted(admission_control, 3, clock, 100, result) == 0, "eviction: an address with open sockets is kept");
+    Check(!admission_control.OnOpen(4, Address(1), clock.Now()), "eviction: its next connection is still refused");
+
+    // The address seen longest ago made room, it comes back with a full bucket
+    admission_control.OnOpen(11, Address(2), clock.Now());
+    Check(CountAdmitted(admission_control, 11, clock, 100, result) == 4, "eviction: the oldest address was replaced");
+
+    // Every entry held by an open socket: the next address is served without an address budget
+    AdmissionControl full(_address_config);
+    for (int socket = 0; socket < ADMISSION_MAX_ADDRESSES; socket++)
+    {
+        full.OnOpen(20 + socket, Address(socket), clock.Now());
+    }
+    Check(full.OnOpen(40, Address(200), clock.Now()), "eviction: admitted without an address entry");
+    Check(CountAdmitted(full, 40, clock, 50, result) == 50, "eviction: only the socket and global limits apply");
+}
+
+static void RunSimulation()
+{
+    FakeClock clock;
+    AdmissionControl admission_control(_device_config);
+
+    // The flood keeps one connection and sends 100 requests per second, the browser opens a
+    // keep-alive connection and loads a page of 6 requests every 3 seconds
+    const int flood_socket = 3;
+    const int browser_socket = 4;
+    admission_control.OnOpen(flood_socket, Address(66), clock.Now());
+    admission_control.OnOpen(browser_socket, Address(20), clock.Now());
+
+    const int64_t duration_us = 60LL * 1000000;
+    const int64_t step_us = 10000;
+    uint32_t flood_sent = 0;
+    uint32_t flood_admitted = 0;
+    uint32_t browser_sent = 0;
+    uint32_t browser_admitted = 0;
+    for (int64_t elapsed_us = 0; elapsed_us < duration_us; elapsed_us += step_us)
+    {
+        flood_sent++;
+        flood_admitted += admission_control.Admit(flood_socket, clock.Now()) == ADMISSION_RESULT_ADMITTED ? 1 : 0;
+
+        if (elapsed_us % 3000000 == 0)
+        {
+            for (int request = 0; request < 6; request++)
+            {
+                browser_sent++;
+                browser_admitted += admission_control.Admit(browser_socket, clock.Now()) == ADMISSION_RESULT_ADMITTED ? 1 : 0;
+            }
+        }
+        clock.Advance(step_us);
+    }
+
+    std::cout << "flood:   " << flood_admitted << " of " << flood_sent << " admitted, "
+              << flood_admitted * 1000000.0 / duration_us << " per second\n";
+    std::cout << "browser: " << browser_admitted << " of " << browser_sent << " admitted\n";
+
+    // The socket burst and then the socket rate, 20 + 10/s for 60 s
+    Check(flood_admitted >= 615 && flood_admitted <= 621, "simulation: flood held to its socket rate");
+    Check(browser_admitted == browser_sent, "simulation: every browser request admitted");
+
+    AdmissionControl::Statistics statistics = admission_control.GetStatistics();
+    Check(statistics.admitted_count == flood_admitted + browser_admitted, "simulation: admitted count");
+    Check(statistics.socket_limited_count == flood_sent - flood_admitted, "simulation: the flood met its socket limit only");
+    Check(statistics.address_limited_count == 0 && statistics.global_limited_count == 0, "simulation: no shared budget ran out");
+}
+
+int main()
+{
+    CheckBucket();
+    CheckLimits();
+    CheckRejectionsTakeNothing();
+    CheckConnections();
+    CheckAddressEviction();
+    RunSimulation();
+
+    if (_failure_count > 0)
+    {
+        std::cerr << _failure_count << " checks failed\n";
+        return 1;
+    }
+    std::cout << "All checks passed\n";
+    return 0;
+}
\ No newline at end of file
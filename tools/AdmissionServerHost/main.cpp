@@ -0,0 +1,513 @@
+// Stand-in for the HTTP server of the device on the host, to measure what admission control does for
+// the other clients while one of them floods.
+//
+//   AdmissionServerHost [--port <port>] [--seconds <n>] [--service-us <n>] [--asset-service-us <n>]
+//                       [--reject-service-us <n>] [--no-admission]
+//
+// One thread serves every socket like the httpd task: it answers one request or websocket frame per
+// ready socket and round, /led, /wsled and the assets like the firmware, and is held for a fixed
+// service time per request (2000 us for a command, 1000 us for an asset and 200 us for a throttled
+// request by default). Admission runs first, with the budgets HttpServer starts with: a throttled
+// request gets the precomputed 429, a throttled websocket the close frame, and a connection over its
+// address budget is closed on accept.
+// The service times are a model of the device, not measurements of it. Compare runs with and without
+// --no-admission, the absolute figures do not predict the latency of the device.
+//
+// Drive it with LoadGenerator, the flooder from a second loopback address so the address buckets
+// tell it apart from the other clients:
+//   AdmissionServerHost --port 18080 --seconds 25 &
+//   LoadGenerator --port 18080 --http 2 --ws 1 --listeners 1 --rate 5 --duration 20 &
+//   LoadGenerator --port 18080 --source 127.0.0.2 --http 0 --ws 0 --listeners 0 --flood-http 2 --flood-ws 1 --duration 20
+// The admission statistics are printed when the server exits.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AdmissionControl.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+// The budgets HttpServer starts with
+static const AdmissionControl::Config _device_config = {{10, 20}, {20, 40}, {60, 120}};
+
+// Same bodies as the firmware sends
+static const char _too_many_requests_body[] = "{\"status\":429,\"error\":\"Too Many Requests\",\"message\":\"The request rate limit was exceeded\"}";
+static const uint8_t _rate_limited_close_payload[] = {0x03, 0xF0, 'r', 'a', 't', 'e', ' ', 'l', 'i', 'm', 'i', 't', 'e', 'd'};
+
+// Roughly the size of the gzipped index page
+static constexpr size_t _asset_size = 2048;
+
+struct Options
+{
+    uint16_t port = 18080;
+    int duration_s = 0;
+    int64_t service_us = 2000;
+    int64_t asset_service_us = 1000;
+    int64_t reject_service_us = 200;
+    bool is_admission_enabled = true;
+};
+
+static int64_t NowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+}
+
+/// @brief Hold the server for the service time, the httpd task serves no one else meanwhile either.
+/// It sleeps rather than spins: the device has its own CPU, here the clients share the host's.
+static void Serve(int64_t duration_us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(duration_us));
+}
+
+class Server
+{
+public:
+    Server(const Options& options)
+        : _options(options), _admission_control(_device_config)
+    {
+    }
+
+    ~Server()
+    {
+        for (std::pair<const int, Client>& client : _clients)
+        {
+            close(client.first);
+        }
+        if (_listen_socket >= 0)
+        {
+            close(_listen_socket);
+        }
+    }
+
+    bool Open()
+    {
+        _listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+        if (_listen_socket < 0)
+        {
+            return false;
+        }
+
+        int reuse = 1;
+        setsockopt(_listen_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        struct sockaddr_in bind_address = {};
+        bind_address.sin_family = AF_INET;
+        bind_address.sin_port = htons(_options.port);
+        bind_address.sin_addr.s_addr = htonl(INADDR_ANY);
+        return bind(_listen_socket, (struct sockaddr*)&bind_address, sizeof(bind_address)) == 0 && listen(_listen_socket, 16) == 0;
+    }
+
+    void Run()
+    {
+        int64_t end_time_us = _options.duration_s > 0 ? NowUs() + (int64_t)_options.duration_s * 1000000 : INT64_MAX;
+        while (NowUs() < end_time_us)
+        {
+            std::vector<struct pollfd> poll_fds = {{_listen_socket, POLLIN, 0}};
+            bool has_pending_message = false;
+            for (std::pair<const int, Client>& client : _clients)
+            {
+                poll_fds.push_back({client.first, POLLIN, 0});
+                has_pending_message = has_pending_message || HasCompleteMessage(client.second);
+            }
+
+            if (poll(poll_fds.data(), poll_fds.size(), has_pending_message ? 0 : 100) < 0)
+            {
+                break;
+            }
+
+            if (poll_fds[0].revents & POLLIN)
+            {
+                Accept();
+            }
+
+            for (size_t i = 1; i < poll_fds.size(); i++)
+            {
+                if ((poll_fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && !Receive(poll_fds[i].fd))
+                {
+                    CloseClient(poll_fds[i].fd);
+                }
+            }
+
+            // One message per socket and round, like httpd
+            std::vector<int> ready_sockets;
+            for (std::pair<const int, Client>& client : _clients)
+            {
+                if (HasCompleteMessage(client.second))
+                {
+                    ready_sockets.push_back(client.first);
+                }
+            }
+            for (int socket_file_descriptor : ready_sockets)
+            {
+                std::map<int, Client>::iterator client = _clients.find(socket_file_descriptor);
+                if (client != _clients.end() && !HandleMessage(client->second))
+                {
+                    CloseClient(socket_file_descriptor);
+                }
+            }
+        }
+    }
+
+    void PrintStatistics() const
+    {
+        AdmissionControl::Statistics statistics = _admission_control.GetStatistics();
+        std::cout << "admission " << (_options.is_admission_enabled ? "on" : "off")
+                  << ", service " << _options.service_us << " us, asset " << _options.asset_service_us
+                  << " us, throttled " << _options.reject_service_us << " us\n"
+                  << "  handled: " << _handled_count << ", throttled requests: " << _throttled_request_count
+                  << ", closed websockets: " << _throttled_websocket_count << "\n"
+                  << "  admitted: " << statistics.admitted_count << ", socket limited: " << statistics.socket_limited_count
+                  << ", address limited: " << statistics.address_limited_count << ", global limited: " << statistics.global_limited_count
+                  << ", refused connections: " << statistics.rejected_connection_count << "\n";
+    }
+
+private:
+    struct Client
+    {
+        int socket_file_descriptor;
+        bool is_websocket;
+        std::string buffer;
+    };
+
+    Options _options;
+    AdmissionControl _admission_control;
+    int _listen_socket = -1;
+    std::map<int, Client> _clients;
+    bool _is_on = false;
+    uint64_t _handled_count = 0;
+    uint64_t _throttled_request_count = 0;
+    uint64_t _throttled_websocket_count = 0;
+
+    void Accept()
+    {
+        struct sockaddr_in peer_address = {};
+        socklen_t peer_address_length = sizeof(peer_address);
+        int socket_file_descriptor = accept(_listen_socket, (struct sockaddr*)&peer_address, &peer_address_length);
+        if (socket_file_descriptor < 0)
+        {
+            return;
+        }
+
+        // httpd closes the socket when the open callback fails
+        if (_options.is_admission_enabled && !_admission_control.OnOpen(socket_file_descriptor, ntohl(peer_address.sin_addr.s_addr), NowUs()))
+        {
+            close(socket_file_descriptor);
+            return;
+        }
+
+        int no_delay = 1;
+        setsockopt(socket_file_descriptor, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        _clients[socket_file_descriptor] = {socket_file_descriptor, false, ""};
+    }
+
+    void CloseClient(int socket_file_descriptor)
+    {
+        if (_options.is_admission_enabled)
+        {
+            _admission_control.OnClose(socket_file_descriptor);
+        }
+        close(socket_file_descriptor);
+        _clients.erase(socket_file_descriptor);
+    }
+
+    /// @return False once the peer closed the connection
+    bool Receive(int socket_file_descriptor)
+    {
+        char data[4096];
+        ssize_t received_length = recv(socket_file_descriptor, data, sizeof(data), MSG_DONTWAIT);
+        if (received_length <= 0)
+        {
+            return received_length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+
+        _clients[socket_file_descriptor].buffer.append(data, received_length);
+        return true;
+    }
+
+    /// @return Length of the first message in the buffer, 0 if it is not complete yet
+    static size_t GetMessageLength(const Client& client)
+    {
+        const std::string& buffer = client.buffer;
+        if (client.is_websocket)
+        {
+            // Client frames are always masked
+            if (buffer.size() < 2)
+            {
+                return 0;
+            }
+            size_t payload_length = (uint8_t)buffer[1] & 0x7F;
+            size_t header_length = 2;
+            if (payload_length == 126)
+            {
+                if (buffer.size() < 4)
+                {
+                    return 0;
+                }
+                payload_length = ((size_t)(uint8_t)buffer[2] << 8) | (uint8_t)buffer[3];
+                header_length = 4;
+            }
+            size_t frame_length = header_length + 4 + payload_length;
+            return buffer.size() >= frame_length ? frame_length : 0;
+        }
+
+        size_t header_end = buffer.find("\r\n\r\n");
+        if (header_end == std::string::npos)
+        {
+            return 0;
+        }
+        size_t message_length = header_end + 4 + GetContentLength(buffer.substr(0, header_end));
+        return buffer.size() >= message_length ? message_length : 0;
+    }
+
+    static bool HasCompleteMessage(const Client& client)
+    {
+        return GetMessageLength(client) > 0;
+    }
+
+    static size_t GetContentLength(const std::string& header)
+    {
+        size_t position = header.find("Content-Length:");
+        if (position == std::string::npos)
+        {
+            return 0;
+        }
+        return strtoul(header.c_str() + position + strlen("Content-Length:"), nullptr, 10);
+    }
+
+    /// @return False to close the connection
+    bool HandleMessage(Client& client)
+    {
+        size_t message_length = GetMessageLength(client);
+        std::string message = client.buffer.substr(0, message_length);
+        client.buffer.erase(0, message_length);
+
+        return client.is_websocket ? HandleFrame(client.socket_file_descriptor, message) : HandleRequest(client, message);
+    }
+
+    bool IsAdmitted(int socket_file_descriptor)
+    {
+        return !_options.is_admission_enabled || _admission_control.Admit(socket_file_descriptor, NowUs()) == ADMISSION_RESULT_ADMITTED;
+    }
+
+    bool HandleRequest(Client& client, const std::string& request)
+    {
+        int socket_file_descriptor = client.socket_file_descriptor;
+        size_t method_end = request.find(' ');
+        size_t path_end = request.find(' ', method_end + 1);
+        std::string method = request.substr(0, method_end);
+        std::string path = request.substr(method_end + 1, path_end - method_end - 1);
+        std::string body = request.substr(request.find("\r\n\r\n") + 4);
+        bool is_upgrade = path == "/wsled" && request.find("Upgrade: websocket") != std::string::npos;
+
+        // httpd answers the handshake before the handler runs, a throttled handshake gets the close frame
+        if (is_upgrade)
+        {
+            std::string handshake = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: x\r\n\r\n";
+            Send(socket_file_descriptor, handshake);
+            client.is_websocket = true;
+            if (!IsAdmitted(socket_file_descriptor))
+            {
+                return CloseThrottledWebsocket(socket_file_descriptor);
+            }
+
+            Serve(_options.service_us);
+            _handled_count++;
+            Send(socket_file_descriptor, Frame(0x1, StateMessage(-1)));
+            return true;
+        }
+
+        if (!IsAdmitted(socket_file_descriptor))
+        {
+            _throttled_request_count++;
+            Serve(_options.reject_service_us);
+            SendResponse(socket_file_descriptor, "429 Too Many Requests", "Retry-After: 1\r\n", _too_many_requests_body);
+            return true;
+        }
+
+        _handled_count++;
+        if (method == "POST" && path == "/led")
+        {
+            Serve(_options.service_us);
+            SetState(body.find("\"on\"") != std::string::npos);
+            SendResponse(socket_file_descriptor, "200 OK", "", StateMessage(-1));
+            return true;
+        }
+
+        Serve(_options.asset_service_us);
+        SendResponse(socket_file_descriptor, "200 OK", "", std::string(_asset_size, 'x'));
+        return true;
+    }
+
+    bool HandleFrame(int socket_file_descriptor, const std::string& frame)
+    {
+        uint8_t opcode = (uint8_t)frame[0] & 0x0F;
+        if (opcode == 0x8)
+        {
+            return false;
+        }
+
+        if (!IsAdmitted(socket_file_descriptor))
+        {
+            return CloseThrottledWebsocket(socket_file_descriptor);
+        }
+
+        size_t header_length = ((uint8_t)frame[1] & 0x7F) == 126 ? 4 : 2;
+        std::string payload = frame.substr(header_length + 4);
+        for (size_t i = 0; i < payload.size(); i++)
+        {
+            payload[i] ^= frame[header_length + i % 4];
+        }
+        if (opcode != 0x1)
+        {
+            return true;
+        }
+
+        Serve(_options.service_us);
+        _handled_count++;
+        size_t id_position = payload.find("\"id\":");
+        int64_t id = id_position == std::string::npos ? -1 : strtoll(payload.c_str() + id_position + 5, nullptr, 10);
+        SetState(payload.find("\"on\"") != std::string::npos);
+        Send(socket_file_descriptor, Frame(0x1, StateMessage(id)));
+        return true;
+    }
+
+    bool CloseThrottledWebsocket(int socket_file_descriptor)
+    {
+        _throttled_websocket_count++;
+        Serve(_options.reject_service_us);
+        Send(socket_file_descriptor, Frame(0x8, std::string((const char*)_rate_limited_close_payload, sizeof(_rate_limited_close_payload))));
+        return false;
+    }
+
+    /// @brief Every state change reaches the websockets, from the same task as on the device
+    void SetState(bool is_on)
+    {
+        if (is_on == _is_on)
+        {
+            return;
+        }
+
+        _is_on = is_on;
+        std::string frame = Frame(0x1, StateMessage(-1));
+        for (std::pair<const int, Client>& client : _clients)
+        {
+            if (client.second.is_websocket)
+            {
+                Send(client.first, frame);
+            }
+        }
+    }
+
+    std::string StateMessage(int64_t id) const
+    {
+        std::string message = std::string("{\"status\":\"") + (_is_on ? "on" : "off") + "\"";
+        if (id >= 0)
+        {
+            message += ",\"id\":" + std::to_string(id);
+        }
+        return message + "}";
+    }
+
+    static std::string Frame(uint8_t opcode, const std::string& payload)
+    {
+        std::string frame(1, (char)(0x80 | opcode));
+        if (payload.size() < 126)
+        {
+            frame += (char)payload.size();
+        }
+        else
+        {
+            frame += (char)126;
+            frame += (char)(payload.size() >> 8);
+            frame += (char)(payload.size() & 0xFF);
+        }
+        return frame + payload;
+    }
+
+    static void SendResponse(int socket_file_descriptor, const char* status, const char* extra_headers, const std::string& body)
+    {
+        std::string response = std::string("HTTP/1.1 ") + status + "\r\nContent-Type: application/json\r\n" + extra_headers +
+                               "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+        Send(socket_file_descriptor, response);
+    }
+
+    static void Send(int socket_file_descriptor, const std::string& data)
+    {
+        size_t sent_length = 0;
+        while (sent_length < data.size())
+        {
+            ssize_t length = send(socket_file_descriptor, data.data() + sent_length, data.size() - sent_length, MSG_NOSIGNAL);
+            if (length <= 0)
+            {
+                return;
+            }
+            sent_length += length;
+        }
+    }
+};
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (argument == "--port" && has_value)
+        {
+            options.port = atoi(argv[++i]);
+        }
+        else if (argument == "--seconds" && has_value)
+        {
+            options.duration_s = std::max(atoi(argv[++i]), 0);
+        }
+        else if (argument == "--service-us" && has_value)
+        {
+            options.service_us = std::max(atoll(argv[++i]), 0LL);
+        }
+        else if (argument == "--asset-service-us" && has_value)
+        {
+            options.asset_service_us = std::max(atoll(argv[++i]), 0LL);
+        }
+        else if (argument == "--reject-service-us" && has_value)
+        {
+            options.reject_service_us = std::max(atoll(argv[++i]), 0LL);
+        }
+        else if (argument == "--no-admission")
+        {
+            options.is_admission_enabled = false;
+        }
+        else
+        {
+            std::cerr << "Usage: AdmissionServerHost [--port <port>] [--seconds <n>] [--service-us <n>] [--asset-service-us <n>]\n"
+                      << "                           [--reject-service-us <n>] [--no-admission]\n";
+            return 1;
+        }
+    }
+
+    Server server(options);
+    if (!server.Open())
+    {
+        std::cerr << "Cannot listen on port " << options.port << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+
+    server.Run();
+    server.PrintStatistics();
+    return 0;
+}
\ No newline at end of file
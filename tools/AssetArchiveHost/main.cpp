@@ -0,0 +1,255 @@
+// Checks the web asset archive format and the reader the firmware mounts the assets slots with.
+//
+//   AssetArchiveHost
+//
+// Format checks build archives with AssetArchiveBuilder and look files up the way the server does:
+// lookups with a query string, prefixes, missing and overlong paths, gzip flags, 4 byte alignment and
+// reproducible output. Corruption checks feed the reader what a failed or hostile upload leaves in
+// flash: erased and truncated slots, every single bit flip, a bad magic or version, and structurally
+// broken indexes with a valid checksum. None of them may open.
+// The exit code is non zero if any check fails.
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "AssetArchive.hpp"
+
+static int _failure_count = 0;
+
+static void Check(bool condition, const std::string& message)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << message << "\n";
+        _failure_count++;
+    }
+}
+
+static std::vector<uint8_t> Bytes(const std::string& text)
+{
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+static std::vector<uint8_t> BuildSample()
+{
+    AssetArchiveBuilder builder;
+    builder.AddFile("/style.css", "text/css", Bytes("body{margin:0}"), 0);
+    builder.AddFile("/index.html", "text/html", Bytes("<html><script src=\"/app.js\"></script></html>"), 0);
+    builder.AddFile("/app.js", "application/javascript", Bytes("\x1f\x8b gzip stream"), ASSET_ENTRY_FLAG_GZIP);
+    builder.AddFile("/empty.txt", "text/plain", {}, 0);
+    return builder.Build();
+}
+
+static AssetArchiveHeader& HeaderOf(std::vector<uint8_t>& archive)
+{
+    return *reinterpret_cast<AssetArchiveHeader*>(archive.data());
+}
+
+static AssetArchiveEntry* EntriesOf(std::vector<uint8_t>& archive)
+{
+    return reinterpret_cast<AssetArchiveEntry*>(archive.data() + sizeof(AssetArchiveHeader));
+}
+
+/// @brief Restore the checksum after a structural change, so only the structure checks can catch it
+static void UpdateChecksum(std::vector<uint8_t>& archive)
+{
+    HeaderOf(archive).data_crc32 = AssetArchive::Crc32(0, archive.data() + sizeof(AssetArchiveHeader), archive.size() - sizeof(AssetArchiveHeader));
+}
+
+static bool Opens(const std::vector<uint8_t>& archive, size_t available_size)
+{
+    AssetArchive reader;
+    std::string error_message;
+    bool is_open = reader.Open(archive.data(), available_size, error_message);
+    if (!is_open && error_message.empty())
+    {
+        Check(false, "a rejected archive comes with a reason");
+    }
+    return is_open;
+}
+
+static void CheckCrc()
+{
+    const char* check_input = "123456789";
+    Check(AssetArchive::Crc32(0, reinterpret_cast<const uint8_t*>(check_input), 9) == 0xCBF43926, "crc: IEEE check value");
+
+    // Chained calls equal one call over the concatenation
+    uint32_t crc = AssetArchive::Crc32(0, reinterpret_cast<const uint8_t*>(check_input), 4);
+    Check(AssetArchive::Crc32(crc, reinterpret_cast<const uint8_t*>(check_input) + 4, 5) == 0xCBF43926, "crc: incremental");
+}
+
+static void CheckFormat()
+{
+    std::vector<uint8_t> archive = BuildSample();
+    const AssetArchiveHeader& header = HeaderOf(archive);
+    Check(header.magic == ASSET_ARCHIVE_MAGIC && header.version == ASSET_ARCHIVE_VERSION, "format: header");
+    Check(header.entry_count == 4 && header.total_size == archive.size(), "format: sizes");
+
+    const AssetArchiveEntry* entries = EntriesOf(archive);
+    for (uint16_t i = 0; i < header.entry_count; i++)
+    {
+        Check(entries[i].offset % 4 == 0, "format: data is 4 byte aligned");
+        Check(i == 0 || strcmp(entries[i - 1].path, entries[i].path) < 0, "format: the index is sorted");
+    }
+
+    AssetArchive reader;
+    std::string error_message;
+    Check(reader.Open(archive.data(), archive.size(), error_message), "format: opens: " + error_message);
+
+    const AssetArchiveEntry* index = reader.Find("/index.html");
+    Check(index && strcmp(index->content_type, "text/html") == 0 && !(index->flags & ASSET_ENTRY_FLAG_GZIP), "format: find /index.html");
+    Check(index && std::string((const char*)reader.GetData(*index), index->length) == "<html><script src=\"/app.js\"></script></html>", "format: data of /index.html");
+
+    const AssetArchiveEntry* script = reader.Find("/app.js?v=3");
+    Check(script && (script->flags & ASSET_ENTRY_FLAG_GZIP), "format: query string ignored, gzip flag kept");
+    Check(reader.Find("/app.js#top") == script, "format: fragment ignored");
+
+    const AssetArchiveEntry* empty = reader.Find("/empty.txt");
+    Check(empty && empty->length == 0, "format: empty file");
+
+    Check(!reader.Find("/index"), "format: a prefix is not a match");
+    Check(!reader.Find("/index.html.bak"), "format: a longer path is not a match");
+    Check(!reader.Find("/missing.png"), "format: missing file");
+    Check(!reader.Find(std::string(200, 'a').c_str()), "format: overlong path");
+    Check(!reader.Find(nullptr), "format: null path");
+
+    // The partition is larger than the archive, the rest of it is erased flash
+    std::vector<uint8_t> partition = archive;
+    partition.resize(0x38000, 0xFF);
+    Check(Opens(partition, partition.size()), "format: opens inside a larger partition");
+
+    // The insertion order does not change the bytes
+    AssetArchiveBuilder builder;
+    builder.AddFile("/empty.txt", "text/plain", {}, 0);
+    builder.AddFile("/app.js", "application/javascript", Bytes("\x1f\x8b gzip stream"), ASSET_ENTRY_FLAG_GZIP);
+    builder.AddFile("/index.html", "text/html", Bytes("<html><script src=\"/app.js\"></script></html>"), 0);
+    builder.AddFile("/style.css", "text/css", Bytes("body{margin:0}"), 0);
+    Check(builder.Build() == archive, "format: reproducible");
+
+    AssetArchive empty_reader;
+    std::vector<uint8_t> empty_archive = AssetArchiveBuilder().Build();
+    Check(empty_reader.Open(empty_archive.data(), empty_archive.size(), error_message), "format: an archive without files opens");
+    Check(empty_reader.GetEntryCount() == 0 && !empty_reader.Find("/index.html"), "format: nothing to find");
+}
+
+static void CheckBuilderLimits()
+{
+    AssetArchiveBuilder builder;
+    Check(builder.AddFile("/a", "text/plain", {}, 0), "builder: plain file");
+    Check(!builder.AddFile("/a", "text/html", {}, 0), "builder: duplicate path");
+    Check(!builder.AddFile("", "text/plain", {}, 0), "builder: empty path");
+    Check(builder.AddFile("/" + std::string(sizeof(AssetArchiveEntry::path) - 2, 'p'), "text/plain", {}, 0), "builder: longest path");
+    Check(!builder.AddFile("/" + std::string(sizeof(AssetArchiveEntry::path) - 1, 'q'), "text/plain", {}, 0), "builder: path too long");
+    Check(!builder.AddFile("/b", std::string(sizeof(AssetArchiveEntry::content_type), 't'), {}, 0), "builder: content type too long");
+}
+
+static void CheckCorruption()
+{
+    const std::vector<uint8_t> archive = BuildSample();
+    Check(Opens(archive, archive.size()), "corruption: the sample opens");
+
+    Check(!Opens(std::vector<uint8_t>(archive.size(), 0xFF), archive.size()), "corruption: erased slot");
+    Check(!Opens(std::vector<uint8_t>(archive.size(), 0x00), archive.size()), "corruption: zeroed slot");
+    Check(!Opens(archive, sizeof(AssetArchiveHeader) - 1), "corruption: smaller than the header");
+
+    // An upload cut short: fewer bytes than the header promises, or the tail still erased
+    for (size_t length = 0; length < archive.size(); length++)
+    {
+        Check(!Opens(archive, length), "corruption: truncated to " + std::to_string(length) + " bytes");
+
+        std::vector<uint8_t> partial = archive;
+        std::fill(partial.begin() + length, partial.end(), 0xFF);
+        if (length >= sizeof(AssetArchiveHeader))
+        {
+            Check(!Opens(partial, partial.size()), "corruption: erased after " + std::to_string(length) + " bytes");
+        }
+    }
+
+    // Every single bit error after the header is caught by the checksum or the index checks
+    for (size_t bit = sizeof(AssetArchiveHeader) * 8; bit < archive.size() * 8; bit++)
+    {
+        std::vector<uint8_t> flipped = archive;
+        flipped[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+        Check(!Opens(flipped, flipped.size()), "corruption: bit " + std::to_string(bit) + " flipped");
+    }
+
+    std::vector<uint8_t> corrupted = archive;
+    HeaderOf(corrupted).magic ^= 1;
+    Check(!Opens(corrupted, corrupted.size()), "corruption: magic");
+
+    corrupted = archive;
+    HeaderOf(corrupted).version = ASSET_ARCHIVE_VERSION + 1;
+    Check(!Opens(corrupted, corrupted.size()), "corruption: version");
+
+    corrupted = archive;
+    HeaderOf(corrupted).data_crc32 ^= 0x80000000;
+    Check(!Opens(corrupted, corrupted.size()), "corruption: checksum field");
+
+    corrupted = archive;
+    HeaderOf(corrupted).entry_count = UINT16_MAX;
+    Check(!Opens(corrupted, corrupted.size()), "corruption: index larger than the archive");
+
+    corrupted = archive;
+    HeaderOf(corrupted).total_size = archive.size() + 4;
+    Check(!Opens(corrupted, corrupted.size()), "corruption: total size beyond the slot");
+
+    // Structurally broken indexes that carry a matching checksum, as a hostile upload would
+    corrupted = archive;
+    memset(EntriesOf(corrupted)[1].path, 'x', sizeof(AssetArchiveEntry::path));
+    UpdateChecksum(corrupted);
+    Check(!Opens(corrupted, corrupted.size()), "corruption: unterminated path");
+
+    corrupted = archive;
+    memset(EntriesOf(corrupted)[0].content_type, 'x', sizeof(AssetArchiveEntry::content_type));
+    UpdateChecksum(corrupted);
+    Check(!Opens(corrupted, corrupted.size()), "corruption: unterminated content type");
+
+    corrupted = archive;
+    EntriesOf(corrupted)[2].offset = sizeof(AssetArchiveHeader);
+    UpdateChecksum(corrupted);
+    Check(!Opens(corrupted, corrupted.size()), "corruption: data inside the index");
+
+    corrupted = archive;
+    EntriesOf(corrupted)[2].offset = archive.size() + 4;
+    UpdateChecksum(corrupted);
+    Check(!Opens(corrupted, corrupted.size()), "corruption: data beyond the archive");
+
+    corrupted = archive;
+    EntriesOf(corrupted)[3].length = UINT32_MAX - 2;
+    UpdateChecksum(corrupted);
+    Check(!Opens(corrupted, corrupted.size()), "corruption: length wrapping around");
+
+    corrupted = archive;
+    std::swap(EntriesOf(corrupted)[0], EntriesOf(corrupted)[1]);
+    UpdateChecksum(corrupted);
+    Check(!Opens(corrupted, corrupted.size()), "corruption: unsorted index");
+
+    corrupted = archive;
+    EntriesOf(corrupted)[1] = EntriesOf(corrupted)[0];
+    UpdateChecksum(corrupted);
+    Check(!Opens(corrupted, corrupted.size()), "corruption: duplicate path");
+
+    // A failed open leaves nothing mounted, even after a good archive
+    AssetArchive reader;
+    std::string error_message;
+    reader.Open(archive.data(), archive.size(), error_message);
+    Check(!reader.Open(corrupted.data(), corrupted.size(), error_message), "corruption: reopen rejected");
+    Check(!reader.IsOpen() && !reader.Find("/index.html") && reader.GetEntryCount() == 0, "corruption: closed after a rejected open");
+}
+
+int main()
+{
+    CheckCrc();
+    CheckFormat();
+    CheckBuilderLimits();
+    CheckCorruption();
+
+    if (_failure_count > 0)
+    {
+        std::cerr << _failure_count << " checks failed\n";
+        return 1;
+    }
+    std::cout << "All checks passed\n";
+    return 0;
+}
\ No newline at end of file
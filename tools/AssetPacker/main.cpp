@@ -0,0 +1,196 @@
+// Packs a directory of web assets into the archive served from the "assets_a" and "assets_b" partitions.
+//
+//   AssetPacker components/HttpServer/WebPage assets.bin
+//   AssetPacker --list assets.bin
+//
+// Files are stored under their path relative to the input directory ("/index.html").
+// A file ending in .gz is stored without the suffix and flagged so it is served with
+// Content-Encoding: gzip. Every archive written is reopened with the firmware reader to verify it.
+//
+// Upload the result to a running device without reflashing the firmware, with the token provisioned
+// in its "web_assets" NVS namespace:
+//   curl -X PUT -H "Authorization: Bearer <token>" -H "Content-Type: application/octet-stream"
+//        --data-binary @assets.bin http://baobao.local/assets
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+#include "AssetArchive.hpp"
+
+namespace fs = std::filesystem;
+
+static std::string GetContentType(const std::string& extension)
+{
+    static const std::map<std::string, std::string> content_types = {
+        {".html", "text/html"},
+        {".htm", "text/html"},
+        {".js", "application/javascript"},
+        {".mjs", "application/javascript"},
+        {".css", "text/css"},
+        {".json", "application/json"},
+        {".svg", "image/svg+xml"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".ico", "image/x-icon"},
+        {".txt", "text/plain"}
+    };
+
+    std::map<std::string, std::string>::const_iterator found_type = content_types.find(extension);
+    return found_type != content_types.end() ? found_type->second : "application/octet-stream";
+}
+
+static bool ReadFile(const fs::path& path, std::vector<uint8_t>& output_data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    output_data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static int ListArchive(const std::string& archive_path)
+{
+    std::vector<uint8_t> data;
+    if (!ReadFile(archive_path, data))
+    {
+        std::cerr << "Cannot read " << archive_path << "\n";
+        return 1;
+    }
+
+    AssetArchive archive;
+    std::string error_message;
+    if (!archive.Open(data.data(), data.size(), error_message))
+    {
+        std::cerr << archive_path << ": " << error_message << "\n";
+        return 1;
+    }
+
+    for (uint16_t i = 0; i < archive.GetEntryCount(); i++)
+    {
+        const AssetArchiveEntry& entry = archive.GetEntries()[i];
+        std::cout << entry.path << "\t" << entry.content_type << "\t" << entry.length << " bytes"
+                  << ((entry.flags & ASSET_ENTRY_FLAG_GZIP) ? "\tgzip" : "") << "\n";
+    }
+    std::cout << archive.GetEntryCount() << " files, " << archive.GetTotalSize() << " bytes\n";
+    return 0;
+}
+
+static int PackDirectory(const std::string& input_directory, const std::string& archive_path, size_t max_size)
+{
+    if (!fs::is_directory(input_directory))
+    {
+        std::cerr << input_directory << " is not a directory\n";
+        return 1;
+    }
+
+    // Sorted so the same input always produces the same archive
+    std::vector<fs::path> files;
+    for (const fs::directory_entry& entry : fs::recursive_directory_iterator(input_directory))
+    {
+        if (entry.is_regular_file())
+        {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    AssetArchiveBuilder builder;
+    size_t file_count = 0;
+    for (const fs::path& file : files)
+    {
+        std::string relative_path = "/" + fs::relative(file, input_directory).generic_string();
+        if (relative_path.find("/node_modules/") != std::string::npos || file.filename().string().rfind("package", 0) == 0)
+        {
+            continue;
+        }
+
+        uint32_t flags = 0;
+        fs::path served_path = relative_path;
+        if (served_path.extension() == ".gz")
+        {
+            flags |= ASSET_ENTRY_FLAG_GZIP;
+            served_path.replace_extension();
+        }
+
+        std::vector<uint8_t> data;
+        if (!ReadFile(file, data))
+        {
+            std::cerr << "Cannot read " << file << "\n";
+            return 1;
+        }
+
+        std::string content_type = GetContentType(served_path.extension().string());
+        if (!builder.AddFile(served_path.generic_string(), content_type, data, flags))
+        {
+            std::cerr << "Cannot add " << served_path.generic_string() << ": the path is a duplicate or longer than "
+                      << sizeof(AssetArchiveEntry::path) - 1 << " characters\n";
+            return 1;
+        }
+        file_count++;
+    }
+
+    if (file_count > UINT16_MAX)
+    {
+        std::cerr << "Too many files\n";
+        return 1;
+    }
+
+    std::vector<uint8_t> archive_data = builder.Build();
+    if (max_size > 0 && archive_data.size() > max_size)
+    {
+        std::cerr << "The archive is " << archive_data.size() << " bytes, the partition holds " << max_size << "\n";
+        return 1;
+    }
+
+    AssetArchive archive;
+    std::string error_message;
+    if (!archive.Open(archive_data.data(), archive_data.size(), error_message))
+    {
+        std::cerr << "The built archive does not verify: " << error_message << "\n";
+        return 1;
+    }
+
+    std::ofstream output_file(archive_path, std::ios::binary);
+    output_file.write(reinterpret_cast<const char*>(archive_data.data()), archive_data.size());
+    if (!output_file)
+    {
+        std::cerr << "Cannot write " << archive_path << "\n";
+        return 1;
+    }
+
+    std::cout << "Packed " << file_count << " files into " << archive_path << " (" << archive_data.size() << " bytes)\n";
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 3 && strcmp(argv[1], "--list") == 0)
+    {
+        return ListArchive(argv[2]);
+    }
+
+    // Matches one assets slot in partitions.csv
+    size_t max_size = 0x38000;
+    if (argc == 5 && strcmp(argv[3], "--max-size") == 0)
+    {
+        max_size = strtoul(argv[4], nullptr, 0);
+    }
+    else if (argc != 3)
+    {
+        std::cerr << "Usage: AssetPacker <input directory> <output archive> [--max-size <bytes>]\n"
+                     "       AssetPacker --list <archive>\n";
+        return 1;
+    }
+
+    return PackDirectory(argv[1], argv[2], max_size);
+}
\ No newline at end of file
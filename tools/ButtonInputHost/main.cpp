@@ -0,0 +1,227 @@
+// Replays button edge sequences through the firmware debouncer on a simulated clock.
+//
+//   ButtonInputHost                                  run the built in scenarios and check them
+//   ButtonInputHost --sequence 0:0,0.4:1,0.9:0,250:1 [--settle-ms 30] [--trailing]
+//
+// A sequence lists "time_ms:level" pin transitions of an active low button that starts released.
+// Every transition is delivered like the interrupt would, through a FIFO with a fixed interrupt to
+// task delay, and each edge re-arms a one shot settle timer exactly as ButtonInput does on the device.
+// The latency printed is from the first edge of a burst to the moment the event is issued.
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ButtonDebouncer.hpp"
+
+// Assumed interrupt to task wake up delay, the device reports its real latency at /buttons
+static const int64_t _isr_to_task_delay_us = 40;
+
+struct Transition
+{
+    int64_t time_us;
+    int level;
+};
+
+struct ButtonEvent
+{
+    uint8_t event;
+    int64_t time_us;
+    int64_t latency_us;
+};
+
+static int LevelAt(const std::vector<Transition>& transitions, int64_t time_us)
+{
+    int level = 1;
+    for (const Transition& transition : transitions)
+    {
+        if (transition.time_us > time_us)
+        {
+            break;
+        }
+        level = transition.level;
+    }
+    return level;
+}
+
+static std::vector<ButtonEvent> Replay(const std::vector<Transition>& transitions, uint32_t settle_time_us, bool is_leading_edge)
+{
+    ButtonDebouncer debouncer(settle_time_us, is_leading_edge, true, 1);
+    std::vector<ButtonEvent> events;
+
+    size_t next_transition = 0;
+    int64_t settle_deadline_us = -1;
+    while (next_transition < transitions.size() || settle_deadline_us >= 0)
+    {
+        int64_t edge_time_us = next_transition < transitions.size() ? transitions[next_transition].time_us + _isr_to_task_delay_us : INT64_MAX;
+        if (settle_deadline_us >= 0 && settle_deadline_us < edge_time_us)
+        {
+            int64_t now_us = settle_deadline_us;
+            settle_deadline_us = -1;
+            uint8_t event = debouncer.OnSettled(LevelAt(transitions, now_us), now_us);
+            if (event != BUTTON_EVENT_NONE)
+            {
+                events.push_back({event, now_us, now_us - debouncer.GetBurstStartTime()});
+            }
+            continue;
+        }
+
+        // The interrupt timestamp is taken at the transition, the task sees it a little later
+        int64_t interrupt_time_us = transitions[next_transition].time_us;
+        next_transition++;
+        settle_deadline_us = edge_time_us + settle_time_us;
+
+        uint8_t event = debouncer.OnEdge(interrupt_time_us);
+        if (event != BUTTON_EVENT_NONE)
+        {
+            events.push_back({event, edge_time_us, edge_time_us - interrupt_time_us});
+        }
+    }
+
+    return events;
+}
+
+static std::string FormatEvents(const std::vector<ButtonEvent>& events)
+{
+    std::ostringstream output;
+    for (const ButtonEvent& event : events)
+    {
+        output << (event.event == BUTTON_EVENT_PRESSED ? "P" : "R");
+    }
+    return output.str();
+}
+
+static void PrintEvents(const std::vector<ButtonEvent>& events)
+{
+    for (const ButtonEvent& event : events)
+    {
+        std::cout << "    " << std::setw(9) << std::fixed << std::setprecision(2) << event.time_us / 1000.0 << " ms  "
+                  << (event.event == BUTTON_EVENT_PRESSED ? "pressed " : "released") << "  latency "
+                  << event.latency_us << " us\n";
+    }
+}
+
+static bool ParseSequence(const std::string& sequence, std::vector<Transition>& output_transitions)
+{
+    std::istringstream sequence_stream(sequence);
+    std::string entry;
+    while (std::getline(sequence_stream, entry, ','))
+    {
+        size_t separator = entry.find(':');
+        if (separator == std::string::npos)
+        {
+            return false;
+        }
+
+        Transition transition = {(int64_t)(atof(entry.c_str()) * 1000), atoi(entry.c_str() + separator + 1) ? 1 : 0};
+        if (!output_transitions.empty() && transition.time_us <= output_transitions.back().time_us)
+        {
+            return false;
+        }
+        output_transitions.push_back(transition);
+    }
+    return !output_transitions.empty();
+}
+
+struct Scenario
+{
+    const char* name;
+    std::vector<Transition> transitions;
+    // Expected events as a string of P and R
+    const char* leading_edge_events;
+    const char* trailing_edge_events;
+};
+
+static int RunScenarios(uint32_t settle_time_us)
+{
+    // Contact bounce of a typical wall switch: a few transitions over the first 5 ms
+    std::vector<Scenario> scenarios = {
+        {"clean press", {{0, 0}, {300000, 1}}, "PR", "PR"},
+        {"bouncing press", {{0, 0}, {300, 1}, {800, 0}, {1500, 1}, {2900, 0}, {250000, 1}, {250400, 0}, {251200, 1}}, "PR", "PR"},
+        {"double press", {{0, 0}, {120000, 1}, {240000, 0}, {360000, 1}}, "PRPR", "PRPR"},
+        {"short tap", {{0, 0}, {15000, 1}}, "PR", ""},
+        {"glitch", {{0, 0}, {200, 1}}, "PR", ""},
+        {"held", {{0, 0}, {400, 1}, {900, 0}}, "P", "P"}
+    };
+
+    int failure_count = 0;
+    for (int mode = 0; mode < 2; mode++)
+    {
+        bool is_leading_edge = mode == 0;
+        int64_t max_press_latency_us = 0;
+        std::cout << (is_leading_edge ? "Leading" : "Trailing") << " edge, settle time " << settle_time_us / 1000 << " ms\n";
+
+        for (const Scenario& scenario : scenarios)
+        {
+            std::vector<ButtonEvent> events = Replay(scenario.transitions, settle_time_us, is_leading_edge);
+            std::string expected_events = is_leading_edge ? scenario.leading_edge_events : scenario.trailing_edge_events;
+            bool is_passed = FormatEvents(events) == expected_events;
+            failure_count += is_passed ? 0 : 1;
+
+            std::cout << "  " << (is_passed ? "ok    " : "FAILED") << " " << scenario.name
+                      << " (expected \"" << expected_events << "\", got \"" << FormatEvents(events) << "\")\n";
+            PrintEvents(events);
+
+            for (const ButtonEvent& event : events)
+            {
+                if (event.event == BUTTON_EVENT_PRESSED && event.latency_us > max_press_latency_us)
+                {
+                    max_press_latency_us = event.latency_us;
+                }
+            }
+        }
+        std::cout << "  worst press latency " << max_press_latency_us << " us\n\n";
+    }
+
+    if (failure_count > 0)
+    {
+        std::cerr << failure_count << " scenarios failed\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<Transition> transitions;
+    uint32_t settle_time_us = 30000;
+    bool is_leading_edge = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if (argument == "--sequence" && has_value)
+        {
+            if (!ParseSequence(argv[++i], transitions))
+            {
+                std::cerr << "Invalid sequence, expected increasing time_ms:level pairs\n";
+                return 1;
+            }
+        }
+        else if (argument == "--settle-ms" && has_value)
+        {
+            settle_time_us = atoi(argv[++i]) * 1000;
+        }
+        else if (argument == "--trailing")
+        {
+            is_leading_edge = false;
+        }
+        else
+        {
+            std::cerr << "Usage: ButtonInputHost [--sequence <time_ms:level,...>] [--settle-ms <ms>] [--trailing]\n";
+            return 1;
+        }
+    }
+
+    if (transitions.empty())
+    {
+        return RunScenarios(settle_time_us);
+    }
+
+    PrintEvents(Replay(transitions, settle_time_us, is_leading_edge));
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,777 @@
+// Runs several group sync members on one host over loopback multicast and measures skew and loss.
+//
+//   GroupSyncHost [--members <n>] [--seconds <n>] [--loss <percent>] [--port <port>] [--max-skew-us <n>]
+//
+// Unit checks cover the leader election, the offset filter, the duplicate filter across a reboot, the
+// bounded sender table under a flood of sender ids and the order of the apply queue. Then <n> members (4 by default) run for <n> seconds (20
+// by default), each in its own thread with its own socket joined to the group on the loopback
+// interface, exchanging the firmware's packets. Every member runs its clock with a random offset of
+// up to 2 s and a drift of up to 100 ppm either way, and drops received packets with the given
+// probability (10 % by default). A random member sends a command every 250 ms, repeated like the
+// firmware does, the leader stops halfway through and the last member reboots at three quarters.
+//
+// The skew of a command is the spread, in host time, of the local deadlines of the members that
+// received it. The timer latency of the device is not part of it, /group reports that as lateness.
+// Checks: the skew stays below --max-skew-us (2000 by default) once the members follow a leader,
+// the lost count of every member matches the commands it really missed, no command is applied twice,
+// the commands sent after the reboot are applied and the remaining members agree on the new leader.
+// The exit code is non zero if any check fails.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "GroupClock.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+// Shorter than on the device so a run takes seconds, the protocol only scales with it
+static constexpr int64_t _beacon_interval_us = 100000;
+static constexpr int64_t _lead_time_us = 150000;
+static constexpr int _command_repeat_count = 3;
+static constexpr uint16_t _group_id = 7;
+static constexpr const char* _multicast_address = "239.255.42.99";
+
+static int _failure_count = 0;
+
+static void Check(bool condition, const std::string& message)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << message << "\n";
+        _failure_count++;
+    }
+}
+
+static void CheckLeaderElection()
+{
+    GroupClock clock(300);
+    clock.Reset(50);
+    Check(clock.IsLeader(0), "election: alone we lead");
+
+    Check(!clock.OnBeacon(80, 1000, 100), "election: a higher id does not take over");
+    Check(clock.IsLeader(100), "election: still leading after a higher id");
+
+    Check(clock.OnBeacon(20, 1000, 100), "election: a lower id takes over");
+    Check(clock.GetLeaderId() == 20 && !clock.IsLeader(100), "election: following the lower id");
+    Check(clock.GetOffsetUs() == 900, "election: the offset follows the leader");
+
+    Check(!clock.OnBeacon(30, 5000, 200), "election: a live leader keeps the lead against a higher id");
+    Check(clock.GetOffsetUs() == 900, "election: other members do not move the offset");
+
+    Check(clock.IsLeader(1000), "election: a silent leader is dropped");
+    Check(clock.GetLeaderId() == 50 && clock.GetOffsetUs() == 900, "election: the group time carries on");
+
+    Check(clock.OnBeacon(30, 3000, 1100), "election: the next lower id takes over");
+    clock.Reset(50);
+    Check(clock.IsLeader(1100) && clock.GetOffsetUs() == 0, "election: reset");
+}
+
+static void CheckOffsetFilter()
+{
+    GroupClock clock(1000000);
+    clock.Reset(50);
+
+    // The leader runs 5 ms ahead, the transit delay only ever lowers a sample
+    const int64_t delays_us[] = {400, 100, 900, 250, 700, 300, 800, 350, 300, 500, 600, 300, 450, 300, 900, 400};
+    int64_t receive_time_us = 0;
+    for (size_t i = 0; i < sizeof(delays_us) / sizeof(delays_us[0]); i++)
+    {
+        receive_time_us += 100000;
+        clock.OnBeacon(10, receive_time_us + 5000 - delays_us[i], receive_time_us);
+        if (i == 7)
+        {
+            Check(clock.GetOffsetUs() == 5000 - 100, "offset: the fastest beacon wins");
+        }
+    }
+    Check(clock.GetOffsetUs() == 5000 - 300, "offset: old samples age out");
+}
+
+static void CheckSequenceTracker()
+{
+    SequenceTracker sequences;
+    uint32_t lost_count = 0;
+    Check(sequences.Track(1, 1, 10, 0, lost_count) && lost_count == 0, "sequence: first command");
+    Check(!sequences.Track(1, 1, 10, 1, lost_count), "sequence: repeated copy");
+    Check(!sequences.Track(1, 1, 9, 2, lost_count), "sequence: older command");
+    Check(sequences.Track(1, 1, 13, 3, lost_count) && lost_count == 2, "sequence: gap counted as lost");
+    Check(sequences.Track(2, 1, 0xFFFFFFFF, 4, lost_count), "sequence: second sender");
+    Check(sequences.Track(2, 1, 1, 5, lost_count) && lost_count == 1, "sequence: wrap around");
+    Check(sequences.GetSenderCount() == 2, "sequence: one entry per sender");
+    sequences.Clear();
+    Check(sequences.GetSenderCount() == 0 && sequences.Track(1, 1, 13, 6, lost_count), "sequence: clear");
+}
+
+static void CheckReboot()
+{
+    SequenceTracker sequences;
+    uint32_t lost_count = 0;
+    sequences.Track(1, 100, 40, 0, lost_count);
+
+    // After a reboot the sender counts from 1 again, below the sequence remembered from before
+    Check(sequences.Track(1, 200, 1, 1, lost_count) && lost_count == 0, "reboot: first command after the reboot");
+    Check(!sequences.Track(1, 200, 1, 2, lost_count), "reboot: its repeated copy is dropped");
+    Check(sequences.Track(1, 200, 3, 3, lost_count) && lost_count == 1, "reboot: gaps are counted from the new sequence");
+    Check(sequences.GetSenderCount() == 1 && sequences.GetEvictionCount() == 0, "reboot: the entry is reused");
+}
+
+static void CheckSenderFlood()
+{
+    SequenceTracker sequences;
+    uint32_t lost_count = 0;
+    sequences.Track(7, 1, 100, 0, lost_count);
+
+    // Any host on the LAN can send with a new id every packet
+    const uint32_t flood_count = 10000;
+    for (uint32_t i = 0; i < flood_count; i++)
+    {
+        sequences.Track(0x10000 + i, 1, 1, 1 + i, lost_count);
+        Check(sequences.GetSenderCount() <= GROUP_SYNC_MAX_SENDERS, "flood: the table is bounded");
+    }
+    Check(sequences.GetEvictionCount() == flood_count + 1 - GROUP_SYNC_MAX_SENDERS, "flood: every extra sender evicts one");
+
+    // The member forgotten first starts over, and the copies of its command are still dropped
+    Check(sequences.Track(7, 1, 101, flood_count + 1, lost_count) && lost_count == 0, "flood: forgotten sender accepted again");
+    Check(!sequences.Track(7, 1, 101, flood_count + 2, lost_count), "flood: its repeated copy is dropped");
+
+    // A member heard recently outlives senders that went quiet
+    for (uint32_t i = 0; i < GROUP_SYNC_MAX_SENDERS - 2; i++)
+    {
+        sequences.Track(0x20000 + i, 1, 1, flood_count + 3 + i, lost_count);
+    }
+    Check(!sequences.Track(7, 1, 101, flood_count + 100, lost_count), "flood: the active sender is remembered");
+}
+
+static void CheckApplyQueue()
+{
+    ApplyQueue queue;
+    PendingApply apply = {};
+    Check(!queue.Peek(apply), "apply: empty");
+
+    // Commands of several senders arrive out of deadline order
+    Check(queue.Push({300, 300, 1}) && queue.Push({100, 100, 0}) && queue.Push({200, 200, 1}), "apply: queued");
+    Check(queue.Push({200, 200, 0}), "apply: same deadline queued");
+    const int64_t expected_deadlines_us[] = {100, 200, 200, 300};
+    const uint8_t expected_states[] = {0, 1, 0, 1};
+    for (size_t i = 0; i < 4; i++)
+    {
+        Check(queue.Peek(apply) && apply.group_deadline_us == expected_deadlines_us[i] && apply.state == expected_states[i], "apply: deadline order");
+        queue.Pop();
+    }
+    Check(queue.GetCount() == 0, "apply: drained");
+
+    // Arriving after a later command was applied, it would undo it
+    Check(!queue.Push({250, 250, 0}), "apply: older than the last applied");
+    Check(queue.Push({300, 300, 0}), "apply: same deadline as the last applied");
+    queue.ForgetLastApplied();
+    Check(queue.Push({50, 50, 0}), "apply: accepted once the group time jumped");
+    queue.Clear();
+
+    // A full queue drops the earliest command, the final state is kept
+    for (int64_t i = 0; i < GROUP_SYNC_MAX_PENDING_APPLIES; i++)
+    {
+        queue.Push({1000 + i * 10, 1000 + i * 10, 0});
+    }
+    Check(!queue.Push({990, 990, 1}), "apply: full, an earlier command is dropped");
+    Check(queue.Push({1005, 1005, 1}), "apply: full, the earliest makes room");
+    Check(queue.GetCount() == GROUP_SYNC_MAX_PENDING_APPLIES && queue.Peek(apply) && apply.group_deadline_us == 1005, "apply: full, earliest dropped");
+    Check(queue.Push({5000, 5000, 1}), "apply: full, the latest makes room too");
+    while (queue.GetCount() > 1)
+    {
+        queue.Pop();
+    }
+    Check(queue.Peek(apply) && apply.group_deadline_us == 5000 && apply.state == 1, "apply: the latest command is applied last");
+    Check(queue.GetDroppedCount() == 4, "apply: dropped count");
+}
+
+static int64_t HostTimeUs()
+{
+    static const Clock::time_point start_time = Clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_time).count();
+}
+
+// A command is identified by its sender, the boot it was sent in and its sequence
+typedef std::tuple<uint32_t, uint16_t, uint32_t> CommandId;
+
+struct ApplyRecord
+{
+    CommandId command;
+    size_t member_index;
+    // Boot of the receiving member, its lost counts start over when it reboots
+    uint16_t member_boot_id;
+    int64_t host_apply_time_us;
+};
+
+struct SentCommand
+{
+    CommandId command;
+    int64_t host_send_time_us;
+};
+
+class ResultLog
+{
+public:
+    void AddApply(const ApplyRecord& record)
+    {
+        std::lock_guard<std::mutex> lock(_logMutex);
+        _applies.push_back(record);
+    }
+
+    void AddSent(const SentCommand& command)
+    {
+        std::lock_guard<std::mutex> lock(_logMutex);
+        _sent_commands.push_back(command);
+    }
+
+    std::vector<ApplyRecord> GetApplies()
+    {
+        std::lock_guard<std::mutex> lock(_logMutex);
+        return _applies;
+    }
+
+    std::vector<SentCommand> GetSentCommands()
+    {
+        std::lock_guard<std::mutex> lock(_logMutex);
+        return _sent_commands;
+    }
+
+private:
+    std::mutex _logMutex;
+    std::vector<ApplyRecord> _applies;
+    std::vector<SentCommand> _sent_commands;
+};
+
+/// @brief One member: the receive loop of GroupSync on a skewed clock and a lossy socket
+class Member
+{
+public:
+    Member(size_t index, uint32_t id, uint16_t port, double loss, uint32_t seed, ResultLog& log)
+        : _index(index), _id(id), _port(port), _loss(loss), _random(seed), _log(log), _clock(3 * _beacon_interval_us)
+    {
+        // Like esp_timer the local clock never runs below zero
+        std::uniform_int_distribution<int64_t> offset_distribution(0, 2000000);
+        std::uniform_real_distribution<double> drift_distribution(-100, 100);
+        _clock_offset_us = offset_distribution(_random);
+        _drift_ppm = drift_distribution(_random);
+        _boot_id = (uint16_t)_random();
+        _clock.Reset(_id);
+    }
+
+    ~Member()
+    {
+        Stop();
+        if (_socket >= 0)
+        {
+            close(_socket);
+        }
+    }
+
+    bool Open()
+    {
+        _socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (_socket < 0)
+        {
+            return false;
+        }
+
+        int reuse = 1;
+        setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        setsockopt(_socket, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+
+        struct sockaddr_in bind_address = {};
+        bind_address.sin_family = AF_INET;
+        bind_address.sin_port = htons(_port);
+        bind_address.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(_socket, (struct sockaddr*)&bind_address, sizeof(bind_address)) < 0)
+        {
+            return false;
+        }
+
+        struct ip_mreq membership = {};
+        membership.imr_multiaddr.s_addr = inet_addr(_multicast_address);
+        membership.imr_interface.s_addr = htonl(INADDR_LOOPBACK);
+        if (setsockopt(_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0)
+        {
+            return false;
+        }
+
+        struct in_addr interface_address = {};
+        interface_address.s_addr = htonl(INADDR_LOOPBACK);
+        uint8_t loopback = 1;
+        setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_IF, &interface_address, sizeof(interface_address));
+        setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loopback, sizeof(loopback));
+
+        struct timeval receive_timeout = {};
+        receive_timeout.tv_usec = 5000;
+        setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, &receive_timeout, sizeof(receive_timeout));
+        return true;
+    }
+
+    void Start()
+    {
+        _is_running = true;
+        _thread = std::thread(&Member::Run, this);
+    }
+
+    void Stop()
+    {
+        _is_running = false;
+        if (_thread.joinable())
+        {
+            _thread.join();
+        }
+    }
+
+    /// @brief Lose everything GroupSync keeps in RAM and start over with a new boot id
+    void Reboot()
+    {
+        Stop();
+        uint16_t boot_id = _boot_id;
+        while (boot_id == _boot_id)
+        {
+            boot_id = (uint16_t)_random();
+        }
+        _boot_id = boot_id;
+        _sequence = 0;
+        _last_beacon_time_us = 0;
+        _clock.Reset(_id);
+        _sequences.Clear();
+        _lost_counts.clear();
+        Start();
+    }
+
+    /// @brief Ask the member thread to send a command
+    void RequestCommand(int state)
+    {
+        _requested_state = state;
+    }
+
+    void SetLoss(double loss)
+    {
+        _loss = loss;
+    }
+
+    uint32_t GetId() const
+    {
+        return _id;
+    }
+
+    uint16_t GetBootId() const
+    {
+        return _boot_id;
+    }
+
+    // Read once the thread stopped
+    const GroupClock& GetClock() const
+    {
+        return _clock;
+    }
+
+    const std::map<std::pair<uint32_t, uint16_t>, uint32_t>& GetLostCounts() const
+    {
+        return _lost_counts;
+    }
+
+    uint32_t GetDuplicateCount() const
+    {
+        return _duplicate_count;
+    }
+
+private:
+    size_t _index;
+    uint32_t _id;
+    uint16_t _port;
+    std::atomic<double> _loss;
+    std::mt19937 _random;
+    ResultLog& _log;
+    int _socket = -1;
+    std::thread _thread;
+    std::atomic<bool> _is_running{false};
+    std::atomic<int> _requested_state{-1};
+
+    int64_t _clock_offset_us = 0;
+    double _drift_ppm = 0;
+    GroupClock _clock;
+    SequenceTracker _sequences;
+    uint16_t _boot_id = 0;
+    uint32_t _sequence = 0;
+    int64_t _last_beacon_time_us = 0;
+    // Sender id and boot id => lost commands counted by the tracker since our own boot
+    std::map<std::pair<uint32_t, uint16_t>, uint32_t> _lost_counts;
+    uint32_t _duplicate_count = 0;
+
+    int64_t LocalTimeUs(int64_t host_time_us) const
+    {
+        return host_time_us + _clock_offset_us + (int64_t)(host_time_us * _drift_ppm / 1000000);
+    }
+
+    int64_t HostTimeOf(int64_t local_time_us) const
+    {
+        return (int64_t)((local_time_us - _clock_offset_us) / (1 + _drift_ppm / 1000000));
+    }
+
+    void Run()
+    {
+        GroupSyncPacket packet;
+        std::uniform_real_distribution<double> loss_distribution(0, 1);
+        while (_is_running)
+        {
+            ssize_t received_length = recv(_socket, &packet, sizeof(packet), 0);
+            int64_t receive_time_us = LocalTimeUs(HostTimeUs());
+
+            if (received_length == (ssize_t)sizeof(packet) && loss_distribution(_random) >= _loss)
+            {
+                HandlePacket(packet, receive_time_us);
+            }
+
+            int state = _requested_state.exchange(-1);
+            if (state >= 0)
+            {
+                SendCommand(state);
+            }
+
+            if (receive_time_us - _last_beacon_time_us >= _beacon_interval_us)
+            {
+                _last_beacon_time_us = receive_time_us;
+                if (_clock.IsLeader(receive_time_us))
+                {
+                    GroupSyncPacket beacon = {};
+                    beacon.type = GROUP_SYNC_PACKET_BEACON;
+                    beacon.sequence = _sequence;
+                    SendPacket(beacon, 1);
+                }
+            }
+        }
+    }
+
+    void HandlePacket(const GroupSyncPacket& packet, int64_t receive_time_us)
+    {
+        if (packet.magic != GROUP_SYNC_PACKET_MAGIC || packet.version != 1 || packet.sender_id == _id || packet.group_id != _group_id)
+        {
+            return;
+        }
+
+        if (packet.type == GROUP_SYNC_PACKET_BEACON)
+        {
+            _clock.OnBeacon(packet.sender_id, packet.sender_group_time_us, receive_time_us);
+        }
+        else if (packet.type == GROUP_SYNC_PACKET_COMMAND)
+        {
+            uint32_t lost_count = 0;
+            if (!_sequences.Track(packet.sender_id, packet.boot_id, packet.sequence, receive_time_us, lost_count))
+            {
+                _duplicate_count++;
+                return;
+            }
+            _lost_counts[{packet.sender_id, packet.boot_id}] += lost_count;
+
+            int64_t local_deadline_us = packet.deadline_group_time_us - _clock.GetOffsetUs();
+            CommandId command((uint32_t)packet.sender_id, (uint16_t)packet.boot_id, (uint32_t)packet.sequence);
+            _log.AddApply({command, _index, _boot_id, HostTimeOf(local_deadline_us)});
+        }
+    }
+
+    void SendCommand(int state)
+    {
+        int64_t host_now_us = HostTimeUs();
+        int64_t now_us = LocalTimeUs(host_now_us);
+        int64_t local_deadline_us = now_us + _lead_time_us;
+
+        GroupSyncPacket packet = {};
+        packet.type = GROUP_SYNC_PACKET_COMMAND;
+        packet.sequence = ++_sequence;
+        packet.sender_group_time_us = now_us + _clock.GetOffsetUs();
+        packet.deadline_group_time_us = local_deadline_us + _clock.GetOffsetUs();
+        packet.state = state;
+
+        CommandId command(_id, _boot_id, (uint32_t)packet.sequence);
+        _log.AddSent({command, host_now_us});
+        _log.AddApply({command, _index, _boot_id, HostTimeOf(local_deadline_us)});
+        SendPacket(packet, _command_repeat_count);
+    }
+
+    void SendPacket(GroupSyncPacket& packet, int repeat_count)
+    {
+        struct sockaddr_in destination = {};
+        destination.sin_family = AF_INET;
+        destination.sin_port = htons(_port);
+        destination.sin_addr.s_addr = inet_addr(_multicast_address);
+
+        packet.magic = GROUP_SYNC_PACKET_MAGIC;
+        packet.version = 1;
+        packet.group_id = _group_id;
+        packet.sender_id = _id;
+        packet.boot_id = _boot_id;
+        for (int i = 0; i < repeat_count; i++)
+        {
+            // Beacons are stamped as late as possible, like on the device
+            if (packet.type == GROUP_SYNC_PACKET_BEACON)
+            {
+                packet.sender_group_time_us = LocalTimeUs(HostTimeUs()) + _clock.GetOffsetUs();
+            }
+            sendto(_socket, &packet, sizeof(packet), 0, (struct sockaddr*)&destination, sizeof(destination));
+        }
+    }
+};
+
+struct Options
+{
+    size_t member_count = 4;
+    int duration_s = 20;
+    double loss = 0.1;
+    uint16_t port = 5107;
+    int64_t max_skew_us = 2000;
+};
+
+static bool RunGroup(const Options& options)
+{
+    ResultLog log;
+    std::mt19937 random(42);
+    std::vector<std::unique_ptr<Member>> members;
+    std::set<uint32_t> member_ids;
+    while (member_ids.size() < options.member_count)
+    {
+        member_ids.insert(random() | 1);
+    }
+
+    size_t index = 0;
+    for (uint32_t member_id : member_ids)
+    {
+        members.push_back(std::make_unique<Member>(index, member_id, options.port, options.loss, random(), log));
+        if (!members.back()->Open())
+        {
+            std::cerr << "Cannot join " << _multicast_address << " on the loopback interface: " << strerror(errno) << "\n";
+            return false;
+        }
+        index++;
+    }
+
+    // Ids are sorted, the first member leads until it stops halfway
+    std::vector<std::pair<int64_t, int64_t>> unsettled_periods;
+    int64_t start_time_us = HostTimeUs();
+    unsettled_periods.push_back({start_time_us, start_time_us + 1000000});
+    for (std::unique_ptr<Member>& member : members)
+    {
+        member->Start();
+    }
+
+    int64_t end_time_us = start_time_us + (int64_t)options.duration_s * 1000000;
+    bool is_leader_stopped = false;
+    bool is_rebooted = false;
+    int state = 1;
+    while (HostTimeUs() < end_time_us)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        if (!is_leader_stopped && HostTimeUs() >= start_time_us + (end_time_us - start_time_us) / 2)
+        {
+            members.front()->Stop();
+            is_leader_stopped = true;
+            unsettled_periods.push_back({HostTimeUs(), HostTimeUs() + 1000000});
+        }
+
+        // The last member is neither the old nor the new leader, its clock follows again after a beacon
+        if (!is_rebooted && HostTimeUs() >= start_time_us + (end_time_us - start_time_us) * 3 / 4)
+        {
+            members.back()->Reboot();
+            is_rebooted = true;
+            unsettled_periods.push_back({HostTimeUs(), HostTimeUs() + 1000000});
+        }
+
+        size_t sender_index = 1 + random() % (members.size() - 1);
+        if (!is_leader_stopped)
+        {
+            sender_index = random() % members.size();
+        }
+        members[sender_index]->RequestCommand(state);
+        state = 1 - state;
+    }
+
+    // With loss a follower may miss three beacons in a row and lead on its own for a moment, a last
+    // second without loss lets the election settle before the leaders are compared
+    for (std::unique_ptr<Member>& member : members)
+    {
+        member->SetLoss(0);
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    for (std::unique_ptr<Member>& member : members)
+    {
+        member->Stop();
+    }
+
+    // Group the applies by command, the skew only counts while the members follow a settled leader
+    std::vector<ApplyRecord> applies = log.GetApplies();
+    std::map<CommandId, std::vector<ApplyRecord>> applies_by_command;
+    std::set<std::pair<CommandId, size_t>> applied;
+    for (const ApplyRecord& record : applies)
+    {
+        applies_by_command[record.command].push_back(record);
+        Check(applied.insert({record.command, record.member_index}).second, "group: a command was applied twice");
+    }
+
+    std::vector<int64_t> skews_us;
+    size_t delivery_count = 0;
+    size_t missed_delivery_count = 0;
+    std::vector<SentCommand> sent_commands = log.GetSentCommands();
+    for (const SentCommand& command : sent_commands)
+    {
+        std::vector<ApplyRecord>& records = applies_by_command[command.command];
+        size_t receiver_count = options.member_count - 1 - (command.host_send_time_us >= unsettled_periods.back().first ? 1 : 0);
+        delivery_count += receiver_count;
+        missed_delivery_count += receiver_count + 1 - records.size();
+
+        bool is_settled = true;
+        for (const std::pair<int64_t, int64_t>& period : unsettled_periods)
+        {
+            is_settled = is_settled && (command.host_send_time_us < period.first || command.host_send_time_us > period.second);
+        }
+        if (!is_settled || records.size() < 2)
+        {
+            continue;
+        }
+
+        int64_t earliest_us = records.front().host_apply_time_us;
+        int64_t latest_us = earliest_us;
+        for (const ApplyRecord& record : records)
+        {
+            earliest_us = std::min(earliest_us, record.host_apply_time_us);
+            latest_us = std::max(latest_us, record.host_apply_time_us);
+        }
+        skews_us.push_back(latest_us - earliest_us);
+    }
+    Check(!skews_us.empty(), "group: no command reached two members");
+    std::sort(skews_us.begin(), skews_us.end());
+
+    // The lost count of a member covers the commands missed between the first and the last it received,
+    // per boot of the sender and since the last boot of the member
+    for (size_t receiver_index = 0; receiver_index < members.size(); receiver_index++)
+    {
+        const Member& receiver = *members[receiver_index];
+        std::map<std::pair<uint32_t, uint16_t>, std::vector<uint32_t>> received_sequences;
+        for (const ApplyRecord& record : applies)
+        {
+            if (record.member_index == receiver_index && record.member_boot_id == receiver.GetBootId() && std::get<0>(record.command) != receiver.GetId())
+            {
+                received_sequences[{std::get<0>(record.command), std::get<1>(record.command)}].push_back(std::get<2>(record.command));
+            }
+        }
+
+        for (std::pair<const std::pair<uint32_t, uint16_t>, std::vector<uint32_t>>& sender : received_sequences)
+        {
+            std::vector<uint32_t>& sequences = sender.second;
+            std::sort(sequences.begin(), sequences.end());
+            uint32_t missed_count = sequences.back() - sequences.front() + 1 - sequences.size();
+            std::map<std::pair<uint32_t, uint16_t>, uint32_t>::const_iterator lost_count = receiver.GetLostCounts().find(sender.first);
+            uint32_t counted_count = lost_count == receiver.GetLostCounts().end() ? 0 : lost_count->second;
+            Check(counted_count == missed_count, "group: lost count does not match the missed commands");
+        }
+    }
+
+    // Its sequence started over below the one the others remember, they must not take it for copies
+    const Member& rebooted = *members.back();
+    size_t rebooted_sent_count = 0;
+    size_t rebooted_applied_count = 0;
+    for (const SentCommand& command : sent_commands)
+    {
+        rebooted_sent_count += command.command == CommandId(rebooted.GetId(), rebooted.GetBootId(), std::get<2>(command.command)) ? 1 : 0;
+    }
+    for (const ApplyRecord& record : applies)
+    {
+        bool is_after_reboot = std::get<0>(record.command) == rebooted.GetId() && std::get<1>(record.command) == rebooted.GetBootId();
+        rebooted_applied_count += is_after_reboot && record.member_index != members.size() - 1 ? 1 : 0;
+    }
+    Check(rebooted_sent_count > 0, "reboot: the rebooted member sent no command");
+    Check(rebooted_applied_count > 0, "reboot: the commands after the reboot were dropped as copies");
+    for (size_t member_index = 1; member_index < members.size(); member_index++)
+    {
+        Check(members[member_index]->GetClock().GetLeaderId() == members[1]->GetId(), "group: the members do not agree on the new leader");
+    }
+
+    uint32_t duplicate_count = 0;
+    for (const std::unique_ptr<Member>& member : members)
+    {
+        duplicate_count += member->GetDuplicateCount();
+    }
+
+    int64_t max_skew_us = skews_us.empty() ? 0 : skews_us.back();
+    std::cout << options.member_count << " members, " << options.duration_s << " s, " << options.loss * 100 << " % receive loss\n"
+              << "  commands: " << sent_commands.size() << ", skew measured on " << skews_us.size() << "\n"
+              << "  skew us: median " << (skews_us.empty() ? 0 : skews_us[skews_us.size() / 2])
+              << ", p99 " << (skews_us.empty() ? 0 : skews_us[skews_us.size() * 99 / 100]) << ", max " << max_skew_us << "\n"
+              << "  missed deliveries: " << missed_delivery_count << " of " << delivery_count
+              << ", duplicates dropped: " << duplicate_count << "\n"
+              << "  after the reboot: " << rebooted_sent_count << " commands sent, applied " << rebooted_applied_count << " times by the others\n";
+    Check(max_skew_us <= options.max_skew_us, "group: skew above " + std::to_string(options.max_skew_us) + " us");
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (argument == "--members" && has_value)
+        {
+            options.member_count = std::max(atoi(argv[++i]), 3);
+        }
+        else if (argument == "--seconds" && has_value)
+        {
+            options.duration_s = std::max(atoi(argv[++i]), 4);
+        }
+        else if (argument == "--loss" && has_value)
+        {
+            options.loss = std::min(std::max(atof(argv[++i]), 0.0), 90.0) / 100;
+        }
+        else if (argument == "--port" && has_value)
+        {
+            options.port = atoi(argv[++i]);
+        }
+        else if (argument == "--max-skew-us" && has_value)
+        {
+            options.max_skew_us = atoll(argv[++i]);
+        }
+        else
+        {
+            std::cerr << "Usage: GroupSyncHost [--members <n>] [--seconds <n>] [--loss <percent>] [--port <port>] [--max-skew-us <n>]\n";
+            return 1;
+        }
+    }
+
+    CheckLeaderElection();
+    CheckOffsetFilter();
+    CheckSequenceTracker();
+    CheckReboot();
+    CheckSenderFlood();
+    CheckApplyQueue();
+    if (!RunGroup(options))
+    {
+        return 1;
+    }
+
+    if (_failure_count > 0)
+    {
+        std::cerr << _failure_count << " checks failed\n";
+        return 1;
+    }
+    std::cout << "All checks passed\n";
+    return 0;
+}
\ No newline at end of file
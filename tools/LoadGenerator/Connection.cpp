@@ -0,0 +1,419 @@
+#include "Connection.hpp"
+#include <cstring>
+#include <random>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+Connection::Connection(std::string host, uint16_t port, int timeout_ms, std::string source_address)
+    : _host(host), _port(port), _timeout_ms(timeout_ms), _source_address(source_address)
+{
+}
+
+Connection::~Connection()
+{
+    Close();
+}
+
+bool Connection::Open()
+{
+    Close();
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* addresses = nullptr;
+    std::string port = std::to_string(_port);
+    if (getaddrinfo(_host.c_str(), port.c_str(), &hints, &addresses) != 0 || !addresses)
+    {
+        return false;
+    }
+
+    _socket = socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol);
+    if (_socket >= 0 && !_source_address.empty())
+    {
+        // e.g. 127.0.0.2, so a flooder on the same host is a different address to the server
+        struct sockaddr_in source = {};
+        source.sin_family = AF_INET;
+        if (inet_pton(AF_INET, _source_address.c_str(), &source.sin_addr) != 1 || bind(_socket, (struct sockaddr*)&source, sizeof(source)) != 0)
+        {
+            close(_socket);
+            _socket = -1;
+        }
+    }
+    if (_socket >= 0 && connect(_socket, addresses->ai_addr, addresses->ai_addrlen) != 0)
+    {
+        close(_socket);
+        _socket = -1;
+    }
+    freeaddrinfo(addresses);
+
+    if (_socket < 0)
+    {
+        return false;
+    }
+
+    // Small request/response messages, Nagle would add up to 40 ms to every round trip
+    int no_delay = 1;
+    setsockopt(_socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+    struct timeval timeout = {};
+    timeout.tv_sec = _timeout_ms / 1000;
+    timeout.tv_usec = (_timeout_ms % 1000) * 1000;
+    setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(_socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    return true;
+}
+
+void Connection::Close()
+{
+    if (_socket >= 0)
+    {
+        close(_socket);
+        _socket = -1;
+    }
+    _buffer.clear();
+}
+
+bool Connection::IsOpen() const
+{
+    return _socket >= 0;
+}
+
+bool Connection::SendAll(const char* data, size_t length)
+{
+    size_t sent_length = 0;
+    while (IsOpen() && sent_length < length)
+    {
+        ssize_t status = send(_socket, data + sent_length, length - sent_length, MSG_NOSIGNAL);
+        if (status <= 0)
+        {
+            Close();
+            return false;
+        }
+        sent_length += status;
+    }
+
+    return IsOpen();
+}
+
+bool Connection::ReceiveExactly(size_t length, std::string& output)
+{
+    while (_buffer.size() < length)
+    {
+        if (!Fill())
+        {
+            return false;
+        }
+    }
+
+    output.assign(_buffer, 0, length);
+    _buffer.erase(0, length);
+    return true;
+}
+
+bool Connection::ReceiveUntil(const std::string& delimiter, std::string& output)
+{
+    size_t position = _buffer.find(delimiter);
+    while (position == std::string::npos)
+    {
+        size_t searched_length = _buffer.size() >= delimiter.size() ? _buffer.size() - delimiter.size() + 1 : 0;
+        if (!Fill())
+        {
+            return false;
+        }
+        position = _buffer.find(delimiter, searched_length);
+    }
+
+    output.assign(_buffer, 0, position + delimiter.size());
+    _buffer.erase(0, position + delimiter.size());
+    return true;
+}
+
+bool Connection::WaitReadable(int timeout_ms)
+{
+    if (!_buffer.empty())
+    {
+        return true;
+    }
+
+    if (!IsOpen())
+    {
+        return false;
+    }
+
+    struct pollfd poll_descriptor = {};
+    poll_descriptor.fd = _socket;
+    poll_descriptor.events = POLLIN;
+    return poll(&poll_descriptor, 1, timeout_ms) > 0;
+}
+
+bool Connection::Fill()
+{
+    if (!IsOpen())
+    {
+        return false;
+    }
+
+    char chunk[4096];
+    ssize_t received_length = recv(_socket, chunk, sizeof(chunk), 0);
+    if (received_length <= 0)
+    {
+        Close();
+        return false;
+    }
+
+    _buffer.append(chunk, received_length);
+    return true;
+}
+
+/* HttpClient */
+HttpClient::HttpClient(std::string host, uint16_t port, int timeout_ms, std::string source_address)
+    : _host(host), _connection(host, port, timeout_ms, source_address)
+{
+}
+
+bool HttpClient::Request(const std::string& method, const std::string& path, const std::string& content_type, const std::string& body, Response& output_response)
+{
+    std::string request = method + " " + path + " HTTP/1.1\r\nHost: " + _host + "\r\n";
+    if (content_type != "")
+    {
+        request += "Content-Type: " + content_type + "\r\n";
+    }
+    if (body != "" || method == "POST")
+    {
+        request += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    request += "\r\n" + body;
+
+    // An idle keep-alive socket has nothing to read unless the server closed it meanwhile
+    if (_connection.IsOpen() && _connection.WaitReadable(0))
+    {
+        _connection.Close();
+    }
+
+    // A socket purged between that check and the send costs one retry. Only GET is retried, a POST
+    // may have been applied before the connection failed.
+    int attempt_count = method == "GET" ? 2 : 1;
+    for (int attempt = 0; attempt < attempt_count; attempt++)
+    {
+        if (!_connection.IsOpen() && !_connection.Open())
+        {
+            return false;
+        }
+
+        if (_connection.SendAll(request.data(), request.size()) && ReceiveResponse(output_response))
+        {
+            return true;
+        }
+        _connection.Close();
+    }
+
+    return false;
+}
+
+bool HttpClient::ReceiveResponse(Response& output_response)
+{
+    std::string headers;
+    if (!_connection.ReceiveUntil("\r\n\r\n", headers))
+    {
+        return false;
+    }
+
+    output_response.status = 0;
+    output_response.body_length = 0;
+    output_response.body.clear();
+    if (sscanf(headers.c_str(), "HTTP/1.%*d %d", &output_response.status) != 1)
+    {
+        return false;
+    }
+
+    // Header names are case insensitive
+    std::string lower_headers = headers;
+    for (char& character : lower_headers)
+    {
+        character = tolower(character);
+    }
+
+    bool is_connection_close = lower_headers.find("\r\nconnection: close") != std::string::npos;
+    size_t content_length_position = lower_headers.find("\r\ncontent-length:");
+    if (content_length_position != std::string::npos)
+    {
+        size_t content_length = strtoul(headers.c_str() + content_length_position + 17, nullptr, 10);
+        if (!_connection.ReceiveExactly(content_length, output_response.body))
+        {
+            return false;
+        }
+    }
+    else if (lower_headers.find("\r\ntransfer-encoding: chunked") != std::string::npos)
+    {
+        while (true)
+        {
+            std::string chunk_header;
+            if (!_connection.ReceiveUntil("\r\n", chunk_header))
+            {
+                return false;
+            }
+
+            size_t chunk_length = strtoul(chunk_header.c_str(), nullptr, 16);
+            std::string chunk;
+            if (!_connection.ReceiveExactly(chunk_length + 2, chunk))
+            {
+                return false;
+            }
+
+            if (chunk_length == 0)
+            {
+                break;
+            }
+            output_response.body.append(chunk, 0, chunk_length);
+        }
+    }
+
+    output_response.body_length = output_response.body.size();
+    if (is_connection_close)
+    {
+        _connection.Close();
+    }
+    return true;
+}
+
+/* WebSocketClient */
+WebSocketClient::WebSocketClient(std::string host, uint16_t port, int timeout_ms, std::string source_address)
+    : _host(host), _connection(host, port, timeout_ms, source_address)
+{
+}
+
+bool WebSocketClient::Connect(const std::string& path)
+{
+    if (!_connection.Open())
+    {
+        return false;
+    }
+
+    // The server does not care about the key value, the accept hash is not verified either
+    std::string request =
+        "GET " + path + " HTTP/1.1\r\n"
+        "Host: " + _host + "\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Version: 13\r\n\r\n";
+
+    std::string response_headers;
+    if (!_connection.SendAll(request.data(), request.size()) || !_connection.ReceiveUntil("\r\n\r\n", response_headers))
+    {
+        return false;
+    }
+
+    if (response_headers.compare(0, 12, "HTTP/1.1 101") != 0)
+    {
+        _connection.Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool WebSocketClient::SendText(const std::string& message)
+{
+    static thread_local std::mt19937 random_generator(std::random_device{}());
+
+    std::string frame;
+    frame.push_back((char)0x81);
+    if (message.size() < 126)
+    {
+        frame.push_back((char)(0x80 | message.size()));
+    }
+    else
+    {
+        frame.push_back((char)(0x80 | 126));
+        frame.push_back((char)((message.size() >> 8) & 0xFF));
+        frame.push_back((char)(message.size() & 0xFF));
+    }
+
+    // Client frames must be masked
+    uint32_t mask = random_generator();
+    char mask_bytes[4];
+    memcpy(mask_bytes, &mask, sizeof(mask_bytes));
+    frame.append(mask_bytes, sizeof(mask_bytes));
+    for (size_t i = 0; i < message.size(); i++)
+    {
+        frame.push_back(message[i] ^ mask_bytes[i % 4]);
+    }
+
+    return _connection.SendAll(frame.data(), frame.size());
+}
+
+bool WebSocketClient::ReceiveText(std::string& output_message, int timeout_ms)
+{
+    while (true)
+    {
+        if (!_connection.WaitReadable(timeout_ms))
+        {
+            return false;
+        }
+
+        std::string header;
+        if (!_connection.ReceiveExactly(2, header))
+        {
+            return false;
+        }
+
+        uint8_t opcode = header[0] & 0x0F;
+        uint64_t payload_length = header[1] & 0x7F;
+        std::string extended_length;
+        if (payload_length == 126 && _connection.ReceiveExactly(2, extended_length))
+        {
+            payload_length = ((uint8_t)extended_length[0] << 8) | (uint8_t)extended_length[1];
+        }
+        else if (payload_length == 127 && _connection.ReceiveExactly(8, extended_length))
+        {
+            payload_length = 0;
+            for (char byte : extended_length)
+            {
+                payload_length = (payload_length << 8) | (uint8_t)byte;
+            }
+        }
+
+        std::string payload;
+        if (!_connection.ReceiveExactly(payload_length, payload))
+        {
+            return false;
+        }
+
+        if (opcode == 0x1)
+        {
+            output_message = payload;
+            return true;
+        }
+
+        if (opcode == 0x8)
+        {
+            _connection.Close();
+            return false;
+        }
+
+        if (opcode == 0x9)
+        {
+            // Answer the ping with a masked pong carrying the same payload
+            std::string pong;
+            pong.push_back((char)0x8A);
+            pong.push_back((char)(0x80 | payload.size()));
+            pong.append(4, '\0');
+            pong += payload;
+            _connection.SendAll(pong.data(), pong.size());
+        }
+    }
+}
+
+bool WebSocketClient::IsOpen() const
+{
+    return _connection.IsOpen();
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#ifndef CONNECTION_HPP
+#define CONNECTION_HPP
+
+#include <cstdint>
+#include <string>
+
+/// @brief Blocking TCP connection with a receive buffer, shared by the HTTP and websocket clients
+class Connection
+{
+public:
+    /// @param source_address Local address to connect from, empty for any
+    Connection(std::string host, uint16_t port, int timeout_ms, std::string source_address = "");
+    ~Connection();
+
+    bool Open();
+    void Close();
+    bool IsOpen() const;
+
+    bool SendAll(const char* data, size_t length);
+
+    /// @brief Read exactly length bytes, from the buffer first
+    bool ReceiveExactly(size_t length, std::string& output);
+
+    /// @brief Read up to and including the delimiter
+    bool ReceiveUntil(const std::string& delimiter, std::string& output);
+
+    /// @brief Wait until data is readable, used by the websocket listeners to poll without blocking forever
+    /// @return False on timeout
+    bool WaitReadable(int timeout_ms);
+
+private:
+    std::string _host;
+    uint16_t _port;
+    int _timeout_ms;
+    std::string _source_address;
+    int _socket = -1;
+    std::string _buffer;
+
+    bool Fill();
+};
+
+/// @brief Keep-alive HTTP/1.1 client, reconnects transparently when the server closed the socket
+class HttpClient
+{
+public:
+    struct Response
+    {
+        int status;
+        size_t body_length;
+        std::string body;
+    };
+
+    HttpClient(std::string host, uint16_t port, int timeout_ms, std::string source_address = "");
+
+    bool Request(const std::string& method, const std::string& path, const std::string& content_type, const std::string& body, Response& output_response);
+
+private:
+    std::string _host;
+    Connection _connection;
+
+    bool ReceiveResponse(Response& output_response);
+};
+
+/// @brief Minimal RFC 6455 client: masked text frames out, unfragmented frames in
+class WebSocketClient
+{
+public:
+    WebSocketClient(std::string host, uint16_t port, int timeout_ms, std::string source_address = "");
+
+    bool Connect(const std::string& path);
+    bool SendText(const std::string& message);
+
+    /// @brief Receive the next text frame. Pings are answered, other control frames skipped
+    /// @return False on timeout or on a closed connection, see IsOpen()
+    bool ReceiveText(std::string& output_message, int timeout_ms);
+
+    bool IsOpen() const;
+
+private:
+    std::string _host;
+    Connection _connection;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,141 @@
+#include "HdrHistogram.hpp"
+#include <algorithm>
+#include <cmath>
+
+static int FloorLog2(uint64_t value)
+{
+    return 63 - __builtin_clzll(value);
+}
+
+HdrHistogram::HdrHistogram(int64_t highest_trackable_value, int significant_digits)
+    : _highest_trackable_value(std::max<int64_t>(highest_trackable_value, 2))
+{
+    significant_digits = std::min(std::max(significant_digits, 1), 5);
+
+    // Linear range [0, sub_bucket_count) must resolve 10^digits distinct values in its upper half
+    int64_t largest_single_unit_value = 2 * (int64_t)std::pow(10, significant_digits);
+    int sub_bucket_count_magnitude = FloorLog2(largest_single_unit_value - 1) + 1;
+    _sub_bucket_half_count_magnitude = sub_bucket_count_magnitude - 1;
+    _sub_bucket_count = (int64_t)1 << sub_bucket_count_magnitude;
+    _sub_bucket_half_count = _sub_bucket_count / 2;
+
+    int highest_exponent = FloorLog2(_highest_trackable_value);
+    int64_t bucket_count = std::max(highest_exponent - sub_bucket_count_magnitude + 1, 0);
+    _counts.resize(_sub_bucket_count + bucket_count * _sub_bucket_half_count, 0);
+}
+
+void HdrHistogram::Record(int64_t value)
+{
+    value = std::max<int64_t>(value, 0);
+    if (value > _highest_trackable_value)
+    {
+        _overflow_count++;
+        value = _highest_trackable_value;
+    }
+
+    _counts[GetIndex(value)]++;
+    _total_count++;
+    _min = std::min(_min, value);
+    _max = std::max(_max, value);
+    _sum += value;
+}
+
+void HdrHistogram::Merge(const HdrHistogram& other)
+{
+    if (other._counts.size() != _counts.size() || other._sub_bucket_count != _sub_bucket_count)
+    {
+        // Different layouts, fall back to re-recording the bucket representatives
+        for (size_t i = 0; i < other._counts.size(); i++)
+        {
+            for (uint64_t j = 0; j < other._counts[i]; j++)
+            {
+                Record(other.GetHighestEquivalentValue(i));
+            }
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < _counts.size(); i++)
+    {
+        _counts[i] += other._counts[i];
+    }
+    _total_count += other._total_count;
+    _overflow_count += other._overflow_count;
+    _min = std::min(_min, other._min);
+    _max = std::max(_max, other._max);
+    _sum += other._sum;
+}
+
+int64_t HdrHistogram::GetValueAtPercentile(double percentile) const
+{
+    if (_total_count == 0)
+    {
+        return 0;
+    }
+
+    percentile = std::min(std::max(percentile, 0.0), 100.0);
+    uint64_t target_count = std::max<uint64_t>((uint64_t)std::ceil(percentile / 100.0 * _total_count), 1);
+
+    uint64_t running_count = 0;
+    for (size_t i = 0; i < _counts.size(); i++)
+    {
+        running_count += _counts[i];
+        if (running_count >= target_count)
+        {
+            return std::min(GetHighestEquivalentValue(i), _max);
+        }
+    }
+
+    return _max;
+}
+
+int64_t HdrHistogram::GetMin() const
+{
+    return _total_count == 0 ? 0 : _min;
+}
+
+int64_t HdrHistogram::GetMax() const
+{
+    return _max;
+}
+
+double HdrHistogram::GetMean() const
+{
+    return _total_count == 0 ? 0.0 : _sum / _total_count;
+}
+
+uint64_t HdrHistogram::GetCount() const
+{
+    return _total_count;
+}
+
+uint64_t HdrHistogram::GetOverflowCount() const
+{
+    return _overflow_count;
+}
+
+size_t HdrHistogram::GetIndex(int64_t value) const
+{
+    if (value < _sub_bucket_count)
+    {
+        return value;
+    }
+
+    // Bucket b covers [2^e, 2^(e+1)) with half_count sub buckets that are 2^b wide
+    int bucket = FloorLog2(value) - _sub_bucket_half_count_magnitude;
+    int64_t sub_bucket = (value >> bucket) - _sub_bucket_half_count;
+    return _sub_bucket_count + (bucket - 1) * _sub_bucket_half_count + sub_bucket;
+}
+
+int64_t HdrHistogram::GetHighestEquivalentValue(size_t index) const
+{
+    if ((int64_t)index < _sub_bucket_count)
+    {
+        return index;
+    }
+
+    int bucket = (index - _sub_bucket_count) / _sub_bucket_half_count + 1;
+    int64_t sub_bucket = (index - _sub_bucket_count) % _sub_bucket_half_count;
+    int64_t lowest_value = (sub_bucket + _sub_bucket_half_count) << bucket;
+    return lowest_value + ((int64_t)1 << bucket) - 1;
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef HDRHISTOGRAM_HPP
+#define HDRHISTOGRAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// @brief Fixed memory latency histogram with bounded relative error (HDR style).
+/// Values are grouped by power of two; each group is split into linear sub buckets, so every
+/// recorded value is reported within 1 / sub_bucket_count of its real value up to the highest
+/// trackable value. Values above it are clamped and counted as overflow.
+class HdrHistogram
+{
+public:
+    /// @param highest_trackable_value e.g. 60'000'000 for latencies in microseconds up to a minute
+    /// @param significant_digits 1 to 5, 3 => 0.1% resolution
+    HdrHistogram(int64_t highest_trackable_value = 60000000, int significant_digits = 3);
+
+    void Record(int64_t value);
+    void Merge(const HdrHistogram& other);
+
+    /// @brief Value at or below which the given percentage of the recorded values fall
+    /// @param percentile 0.0 to 100.0
+    int64_t GetValueAtPercentile(double percentile) const;
+
+    int64_t GetMin() const;
+    int64_t GetMax() const;
+    double GetMean() const;
+    uint64_t GetCount() const;
+    uint64_t GetOverflowCount() const;
+
+private:
+    int64_t _highest_trackable_value;
+    int _sub_bucket_half_count_magnitude;
+    int64_t _sub_bucket_count;
+    int64_t _sub_bucket_half_count;
+    std::vector<uint64_t> _counts;
+
+    uint64_t _total_count = 0;
+    uint64_t _overflow_count = 0;
+    int64_t _min = INT64_MAX;
+    int64_t _max = 0;
+    double _sum = 0;
+
+    size_t GetIndex(int64_t value) const;
+    int64_t GetHighestEquivalentValue(size_t index) const;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,624 @@
+// Load generator and latency benchmark for the LED controller HTTP and websocket API.
+//
+// Opens N HTTP and M websocket connections against a device, drives /led, /wsled and the web
+// assets with a configurable mix and rate, and writes the latency distributions as JSON so every
+// release can be compared against a baseline.
+//
+//   LoadGenerator --host baobao.local --http 4 --ws 4 --listeners 2 --duration 30 --rate 20
+//                 --mix led=70,asset=30 --output results.json
+//
+// Websocket commands carry an "id" that the device echoes in its direct reply. Every websocket
+// client also receives a broadcast per state change, its own commands included, so ws_command waits
+// for the reply with the matching id and skips the broadcasts.
+//
+// With --rate 0 every connection runs closed loop (next request after the previous response).
+// With a rate, requests are scheduled open loop and latency is measured from the intended send
+// time, so a stalled server is not hidden by the client backing off (coordinated omission).
+//
+// Flood connections play a misbehaving client: they hammer /led or /wsled as fast as the server
+// answers. 429 responses and websocket closes are counted as "throttled", not as errors, so one run
+// shows both how often the flooder was stopped and whether the p99 of the other clients moved.
+// The device also limits per source address, so run the flooder from a second machine:
+//
+//   LoadGenerator --host baobao.local --http 0 --ws 0 --listeners 0 --flood-http 2 --flood-ws 1 --duration 30
+//
+// or, against tools/AdmissionServerHost, from a second loopback address with --source 127.0.0.2.
+
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Connection.hpp"
+#include "HdrHistogram.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    std::string host = "127.0.0.1";
+    uint16_t port = 80;
+    int http_connections = 4;
+    int websocket_connections = 4;
+    int listener_connections = 2;
+    int duration_s = 10;
+    double rate_per_connection = 0;
+    int timeout_ms = 2000;
+    int led_weight = 70;
+    int asset_weight = 30;
+    int flood_http_connections = 0;
+    int flood_websocket_connections = 0;
+    std::string source_address = "";
+    std::string output_path = "";
+};
+
+struct OperationResult
+{
+    HdrHistogram latency_us;
+    uint64_t error_count = 0;
+    uint64_t throttled_count = 0;
+    uint64_t byte_count = 0;
+};
+
+class ResultSet
+{
+public:
+    void Merge(const std::map<std::string, OperationResult>& results)
+    {
+        std::lock_guard<std::mutex> lock(_resultsMutex);
+        for (const std::pair<const std::string, OperationResult>& result : results)
+        {
+            OperationResult& merged_result = _results[result.first];
+            merged_result.latency_us.Merge(result.second.latency_us);
+            merged_result.error_count += result.second.error_count;
+            merged_result.throttled_count += result.second.throttled_count;
+            merged_result.byte_count += result.second.byte_count;
+        }
+    }
+
+    const std::map<std::string, OperationResult>& GetResults() const
+    {
+        return _results;
+    }
+
+private:
+    std::map<std::string, OperationResult> _results;
+    std::mutex _resultsMutex;
+};
+
+static std::atomic<bool> _is_running(true);
+
+// Send time of the latest command per state, used to attribute the broadcasts the listeners receive.
+// Under concurrent senders this picks the most recent matching command, so it slightly underestimates.
+static std::atomic<int64_t> _last_command_time_ns[2];
+
+static int64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static std::string StateRequest(bool is_on)
+{
+    return is_on ? "{\"state\":\"on\"}" : "{\"state\":\"off\"}";
+}
+
+/// @brief Paces a worker: closed loop without a rate, fixed schedule otherwise
+class Pacer
+{
+public:
+    Pacer(double rate_per_second)
+        : _interval_ns(rate_per_second > 0 ? (int64_t)(1e9 / rate_per_second) : 0), _next_send_time_ns(NowNs())
+    {
+    }
+
+    /// @return The time the latency of the next operation is measured from
+    int64_t WaitForNextSend()
+    {
+        if (_interval_ns == 0)
+        {
+            return NowNs();
+        }
+
+        int64_t intended_send_time_ns = _next_send_time_ns;
+        _next_send_time_ns += _interval_ns;
+
+        int64_t wait_time_ns = intended_send_time_ns - NowNs();
+        if (wait_time_ns > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(wait_time_ns));
+        }
+        return intended_send_time_ns;
+    }
+
+private:
+    int64_t _interval_ns;
+    int64_t _next_send_time_ns;
+};
+
+/// @brief Id echoed in the reply to a websocket command, -1 for broadcasts and error replies
+static int64_t ParseReplyId(const std::string& reply)
+{
+    size_t id_position = reply.find("\"id\"");
+    if (id_position == std::string::npos)
+    {
+        return -1;
+    }
+
+    // The device may pretty print, skip the separator and any whitespace around it
+    size_t value_position = reply.find_first_not_of(": \t\r\n", id_position + 4);
+    if (value_position == std::string::npos || !isdigit((unsigned char)reply[value_position]))
+    {
+        return -1;
+    }
+    return strtoll(reply.c_str() + value_position, nullptr, 10);
+}
+
+/// @brief Send a tagged command and wait for its direct reply, skipping the broadcasts around it
+static bool SendWebSocketCommand(WebSocketClient& client, bool is_on, int64_t command_id, int timeout_ms, std::string& output_reply)
+{
+    std::string request = std::string("{\"state\":\"") + (is_on ? "on" : "off") + "\",\"id\":" + std::to_string(command_id) + "}";
+    if (!client.SendText(request))
+    {
+        return false;
+    }
+
+    int64_t deadline_ns = NowNs() + (int64_t)timeout_ms * 1000000;
+    while (true)
+    {
+        int remaining_time_ms = (int)((deadline_ns - NowNs()) / 1000000);
+        if (remaining_time_ms <= 0 || !client.ReceiveText(output_reply, remaining_time_ms))
+        {
+            return false;
+        }
+
+        if (ParseReplyId(output_reply) == command_id)
+        {
+            return true;
+        }
+    }
+}
+
+static void HttpWorker(const Options& options, int worker_index, ResultSet& result_set)
+{
+    std::map<std::string, OperationResult> results;
+    HttpClient client(options.host, options.port, options.timeout_ms, options.source_address);
+    Pacer pacer(options.rate_per_connection);
+
+    const char* asset_paths[] = {"/", "/websocket.js"};
+    int total_weight = std::max(options.led_weight + options.asset_weight, 1);
+    bool is_on = worker_index % 2 == 0;
+    uint64_t operation_index = worker_index;
+
+    while (_is_running)
+    {
+        int64_t start_time_ns = pacer.WaitForNextSend();
+        if (!_is_running)
+        {
+            break;
+        }
+
+        // Deterministic weighted round robin keeps runs comparable
+        bool is_led_operation = (int)(operation_index * 37 % total_weight) < options.led_weight;
+        operation_index++;
+
+        HttpClient::Response response = {};
+        bool is_successful = false;
+        std::string operation_name;
+        if (is_led_operation)
+        {
+            operation_name = "http_led";
+            _last_command_time_ns[is_on ? 1 : 0] = NowNs();
+            is_successful = client.Request("POST", "/led", "application/json", StateRequest(is_on), response);
+            is_on = !is_on;
+        }
+        else
+        {
+            operation_name = "http_asset";
+            is_successful = client.Request("GET", asset_paths[operation_index % 2], "", "", response);
+        }
+
+        OperationResult& result = results[operation_name];
+        if (is_successful && response.status == 429)
+        {
+            result.throttled_count++;
+            continue;
+        }
+
+        if (!is_successful || response.status < 200 || response.status >= 300)
+        {
+            result.error_count++;
+            continue;
+        }
+
+        result.latency_us.Record((NowNs() - start_time_ns) / 1000);
+        result.byte_count += response.body_length;
+    }
+
+    result_set.Merge(results);
+}
+
+static void WebSocketWorker(const Options& options, int worker_index, ResultSet& result_set)
+{
+    std::map<std::string, OperationResult> results;
+    OperationResult& result = results["ws_command"];
+    WebSocketClient client(options.host, options.port, options.timeout_ms, options.source_address);
+    Pacer pacer(options.rate_per_connection);
+    bool is_on = worker_index % 2 == 0;
+    int64_t command_id = 0;
+
+    std::string message;
+    if (!client.Connect("/wsled") || !client.ReceiveText(message, options.timeout_ms))
+    {
+        result.error_count++;
+        result_set.Merge(results);
+        return;
+    }
+
+    while (_is_running && client.IsOpen())
+    {
+        int64_t start_time_ns = pacer.WaitForNextSend();
+        if (!_is_running)
+        {
+            break;
+        }
+
+        _last_command_time_ns[is_on ? 1 : 0] = NowNs();
+        bool is_successful = SendWebSocketCommand(client, is_on, ++command_id, options.timeout_ms, message);
+        is_on = !is_on;
+
+        if (!is_successful)
+        {
+            result.error_count++;
+            continue;
+        }
+
+        result.latency_us.Record((NowNs() - start_time_ns) / 1000);
+        result.byte_count += message.size();
+    }
+
+    result_set.Merge(results);
+}
+
+static void HttpFloodWorker(const Options& options, int worker_index, ResultSet& result_set)
+{
+    std::map<std::string, OperationResult> results;
+    OperationResult& result = results["flood_http"];
+    HttpClient client(options.host, options.port, options.timeout_ms, options.source_address);
+    bool is_on = worker_index % 2 == 0;
+
+    while (_is_running)
+    {
+        int64_t start_time_ns = NowNs();
+        HttpClient::Response response = {};
+        bool is_successful = client.Request("POST", "/led", "application/json", StateRequest(is_on), response);
+        is_on = !is_on;
+
+        if (is_successful && response.status == 429)
+        {
+            result.throttled_count++;
+            continue;
+        }
+
+        if (!is_successful || response.status < 200 || response.status >= 300)
+        {
+            result.error_count++;
+            continue;
+        }
+
+        result.latency_us.Record((NowNs() - start_time_ns) / 1000);
+        result.byte_count += response.body_length;
+    }
+
+    result_set.Merge(results);
+}
+
+static void WebSocketFloodWorker(const Options& options, int worker_index, ResultSet& result_set)
+{
+    std::map<std::string, OperationResult> results;
+    OperationResult& result = results["flood_ws"];
+    bool is_on = worker_index % 2 == 0;
+    int64_t command_id = 0;
+
+    while (_is_running)
+    {
+        WebSocketClient client(options.host, options.port, options.timeout_ms, options.source_address);
+        std::string message;
+        if (!client.Connect("/wsled") || !client.ReceiveText(message, options.timeout_ms))
+        {
+            result.error_count++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+
+        while (_is_running && client.IsOpen())
+        {
+            int64_t start_time_ns = NowNs();
+            bool is_successful = SendWebSocketCommand(client, is_on, ++command_id, options.timeout_ms, message);
+            is_on = !is_on;
+
+            if (is_successful)
+            {
+                result.latency_us.Record((NowNs() - start_time_ns) / 1000);
+                result.byte_count += message.size();
+            }
+        }
+
+        // The server closes a flooding websocket, reconnect like a buggy retry loop would
+        if (_is_running)
+        {
+            result.throttled_count++;
+        }
+    }
+
+    result_set.Merge(results);
+}
+
+static void ListenerWorker(const Options& options, ResultSet& result_set)
+{
+    std::map<std::string, OperationResult> results;
+    OperationResult& result = results["ws_broadcast"];
+    WebSocketClient client(options.host, options.port, options.timeout_ms, options.source_address);
+
+    std::string message;
+    if (!client.Connect("/wsled") || !client.ReceiveText(message, options.timeout_ms))
+    {
+        result.error_count++;
+        result_set.Merge(results);
+        return;
+    }
+
+    while (_is_running && client.IsOpen())
+    {
+        if (!client.ReceiveText(message, 100))
+        {
+            continue;
+        }
+
+        int64_t receive_time_ns = NowNs();
+        bool is_on = message.find("\"on\"") != std::string::npos;
+        int64_t command_time_ns = _last_command_time_ns[is_on ? 1 : 0];
+        if (command_time_ns == 0)
+        {
+            continue;
+        }
+
+        result.latency_us.Record((receive_time_ns - command_time_ns) / 1000);
+        result.byte_count += message.size();
+    }
+
+    result_set.Merge(results);
+}
+
+static std::string FormatResults(const Options& options, const ResultSet& result_set, double elapsed_s)
+{
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"target\": \"" << options.host << ":" << options.port << "\",\n";
+    json << "  \"duration_s\": " << elapsed_s << ",\n";
+    json << "  \"config\": {\"http_connections\": " << options.http_connections
+         << ", \"websocket_connections\": " << options.websocket_connections
+         << ", \"listener_connections\": " << options.listener_connections
+         << ", \"rate_per_connection\": " << options.rate_per_connection
+         << ", \"led_weight\": " << options.led_weight
+         << ", \"asset_weight\": " << options.asset_weight
+         << ", \"flood_http_connections\": " << options.flood_http_connections
+         << ", \"flood_websocket_connections\": " << options.flood_websocket_connections << "},\n";
+    json << "  \"operations\": {";
+
+    bool is_first = true;
+    for (const std::pair<const std::string, OperationResult>& result : result_set.GetResults())
+    {
+        const HdrHistogram& latency = result.second.latency_us;
+        json << (is_first ? "\n" : ",\n");
+        json << "    \"" << result.first << "\": {\"count\": " << latency.GetCount()
+             << ", \"errors\": " << result.second.error_count
+             << ", \"throttled\": " << result.second.throttled_count
+             << ", \"bytes\": " << result.second.byte_count
+             << ", \"throughput_per_s\": " << latency.GetCount() / elapsed_s
+             << ", \"latency_us\": {\"min\": " << latency.GetMin()
+             << ", \"mean\": " << latency.GetMean()
+             << ", \"p50\": " << latency.GetValueAtPercentile(50)
+             << ", \"p90\": " << latency.GetValueAtPercentile(90)
+             << ", \"p99\": " << latency.GetValueAtPercentile(99)
+             << ", \"p99_9\": " << latency.GetValueAtPercentile(99.9)
+             << ", \"max\": " << latency.GetMax() << "}}";
+        is_first = false;
+    }
+
+    json << "\n  }\n}\n";
+    return json.str();
+}
+
+static bool ParseMix(const std::string& mix, Options& options)
+{
+    options.led_weight = 0;
+    options.asset_weight = 0;
+
+    std::istringstream mix_stream(mix);
+    std::string entry;
+    while (std::getline(mix_stream, entry, ','))
+    {
+        size_t separator = entry.find('=');
+        if (separator == std::string::npos)
+        {
+            return false;
+        }
+
+        std::string name = entry.substr(0, separator);
+        int weight = atoi(entry.c_str() + separator + 1);
+        if (name == "led")
+        {
+            options.led_weight = weight;
+        }
+        else if (name == "asset")
+        {
+            options.asset_weight = weight;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return options.led_weight + options.asset_weight > 0;
+}
+
+static void PrintUsage()
+{
+    std::cout <<
+        "Usage: LoadGenerator [options]\n"
+        "  --host <name>        Target host (default 127.0.0.1)\n"
+        "  --port <port>        Target port (default 80)\n"
+        "  --http <n>           HTTP connections driving the mix (default 4)\n"
+        "  --ws <n>             Websocket connections sending commands (default 4)\n"
+        "  --listeners <n>      Websocket connections measuring broadcast receipt (default 2)\n"
+        "  --duration <s>       Test duration in seconds (default 10)\n"
+        "  --rate <r>           Operations per second per connection, 0 = closed loop (default 0)\n"
+        "  --mix <spec>         HTTP mix weights e.g. led=70,asset=30\n"
+        "  --flood-http <n>     HTTP connections flooding /led as fast as possible (default 0)\n"
+        "  --flood-ws <n>       Websocket connections flooding /wsled, reconnecting when closed (default 0)\n"
+        "  --timeout-ms <ms>    Socket timeout (default 2000)\n"
+        "  --source <address>   Local address to connect from, e.g. 127.0.0.2 (default any)\n"
+        "  --output <path>      Write the JSON results to a file instead of stdout\n";
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (argument == "--help" || argument == "-h")
+        {
+            PrintUsage();
+            return 0;
+        }
+        else if (argument == "--host" && has_value)
+        {
+            options.host = argv[++i];
+        }
+        else if (argument == "--port" && has_value)
+        {
+            options.port = atoi(argv[++i]);
+        }
+        else if (argument == "--http" && has_value)
+        {
+            options.http_connections = atoi(argv[++i]);
+        }
+        else if (argument == "--ws" && has_value)
+        {
+            options.websocket_connections = atoi(argv[++i]);
+        }
+        else if (argument == "--listeners" && has_value)
+        {
+            options.listener_connections = atoi(argv[++i]);
+        }
+        else if (argument == "--duration" && has_value)
+        {
+            options.duration_s = atoi(argv[++i]);
+        }
+        else if (argument == "--rate" && has_value)
+        {
+            options.rate_per_connection = atof(argv[++i]);
+        }
+        else if (argument == "--flood-http" && has_value)
+        {
+            options.flood_http_connections = atoi(argv[++i]);
+        }
+        else if (argument == "--flood-ws" && has_value)
+        {
+            options.flood_websocket_connections = atoi(argv[++i]);
+        }
+        else if (argument == "--timeout-ms" && has_value)
+        {
+            options.timeout_ms = atoi(argv[++i]);
+        }
+        else if (argument == "--source" && has_value)
+        {
+            options.source_address = argv[++i];
+        }
+        else if (argument == "--output" && has_value)
+        {
+            options.output_path = argv[++i];
+        }
+        else if (argument == "--mix" && has_value)
+        {
+            if (!ParseMix(argv[++i], options))
+            {
+                std::cerr << "Invalid mix: " << argv[i] << "\n";
+                return 1;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown or incomplete option: " << argument << "\n";
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    ResultSet result_set;
+    std::vector<std::thread> workers;
+
+    // Listeners connect first so they see the broadcasts of the very first commands
+    for (int i = 0; i < options.listener_connections; i++)
+    {
+        workers.emplace_back(ListenerWorker, std::cref(options), std::ref(result_set));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    Clock::time_point start_time = Clock::now();
+    for (int i = 0; i < options.http_connections; i++)
+    {
+        workers.emplace_back(HttpWorker, std::cref(options), i, std::ref(result_set));
+    }
+    for (int i = 0; i < options.websocket_connections; i++)
+    {
+        workers.emplace_back(WebSocketWorker, std::cref(options), i, std::ref(result_set));
+    }
+    for (int i = 0; i < options.flood_http_connections; i++)
+    {
+        workers.emplace_back(HttpFloodWorker, std::cref(options), i, std::ref(result_set));
+    }
+    for (int i = 0; i < options.flood_websocket_connections; i++)
+    {
+        workers.emplace_back(WebSocketFloodWorker, std::cref(options), i, std::ref(result_set));
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(options.duration_s));
+    _is_running = false;
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    double elapsed_s = std::chrono::duration<double>(Clock::now() - start_time).count();
+    std::string results = FormatResults(options, result_set, elapsed_s);
+
+    if (options.output_path == "")
+    {
+        std::cout << results;
+        return 0;
+    }
+
+    std::ofstream output_file(options.output_path);
+    if (!output_file)
+    {
+        std::cerr << "Cannot write " << options.output_path << "\n";
+        return 1;
+    }
+    output_file << results;
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,345 @@
+// Checks the outbound queue and the reconnect backoff of the MQTT bridge on the host.
+//
+//   MqttBridgeHost [--seconds <n>]
+//
+// Unit checks cover coalescing, eviction when full, requeueing after a refused publish, the latency
+// of QoS 0 and acknowledged QoS 1 messages, and the backoff bounds. The simulation then replays the
+// publish task of the bridge against a scripted broker for <n> simulated seconds (600 by default):
+// bursts of state changes, telemetry every 10 s, acknowledgements after a random delay and a broker
+// that drops the connection now and then. It checks that the queue stays bounded, no state change
+// is lost for good and the broker ends with the last state.
+// The exit code is non zero if any check fails.
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "OutboundQueue.hpp"
+
+static int _failure_count = 0;
+
+static void Check(bool condition, const std::string& message)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << message << "\n";
+        _failure_count++;
+    }
+}
+
+static void CheckCoalescing()
+{
+    OutboundQueue queue(4);
+    Check(queue.Enqueue("a/state", "on", 0, false, 10), "coalescing: first enqueue");
+    Check(queue.Enqueue("a/state", "off", 1, true, 20), "coalescing: second enqueue");
+    Check(queue.Enqueue("a/telemetry", "{}", 0, false, 30), "coalescing: other topic");
+    Check(queue.GetLength() == 2, "coalescing: one message per topic");
+
+    OutboundMessage message;
+    Check(queue.Pop(message), "coalescing: pop");
+    Check(message.topic == "a/state" && message.payload == "off", "coalescing: the latest payload is kept");
+    Check(message.qos == 1 && message.retain, "coalescing: the strongest QoS and retain flag are kept");
+    Check(message.enqueued_time_us == 10, "coalescing: the latency counts from the first enqueue");
+    Check(queue.GetStatistics().coalesced_count == 1, "coalescing: counted");
+}
+
+static void CheckEviction()
+{
+    OutboundQueue queue(3);
+    queue.Enqueue("state", "on", 1, true, 0);
+    queue.Enqueue("telemetry", "1", 0, false, 0);
+    queue.Enqueue("other", "x", 1, false, 0);
+    Check(queue.Enqueue("new", "y", 1, false, 0), "eviction: a QoS 0 message makes room");
+    Check(queue.GetLength() == 3, "eviction: the length stays at the maximum");
+
+    OutboundMessage message;
+    std::vector<std::string> topics;
+    while (queue.Pop(message))
+    {
+        topics.push_back(message.topic);
+    }
+    Check(topics == std::vector<std::string>({"state", "other", "new"}), "eviction: the QoS 0 message was evicted");
+
+    queue.Enqueue("a", "1", 1, false, 0);
+    queue.Enqueue("b", "1", 1, false, 0);
+    queue.Enqueue("c", "1", 1, false, 0);
+    Check(!queue.Enqueue("d", "1", 1, false, 0), "eviction: without a QoS 0 message the new one is dropped");
+    Check(queue.Enqueue("a", "2", 1, false, 0), "eviction: coalescing still works when full");
+    Check(queue.GetStatistics().dropped_count == 2, "eviction: both drops counted");
+    Check(queue.GetStatistics().max_queue_depth == 3, "eviction: max depth");
+}
+
+static void CheckPublishFailure()
+{
+    OutboundQueue queue(4);
+    queue.Enqueue("state", "on", 1, true, 0);
+    queue.Enqueue("telemetry", "1", 0, false, 0);
+
+    OutboundMessage message;
+    queue.Pop(message);
+    queue.OnPublishFailed(message);
+    Check(queue.GetLength() == 2, "failure: a QoS 1 message is kept");
+
+    queue.Pop(message);
+    Check(message.topic == "state" && message.payload == "on", "failure: a kept message goes back to the front");
+    queue.Enqueue("state", "off", 1, true, 0);
+    queue.OnPublishFailed(message);
+    Check(queue.GetLength() == 2, "failure: a refused value is dropped when a newer one is pending");
+
+    OutboundMessage telemetry;
+    queue.Pop(telemetry);
+    queue.OnPublishFailed(telemetry);
+    Check(telemetry.topic == "telemetry" && queue.GetLength() == 1, "failure: a QoS 0 message is dropped");
+
+    queue.Pop(message);
+    Check(message.payload == "off", "failure: the newer value is sent");
+    Check(queue.GetStatistics().dropped_count == 2, "failure: both drops counted");
+}
+
+static void CheckLatency()
+{
+    OutboundQueue queue(4);
+    queue.Enqueue("telemetry", "1", 0, false, 1000);
+    queue.Enqueue("state", "on", 1, true, 2000);
+
+    OutboundMessage message;
+    queue.Pop(message);
+    queue.OnPublished(message, 0, 1500);
+    queue.Pop(message);
+    queue.OnPublished(message, 7, 2100);
+
+    OutboundQueueStatistics statistics = queue.GetStatistics();
+    Check(statistics.published_count == 2 && statistics.completed_count == 1, "latency: the QoS 1 message waits for its acknowledgement");
+    Check(statistics.total_publish_latency_us == 500, "latency: a QoS 0 message completes when it is handed over");
+
+    queue.OnAcknowledged(99, 9000);
+    Check(queue.GetStatistics().completed_count == 1, "latency: an unknown id is ignored");
+    queue.OnAcknowledged(7, 5000);
+    statistics = queue.GetStatistics();
+    Check(statistics.completed_count == 2 && statistics.total_publish_latency_us == 3500, "latency: the acknowledgement completes the message");
+    Check(statistics.max_publish_latency_us == 3000 && statistics.last_publish_latency_us == 3000, "latency: max and last");
+    queue.OnAcknowledged(7, 6000);
+    Check(queue.GetStatistics().completed_count == 2, "latency: a duplicate acknowledgement is ignored");
+
+    queue.Enqueue("state", "off", 1, true, 7000);
+    queue.Pop(message);
+    queue.OnPublished(message, 8, 7100);
+    queue.OnSessionLost();
+    Check(queue.GetInFlightCount() == 0, "latency: the session loss clears the messages in flight");
+    queue.OnAcknowledged(8, 8000);
+    Check(queue.GetStatistics().completed_count == 2, "latency: an acknowledgement of the old session is ignored");
+}
+
+static void CheckBackoff()
+{
+    const uint32_t initial_ms = 1000;
+    const uint32_t max_ms = 60000;
+
+    uint32_t expected_ms = initial_ms;
+    for (uint32_t attempt = 0; attempt < 100; attempt++)
+    {
+        // random % (delay / 2 + 1) spans 0 to delay / 2
+        ReconnectBackoff lowest_backoff(initial_ms, max_ms);
+        ReconnectBackoff highest_backoff(initial_ms, max_ms);
+        for (uint32_t i = 0; i < attempt; i++)
+        {
+            lowest_backoff.NextDelayMs(0);
+            highest_backoff.NextDelayMs(0);
+        }
+        uint32_t lowest_ms = lowest_backoff.NextDelayMs(0);
+        uint32_t highest_ms = highest_backoff.NextDelayMs(expected_ms / 2);
+
+        Check(lowest_ms == expected_ms / 2, "backoff: attempt " + std::to_string(attempt) + " waits at least " + std::to_string(lowest_ms) + " ms");
+        Check(highest_ms == expected_ms, "backoff: attempt " + std::to_string(attempt) + " waits at most " + std::to_string(highest_ms) + " ms");
+        expected_ms = std::min(max_ms, expected_ms * 2);
+    }
+
+    std::mt19937 random(7);
+    ReconnectBackoff backoff(initial_ms, max_ms);
+    for (int i = 0; i < 100000; i++)
+    {
+        uint32_t delay_ms = backoff.NextDelayMs(random());
+        if (delay_ms < initial_ms / 2 || delay_ms > max_ms)
+        {
+            Check(false, "backoff: delay " + std::to_string(delay_ms) + " ms out of range");
+            break;
+        }
+    }
+    Check(backoff.GetTotalAttemptCount() == 100000, "backoff: total attempts");
+
+    backoff.Reset();
+    Check(backoff.NextDelayMs(UINT32_MAX) <= initial_ms && backoff.GetAttemptCount() == 1, "backoff: a reset starts from the initial delay");
+    Check(backoff.GetTotalAttemptCount() == 100001, "backoff: a reset keeps the total");
+}
+
+/// @brief Replays the publish task of the bridge against a broker that acknowledges QoS 1 messages
+/// after a random delay and drops the connection now and then
+static void RunSimulation(int64_t duration_s)
+{
+    const int64_t tick_us = 1000;
+    const int64_t batch_window_us = 50000;
+    const int64_t telemetry_interval_us = 10000000;
+
+    std::mt19937 random(42);
+    OutboundQueue queue(16);
+    ReconnectBackoff backoff(1000, 60000);
+
+    bool is_connected = true;
+    int64_t reconnect_time_us = 0;
+    int next_message_id = 1;
+    // Acknowledgement time => message id, lost with the connection
+    std::multimap<int64_t, int> pending_acknowledgements;
+
+    std::string led_state = "off";
+    std::string broker_state = "";
+    std::string last_enqueued_state = "";
+    int64_t next_flush_time_us = -1;
+    int64_t next_telemetry_time_us = telemetry_interval_us;
+    int64_t next_change_time_us = 0;
+    size_t max_length = 0;
+    uint32_t state_change_count = 0;
+    uint32_t disconnect_count = 0;
+
+    for (int64_t now_us = 0; now_us < duration_s * 1000000; now_us += tick_us)
+    {
+        // Bursts of toggles from the web page and the wall button, then a quiet period
+        if (now_us >= next_change_time_us)
+        {
+            led_state = led_state == "on" ? "off" : "on";
+            state_change_count++;
+            queue.Enqueue("baobao/state", "{\"state\":\"" + led_state + "\"}", 1, true, now_us);
+            last_enqueued_state = led_state;
+            next_change_time_us = now_us + (random() % 10 == 0 ? 2000000 + random() % 8000000 : 1000 + random() % 30000);
+            if (next_flush_time_us < 0)
+            {
+                next_flush_time_us = now_us + batch_window_us;
+            }
+        }
+
+        if (now_us >= next_telemetry_time_us)
+        {
+            queue.Enqueue("baobao/telemetry", "{\"t\":" + std::to_string(now_us) + "}", 0, false, now_us);
+            next_telemetry_time_us += telemetry_interval_us;
+            if (next_flush_time_us < 0)
+            {
+                next_flush_time_us = now_us + batch_window_us;
+            }
+        }
+
+        while (!pending_acknowledgements.empty() && pending_acknowledgements.begin()->first <= now_us)
+        {
+            queue.OnAcknowledged(pending_acknowledgements.begin()->second, now_us);
+            pending_acknowledgements.erase(pending_acknowledgements.begin());
+        }
+
+        if (is_connected && random() % 20000 == 0)
+        {
+            is_connected = false;
+            disconnect_count++;
+            pending_acknowledgements.clear();
+            reconnect_time_us = now_us + (int64_t)backoff.NextDelayMs(random()) * 1000;
+        }
+        else if (!is_connected && now_us >= reconnect_time_us)
+        {
+            // One attempt in four fails and backs off further
+            if (random() % 4 == 0)
+            {
+                reconnect_time_us = now_us + (int64_t)backoff.NextDelayMs(random()) * 1000;
+            }
+            else
+            {
+                is_connected = true;
+                backoff.Reset();
+                queue.OnSessionLost();
+                queue.Enqueue("baobao/state", "{\"state\":\"" + led_state + "\"}", 1, true, now_us);
+                next_flush_time_us = now_us;
+            }
+        }
+
+        max_length = std::max(max_length, queue.GetLength());
+
+        if (next_flush_time_us < 0 || now_us < next_flush_time_us)
+        {
+            continue;
+        }
+        next_flush_time_us = -1;
+
+        OutboundMessage message;
+        while (is_connected && queue.Pop(message))
+        {
+            // The client refuses a publish now and then when its outbox is full
+            if (random() % 50 == 0)
+            {
+                queue.OnPublishFailed(message);
+                next_flush_time_us = now_us + batch_window_us;
+                break;
+            }
+
+            int message_id = message.qos > 0 ? next_message_id++ : 0;
+            queue.OnPublished(message, message_id, now_us);
+            if (message.qos > 0)
+            {
+                pending_acknowledgements.insert({now_us + 2000 + random() % 200000, message_id});
+            }
+            if (message.topic == "baobao/state")
+            {
+                broker_state = message.payload;
+            }
+        }
+    }
+
+    // Drain once connected, as the bridge does on MQTT_EVENT_CONNECTED
+    OutboundMessage message;
+    while (queue.Pop(message))
+    {
+        if (message.topic == "baobao/state")
+        {
+            broker_state = message.payload;
+        }
+    }
+
+    OutboundQueueStatistics statistics = queue.GetStatistics();
+    std::cout << "Simulated " << duration_s << " s: " << state_change_count << " state changes, " << disconnect_count << " disconnects\n"
+              << "  published " << statistics.published_count << ", completed " << statistics.completed_count
+              << ", coalesced " << statistics.coalesced_count << ", dropped " << statistics.dropped_count << "\n"
+              << "  max queue depth " << max_length << ", max latency " << statistics.max_publish_latency_us / 1000
+              << " ms, average " << statistics.total_publish_latency_us / std::max<uint32_t>(statistics.completed_count, 1) / 1000 << " ms\n";
+
+    Check(max_length <= 16, "simulation: the queue grew past its bound");
+    Check(broker_state == "{\"state\":\"" + last_enqueued_state + "\"}", "simulation: the broker does not hold the last state");
+    Check(statistics.coalesced_count > 0, "simulation: the bursts were not coalesced");
+    Check(statistics.completed_count <= statistics.published_count, "simulation: more completed than published messages");
+}
+
+int main(int argc, char** argv)
+{
+    int64_t duration_s = 600;
+    if (argc == 3 && strcmp(argv[1], "--seconds") == 0)
+    {
+        duration_s = std::max(atoll(argv[2]), 1LL);
+    }
+    else if (argc != 1)
+    {
+        std::cerr << "Usage: MqttBridgeHost [--seconds <n>]\n";
+        return 1;
+    }
+
+    CheckCoalescing();
+    CheckEviction();
+    CheckPublishFailure();
+    CheckLatency();
+    CheckBackoff();
+    RunSimulation(duration_s);
+
+    if (_failure_count > 0)
+    {
+        std::cerr << _failure_count << " checks failed\n";
+        return 1;
+    }
+    std::cout << "All checks passed\n";
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,273 @@
+// Benchmarks the validation every HTTP route runs before its handler and checks its decisions.
+//
+//   RequestPipelineBench [--iterations <n>]
+//
+// Checks: content type matching (case, parameters, prefixes), the order of the stages, the body
+// limit boundary, routes without a body type, and that a request never allocates on the pipeline.
+// Benchmark: runs <n> requests (1M by default) of each kind through two paths and prints the cost
+// per request and the heap allocations per request:
+//   legacy    the checks LedControlHttpHandler repeated before the route table: the Content-Type
+//             looked up twice, copied to the heap, compared with strcmp, and every rejection
+//             formatted at runtime (cJSON is not built on the host, the body is built with strings)
+//   pipeline  what HttpServer::ValidateRequest does: one lookup into a stack buffer and RequestPipeline
+// Both paths look headers up in the same model of the httpd header block. The request logging of the
+// legacy handler is left out, so its figures are a lower bound.
+// The exit code is non zero if any check fails.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <strings.h>
+#include "RequestPipeline.hpp"
+
+static int _failure_count = 0;
+static size_t _allocation_count = 0;
+
+void* operator new(size_t size)
+{
+    _allocation_count++;
+    void* memory = malloc(size ? size : 1);
+    if (!memory)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+static void Check(bool condition, const std::string& message)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << message << "\n";
+        _failure_count++;
+    }
+}
+
+struct Scenario
+{
+    const char* name;
+    // Header lines as httpd keeps them, separated by "\r\n"
+    const char* headers;
+    size_t content_length;
+    RequestLimits limits;
+};
+
+static const RequestLimits _json_limits = {CONTENT_TYPE_JSON, 256};
+static const RequestLimits _get_limits = {CONTENT_TYPE_NONE, 0};
+
+static const Scenario _scenarios[] = {
+    {"POST json",         "Host: led.local\r\nUser-Agent: curl/8.5.0\r\nAccept: */*\r\nContent-Type: application/json\r\n",                 16,   _json_limits},
+    {"POST missing type", "Host: led.local\r\nUser-Agent: curl/8.5.0\r\nAccept: */*\r\n",                                                   16,   _json_limits},
+    {"POST wrong type",   "Host: led.local\r\nUser-Agent: curl/8.5.0\r\nAccept: */*\r\nContent-Type: text/plain\r\n",                       16,   _json_limits},
+    {"POST too large",    "Host: led.local\r\nUser-Agent: curl/8.5.0\r\nAccept: */*\r\nContent-Type: application/json\r\n",                 4096, _json_limits},
+    {"GET",               "Host: led.local\r\nUser-Agent: Mozilla/5.0\r\nAccept: text/html\r\nAccept-Encoding: gzip\r\n",                   0,    _get_limits}
+};
+
+/// @brief Case insensitive header lookup over the whole block, as httpd_req_get_hdr_value_len and _str do
+/// @return The value without leading blanks, nullptr if there is no such header
+static const char* FindHeader(const char* headers, const char* name, size_t& output_length)
+{
+    size_t name_length = strlen(name);
+    for (const char* line = headers; *line != '\0';)
+    {
+        const char* line_end = strstr(line, "\r\n");
+        if (!line_end)
+        {
+            line_end = line + strlen(line);
+        }
+
+        if ((size_t)(line_end - line) > name_length && line[name_length] == ':' && strncasecmp(line, name, name_length) == 0)
+        {
+            const char* value = line + name_length + 1;
+            while (*value == ' ')
+            {
+                value++;
+            }
+            output_length = line_end - value;
+            return value;
+        }
+        line = *line_end != '\0' ? line_end + 2 : line_end;
+    }
+    return nullptr;
+}
+
+/// @brief Mirrors HttpServer::ValidateRequest
+static const PrecomputedResponse* ValidateWithPipeline(const Scenario& scenario)
+{
+    char content_type[REQUEST_CONTENT_TYPE_MAX_LENGTH + 1] = "";
+    RequestSummary request = {scenario.content_length, content_type};
+    if (scenario.limits.content_types != CONTENT_TYPE_NONE)
+    {
+        size_t length = 0;
+        const char* value = FindHeader(scenario.headers, "Content-Type", length);
+        if (!value)
+        {
+            request.content_type = nullptr;
+        }
+        else if (length < sizeof(content_type))
+        {
+            memcpy(content_type, value, length);
+            content_type[length] = '\0';
+        }
+    }
+    return RequestPipeline::Run(request, scenario.limits);
+}
+
+/// @brief The shape of ConstructFailedJsonResponse: a tree of heap nodes printed into a heap buffer
+static std::string FormatLegacyError(uint16_t error_status, const std::string& error_code, const std::string& error_message)
+{
+    std::string status = std::to_string(error_status);
+    return "{\n\t\"status\":\t" + status + ",\n\t\"error\":\t\"" + error_code + "\",\n\t\"message\":\t\"" + error_message + "\"\n}";
+}
+
+/// @brief The checks of the handlers before the route table
+/// @return Length of the error body, 0 to run the handler
+static size_t ValidateLegacy(const Scenario& scenario)
+{
+    if (scenario.limits.content_types == CONTENT_TYPE_NONE)
+    {
+        return 0;
+    }
+
+    size_t header_length = 0;
+    if (!FindHeader(scenario.headers, "Content-Type", header_length) || header_length == 0)
+    {
+        return FormatLegacyError(400, "Bad Request", "Must have header Content-Type").size();
+    }
+
+    std::unique_ptr<char[]> header_value(new char[header_length + 1]);
+    const char* value = FindHeader(scenario.headers, "Content-Type", header_length);
+    memcpy(header_value.get(), value, header_length);
+    header_value[header_length] = '\0';
+    if (strcmp(header_value.get(), "application/json") != 0)
+    {
+        return FormatLegacyError(400, "Bad Request", "Type must be application json").size();
+    }
+
+    if (scenario.content_length > scenario.limits.max_body_size)
+    {
+        return FormatLegacyError(413, "Payload Too Large", "The request body is too large").size();
+    }
+    return 0;
+}
+
+static const PrecomputedResponse* Validate(size_t content_length, const char* content_type, uint32_t content_types, size_t max_body_size)
+{
+    return RequestPipeline::Run({content_length, content_type}, {content_types, max_body_size});
+}
+
+static void RunChecks()
+{
+    Check(RequestPipeline::MatchContentType("application/json") == CONTENT_TYPE_JSON, "match: json");
+    Check(RequestPipeline::MatchContentType("Application/JSON; charset=utf-8") == CONTENT_TYPE_JSON, "match: case and parameters");
+    Check(RequestPipeline::MatchContentType("application/json\t;charset=utf-8") == CONTENT_TYPE_JSON, "match: tab before the parameters");
+    Check(RequestPipeline::MatchContentType("application/octet-stream") == CONTENT_TYPE_OCTET_STREAM, "match: octet stream");
+    Check(RequestPipeline::MatchContentType("application/jsonp") == CONTENT_TYPE_NONE, "match: longer type");
+    Check(RequestPipeline::MatchContentType("application/js") == CONTENT_TYPE_NONE, "match: prefix");
+    Check(RequestPipeline::MatchContentType("text/plain") == CONTENT_TYPE_NONE, "match: unknown type");
+    Check(RequestPipeline::MatchContentType("") == CONTENT_TYPE_NONE, "match: empty value");
+
+    Check(!Validate(16, "application/json", CONTENT_TYPE_JSON, 256), "pipeline: accepted");
+    Check(!Validate(256, "application/json", CONTENT_TYPE_JSON, 256), "pipeline: body exactly at the limit");
+    Check(Validate(257, "application/json", CONTENT_TYPE_JSON, 256) == &RequestPipeline::_payload_too_large_response, "pipeline: body over the limit");
+    Check(Validate(16, nullptr, CONTENT_TYPE_JSON, 256) == &RequestPipeline::_missing_content_type_response, "pipeline: missing type");
+    Check(Validate(16, "text/plain", CONTENT_TYPE_JSON, 256) == &RequestPipeline::_unsupported_content_type_response, "pipeline: wrong type");
+    Check(Validate(16, "", CONTENT_TYPE_JSON, 256) == &RequestPipeline::_unsupported_content_type_response, "pipeline: type too long to read");
+    Check(Validate(4096, nullptr, CONTENT_TYPE_JSON, 256) == &RequestPipeline::_payload_too_large_response, "pipeline: the size is checked first");
+    Check(!Validate(0, nullptr, CONTENT_TYPE_NONE, 0), "pipeline: a GET needs no type");
+    Check(Validate(1, nullptr, CONTENT_TYPE_NONE, 0) == &RequestPipeline::_payload_too_large_response, "pipeline: a GET with a body");
+    Check(!Validate(1024, "application/octet-stream", CONTENT_TYPE_JSON | CONTENT_TYPE_OCTET_STREAM, 0x38000), "pipeline: one of several types");
+
+    // An assets slot sized limit resolved at dispatch
+    Check(!Validate(0x38000, "application/octet-stream", CONTENT_TYPE_OCTET_STREAM, 0x38000), "pipeline: archive filling the slot");
+    Check(Validate(0x38001, "application/octet-stream", CONTENT_TYPE_OCTET_STREAM, 0x38000) == &RequestPipeline::_payload_too_large_response, "pipeline: archive over the slot");
+    Check(Validate(1, "application/octet-stream", CONTENT_TYPE_OCTET_STREAM, 0) == &RequestPipeline::_payload_too_large_response, "pipeline: no slot, no upload");
+
+    for (const PrecomputedResponse* response : {&RequestPipeline::_payload_too_large_response, &RequestPipeline::_missing_content_type_response,
+                                                &RequestPipeline::_unsupported_content_type_response})
+    {
+        Check(response->body_length == strlen(response->body), std::string("response: body length of ") + response->status);
+    }
+
+    const PrecomputedResponse* expected[] = {nullptr, &RequestPipeline::_missing_content_type_response, &RequestPipeline::_unsupported_content_type_response,
+                                             &RequestPipeline::_payload_too_large_response, nullptr};
+    for (size_t i = 0; i < sizeof(_scenarios) / sizeof(_scenarios[0]); i++)
+    {
+        size_t allocation_count = _allocation_count;
+        const PrecomputedResponse* rejection = ValidateWithPipeline(_scenarios[i]);
+        bool is_allocation_free = _allocation_count == allocation_count;
+        Check(rejection == expected[i], std::string("scenario: ") + _scenarios[i].name);
+        Check(is_allocation_free, std::string("scenario: no allocation for ") + _scenarios[i].name);
+        Check((ValidateLegacy(_scenarios[i]) == 0) == (expected[i] == nullptr), std::string("scenario: legacy agrees on ") + _scenarios[i].name);
+    }
+}
+
+static void RunBenchmark(size_t iteration_count)
+{
+    volatile size_t sink = 0;
+    printf("%-18s %12s %12s %14s %14s\n", "request", "legacy ns", "pipeline ns", "legacy allocs", "pipeline allocs");
+    for (const Scenario& scenario : _scenarios)
+    {
+        size_t allocation_count = _allocation_count;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iteration_count; i++)
+        {
+            sink = sink + ValidateLegacy(scenario);
+        }
+        double legacy_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iteration_count;
+        double legacy_allocations = (double)(_allocation_count - allocation_count) / iteration_count;
+
+        allocation_count = _allocation_count;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iteration_count; i++)
+        {
+            const PrecomputedResponse* rejection = ValidateWithPipeline(scenario);
+            sink = sink + (rejection ? rejection->body_length : 0);
+        }
+        double pipeline_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iteration_count;
+        double pipeline_allocations = (double)(_allocation_count - allocation_count) / iteration_count;
+
+        printf("%-18s %12.1f %12.1f %14.1f %14.1f\n", scenario.name, legacy_ns, pipeline_ns, legacy_allocations, pipeline_allocations);
+        Check(pipeline_allocations == 0, std::string("benchmark: no allocation for ") + scenario.name);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t iteration_count = 1000000;
+    if (argc == 3 && strcmp(argv[1], "--iterations") == 0)
+    {
+        iteration_count = strtoul(argv[2], nullptr, 0);
+    }
+    else if (argc != 1)
+    {
+        std::cerr << "Usage: RequestPipelineBench [--iterations <n>]\n";
+        return 1;
+    }
+
+    RunChecks();
+    RunBenchmark(iteration_count > 0 ? iteration_count : 1);
+
+    if (_failure_count > 0)
+    {
+        std::cerr << _failure_count << " checks failed\n";
+        return 1;
+    }
+    std::cout << "All checks passed\n";
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "RamFlashStorage.hpp"
+#include <algorithm>
+#include <cstring>
+
+RamFlashStorage::RamFlashStorage(size_t sector_size, size_t sector_count)
+    : _sector_size(sector_size), _sector_count(sector_count), _data(sector_size * sector_count, 0xFF), _erase_counts(sector_count, 0)
+{
+}
+
+size_t RamFlashStorage::GetSectorSize() const
+{
+    return _sector_size;
+}
+
+size_t RamFlashStorage::GetSectorCount() const
+{
+    return _sector_count;
+}
+
+bool RamFlashStorage::Read(size_t offset, void* output_data, size_t length)
+{
+    if (offset > _data.size() || length > _data.size() - offset)
+    {
+        return false;
+    }
+
+    memcpy(output_data, _data.data() + offset, length);
+    return true;
+}
+
+bool RamFlashStorage::Write(size_t offset, const void* data, size_t length)
+{
+    if (offset > _data.size() || length > _data.size() - offset)
+    {
+        return false;
+    }
+
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    size_t written_length = std::min(length, _write_budget);
+    for (size_t i = 0; i < written_length; i++)
+    {
+        uint8_t& cell = _data[offset + i];
+        if ((cell & bytes[i]) != bytes[i])
+        {
+            _violation_count++;
+            return false;
+        }
+        cell = bytes[i];
+    }
+
+    if (_write_budget != SIZE_MAX)
+    {
+        _write_budget -= written_length;
+    }
+    return written_length == length;
+}
+
+bool RamFlashStorage::EraseSector(size_t sector_index)
+{
+    if (sector_index >= _sector_count || _write_budget == 0)
+    {
+        return false;
+    }
+
+    memset(_data.data() + sector_index * _sector_size, 0xFF, _sector_size);
+    _erase_counts[sector_index]++;
+    return true;
+}
+
+void RamFlashStorage::SetWriteBudget(size_t bytes)
+{
+    _write_budget = bytes;
+}
+
+uint32_t RamFlashStorage::GetViolationCount() const
+{
+    return _violation_count;
+}
+
+uint32_t RamFlashStorage::GetMaxSectorEraseCount() const
+{
+    return *std::max_element(_erase_counts.begin(), _erase_counts.end());
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef RAMFLASHSTORAGE_HPP
+#define RAMFLASHSTORAGE_HPP
+
+#include <vector>
+#include "StateHistoryLog.hpp"
+
+/// @brief NOR flash in RAM. A write may only clear bits, anything else is counted as a violation
+/// and fails, the way a real chip would silently corrupt the data. A write budget simulates a power
+/// cut: the write that exhausts it is only partially applied.
+class RamFlashStorage : public HistoryStorage
+{
+public:
+    RamFlashStorage(size_t sector_size, size_t sector_count);
+
+    size_t GetSectorSize() const override;
+    size_t GetSectorCount() const override;
+    bool Read(size_t offset, void* output_data, size_t length) override;
+    bool Write(size_t offset, const void* data, size_t length) override;
+    bool EraseSector(size_t sector_index) override;
+
+    /// @brief Fail every write once this many more bytes were programmed, SIZE_MAX disables the cut
+    void SetWriteBudget(size_t bytes);
+
+    uint32_t GetViolationCount() const;
+    uint32_t GetMaxSectorEraseCount() const;
+
+private:
+    size_t _sector_size;
+    size_t _sector_count;
+    std::vector<uint8_t> _data;
+    std::vector<uint32_t> _erase_counts;
+    size_t _write_budget = SIZE_MAX;
+    uint32_t _violation_count = 0;
+};
+
+#endif
\ No newline at end of file
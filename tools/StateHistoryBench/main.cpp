@@ -0,0 +1,356 @@
+// Benchmarks the firmware state history log over a RAM model of NOR flash and checks what it returns.
+//
+//   StateHistoryBench [--events <n>]
+//
+// Checks, on a small partition so the ring wraps many times:
+//   every query matches a reference list of the appended events, clock jumps backwards included
+//   a remount resumes after the last chunk, a power cut during a flush only loses that batch
+//   no write ever needs a bit to go from 0 to 1
+// Benchmark: appends <n> events (1M by default) to a partition large enough to keep them all,
+// flushing whenever the log asks to, then queries the whole range, random day and week windows, and
+// the whole range again formatted the way GET /history streams it.
+// The exit code is non zero if any check fails.
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "RamFlashStorage.hpp"
+#include "StateHistoryLog.hpp"
+
+static int _failure_count = 0;
+
+static void Check(bool condition, const std::string& message)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << message << "\n";
+        _failure_count++;
+    }
+}
+
+static double GetElapsedSeconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// @brief A light switched a few times an hour, with bursts of fast toggling and a rare clock step backwards
+class EventGenerator
+{
+public:
+    EventGenerator(uint32_t seed)
+        : _random(seed)
+    {
+    }
+
+    HistoryEvent Next()
+    {
+        std::uniform_real_distribution<double> chance(0.0, 1.0);
+        double roll = chance(_random);
+        if (roll < 0.00005)
+        {
+            // NTP correcting a drifted clock, or the boot before the first synchronization
+            _time_ms -= std::uniform_int_distribution<int64_t>(1000, 3600 * 1000)(_random);
+        }
+        else if (roll < 0.05)
+        {
+            _time_ms += std::uniform_int_distribution<int64_t>(150, 900)(_random);
+        }
+        else
+        {
+            _time_ms += (int64_t)std::exponential_distribution<double>(1.0 / 1200000)(_random) + 1;
+        }
+
+        _state ^= 1;
+        return {_time_ms, _state};
+    }
+
+private:
+    std::mt19937 _random;
+    int64_t _time_ms = 1700000000000;
+    uint8_t _state = 0;
+};
+
+static std::vector<HistoryEvent> Collect(StateHistoryLog& log, int64_t from_ms, int64_t to_ms, StateHistoryLog::QueryResult& output_result)
+{
+    std::vector<HistoryEvent> events;
+    output_result = log.Query(from_ms, to_ms, [&](const HistoryEvent& event) {
+        events.push_back(event);
+        return true;
+    });
+    return events;
+}
+
+static bool IsSameEvent(const HistoryEvent& left, const HistoryEvent& right)
+{
+    return left.time_ms == right.time_ms && left.state == right.state;
+}
+
+/// @brief Compare random windows to the reference. The log keeps a suffix of it, the oldest sectors are recycled.
+static void CheckQueries(StateHistoryLog& log, const std::vector<HistoryEvent>& reference, size_t query_count, std::mt19937& random, const std::string& name)
+{
+    StateHistoryLog::QueryResult result;
+    std::vector<HistoryEvent> kept = Collect(log, INT64_MIN, INT64_MAX, result);
+    Check(result.is_complete && result.initial_state == -1, name + ": full range result");
+    if (reference.empty())
+    {
+        Check(kept.empty(), name + ": an empty log returned events");
+        return;
+    }
+
+    Check(!kept.empty() && kept.size() <= reference.size(), name + ": kept " + std::to_string(kept.size()) + " of " + std::to_string(reference.size()));
+    if (kept.empty() || kept.size() > reference.size())
+    {
+        return;
+    }
+
+    size_t first_kept = reference.size() - kept.size();
+    for (size_t i = 0; i < kept.size(); i++)
+    {
+        if (!IsSameEvent(kept[i], reference[first_kept + i]))
+        {
+            Check(false, name + ": event " + std::to_string(i) + " of " + std::to_string(kept.size()) + " differs from the reference of " + std::to_string(reference.size()));
+            return;
+        }
+    }
+
+    std::uniform_int_distribution<size_t> pick(first_kept, reference.size() - 1);
+    std::uniform_int_distribution<int64_t> jitter(-5000, 5000);
+    for (size_t query = 0; query < query_count; query++)
+    {
+        int64_t from_ms = reference[pick(random)].time_ms + jitter(random);
+        int64_t to_ms = reference[pick(random)].time_ms + jitter(random);
+        if (from_ms > to_ms)
+        {
+            std::swap(from_ms, to_ms);
+        }
+
+        int expected_initial_state = -1;
+        std::vector<HistoryEvent> expected;
+        for (size_t i = first_kept; i < reference.size(); i++)
+        {
+            if (reference[i].time_ms < from_ms)
+            {
+                expected_initial_state = reference[i].state;
+            }
+            else if (reference[i].time_ms <= to_ms)
+            {
+                expected.push_back(reference[i]);
+            }
+        }
+
+        std::vector<HistoryEvent> events = Collect(log, from_ms, to_ms, result);
+        bool is_same = events.size() == expected.size() && result.event_count == expected.size();
+        for (size_t i = 0; is_same && i < events.size(); i++)
+        {
+            is_same = IsSameEvent(events[i], expected[i]);
+        }
+
+        if (!is_same || result.initial_state != expected_initial_state)
+        {
+            Check(false, name + ": window " + std::to_string(from_ms) + ".." + std::to_string(to_ms) + " returned " + std::to_string(events.size()) +
+                         " events, expected " + std::to_string(expected.size()));
+            return;
+        }
+    }
+}
+
+/// @brief Append like the firmware: flush when the log asks to, plus a timer flush now and then
+static void AppendEvents(StateHistoryLog& log, EventGenerator& generator, std::vector<HistoryEvent>& reference, size_t count, std::mt19937& random)
+{
+    std::uniform_int_distribution<int> timer(0, 99);
+    for (size_t i = 0; i < count; i++)
+    {
+        HistoryEvent event = generator.Next();
+        reference.push_back(event);
+        if (log.Append(event.time_ms, event.state) || timer(random) == 0)
+        {
+            log.Flush();
+        }
+    }
+}
+
+static void RunChecks()
+{
+    std::mt19937 random(7);
+    EventGenerator generator(11);
+    std::vector<HistoryEvent> reference;
+
+    // 8 sectors keep about 9000 events, 100000 wrap the ring more than ten times
+    RamFlashStorage storage(4096, 8);
+    {
+        StateHistoryLog log(storage);
+        Check(log.Mount(), "mount of an erased partition");
+        CheckQueries(log, reference, 0, random, "empty");
+
+        AppendEvents(log, generator, reference, 100000, random);
+        CheckQueries(log, reference, 300, random, "wrapped ring with an unflushed batch");
+
+        StateHistoryLog::Statistics statistics = log.GetStatistics();
+        Check(statistics.dropped_count == 0 && statistics.write_error_count == 0, "no dropped events");
+        Check(statistics.appended_count == 100000, "appended count");
+        log.Flush();
+    }
+
+    {
+        StateHistoryLog log(storage);
+        Check(log.Mount(), "remount");
+        CheckQueries(log, reference, 100, random, "remount");
+        AppendEvents(log, generator, reference, 5000, random);
+        CheckQueries(log, reference, 100, random, "appended after the remount");
+        log.Flush();
+    }
+
+    // Power cut part way through the flushes that follow: before the first byte, inside a payload,
+    // and a few chunks later
+    const size_t write_budgets[] = {0, 1, 40, 200, 2000};
+    for (size_t budget : write_budgets)
+    {
+        std::string name = "power cut after " + std::to_string(budget) + " bytes";
+        {
+            StateHistoryLog log(storage);
+            Check(log.Mount(), name + ": mount");
+            AppendEvents(log, generator, reference, 3000, random);
+
+            storage.SetWriteBudget(budget);
+            for (size_t i = 0; i < 2000; i++)
+            {
+                HistoryEvent event = generator.Next();
+                reference.push_back(event);
+                if (log.Append(event.time_ms, event.state) && !log.Flush())
+                {
+                    break;
+                }
+            }
+
+            // Every flush after the cut fails, so the lost events are the newest ones
+            StateHistoryLog::Statistics statistics = log.GetStatistics();
+            Check(statistics.dropped_count > 0, name + ": the cut failed a flush");
+            reference.resize(reference.size() - statistics.dropped_count - statistics.pending_count);
+        }
+
+        storage.SetWriteBudget(SIZE_MAX);
+        StateHistoryLog log(storage);
+        Check(log.Mount(), name + ": mount after the cut");
+        CheckQueries(log, reference, 50, random, name);
+        AppendEvents(log, generator, reference, 2000, random);
+        CheckQueries(log, reference, 50, random, name + ", appended after it");
+        log.Flush();
+    }
+
+    Check(storage.GetViolationCount() == 0, "writes only cleared bits, " + std::to_string(storage.GetViolationCount()) + " violations");
+}
+
+static void RunBenchmark(size_t event_count)
+{
+    std::mt19937 random(3);
+    EventGenerator generator(5);
+    std::vector<HistoryEvent> events;
+    events.reserve(event_count);
+    for (size_t i = 0; i < event_count; i++)
+    {
+        events.push_back(generator.Next());
+    }
+
+    // 4 KB sectors as on the ESP32, enough of them to keep every event
+    size_t sector_count = event_count * 4 / 4096 + 16;
+    RamFlashStorage storage(4096, sector_count);
+    StateHistoryLog log(storage);
+    Check(log.Mount(), "benchmark mount");
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (const HistoryEvent& event : events)
+    {
+        if (log.Append(event.time_ms, event.state))
+        {
+            log.Flush();
+        }
+    }
+    log.Flush();
+    double append_seconds = GetElapsedSeconds(start);
+
+    StateHistoryLog::Statistics statistics = log.GetStatistics();
+    Check(statistics.flushed_count == event_count && statistics.dropped_count == 0, "benchmark kept every event");
+    printf("append:        %zu events, %.1f ns/event including flushes\n", event_count, append_seconds * 1e9 / event_count);
+    printf("flash:         %.2f bytes/event, %u flushes (%.0f events each), %u sector erases, %.0f events per erase\n",
+           (double)statistics.flash_bytes_written / event_count, statistics.flush_count, (double)event_count / statistics.flush_count,
+           statistics.erase_count, (double)event_count / statistics.erase_count);
+    printf("               %zu events would be %zu bytes as 9 byte records\n", event_count, event_count * 9);
+
+    StateHistoryLog::QueryResult result;
+    start = std::chrono::steady_clock::now();
+    std::vector<HistoryEvent> all = Collect(log, INT64_MIN, INT64_MAX, result);
+    double full_seconds = GetElapsedSeconds(start);
+    Check(all.size() == event_count, "benchmark full range returned every event");
+    printf("full range:    %.1f M events/s, %.1f ms\n", event_count / full_seconds / 1e6, full_seconds * 1000);
+
+    std::uniform_int_distribution<size_t> pick(0, event_count - 1);
+    const int64_t windows_ms[] = {24LL * 3600 * 1000, 7LL * 24 * 3600 * 1000};
+    const char* window_names[] = {"day", "week"};
+    for (size_t w = 0; w < 2; w++)
+    {
+        const size_t query_count = 1000;
+        uint64_t returned_count = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t query = 0; query < query_count; query++)
+        {
+            int64_t from_ms = events[pick(random)].time_ms;
+            result = log.Query(from_ms, from_ms + windows_ms[w], [](const HistoryEvent&) { return true; });
+            returned_count += result.event_count;
+        }
+        double seconds = GetElapsedSeconds(start);
+        printf("%-4s window:   %.1f us/query, %.0f events each\n", window_names[w], seconds * 1e6 / query_count, (double)returned_count / query_count);
+    }
+
+    // The JSON body of GET /history, formatted into a 1 KB chunk buffer that is handed to the socket when full
+    char chunk[1024];
+    size_t chunk_length = 0;
+    uint64_t body_length = 0;
+    start = std::chrono::steady_clock::now();
+    result = log.Query(INT64_MIN, INT64_MAX, [&](const HistoryEvent& event) {
+        if (chunk_length + 32 > sizeof(chunk))
+        {
+            body_length += chunk_length;
+            chunk_length = 0;
+        }
+        chunk_length += snprintf(chunk + chunk_length, sizeof(chunk) - chunk_length, "[%" PRId64 ",%d],", event.time_ms, event.state);
+        return true;
+    });
+    body_length += chunk_length;
+    double json_seconds = GetElapsedSeconds(start);
+    printf("json stream:   %.1f M events/s, %.1f MB of body\n", event_count / json_seconds / 1e6, body_length / 1e6);
+
+    Check(storage.GetViolationCount() == 0, "benchmark writes only cleared bits");
+}
+
+int main(int argc, char** argv)
+{
+    size_t event_count = 1000000;
+    if (argc == 3 && strcmp(argv[1], "--events") == 0)
+    {
+        event_count = strtoul(argv[2], nullptr, 0);
+    }
+    else if (argc != 1)
+    {
+        std::cerr << "Usage: StateHistoryBench [--events <n>]\n";
+        return 1;
+    }
+
+    RunChecks();
+    RunBenchmark(std::max<size_t>(event_count, 1));
+
+    if (_failure_count > 0)
+    {
+        std::cerr << _failure_count << " checks failed\n";
+        return 1;
+    }
+    std::cout << "All checks passed\n";
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "FakeTaskSource.hpp"
+#include <algorithm>
+#include <cstring>
+
+FakeTaskSource::FakeTaskSource(int core_count, uint32_t start_runtime)
+    : _core_count(core_count), _total_runtime(start_runtime)
+{
+    for (int core_id = 0; core_id < core_count; core_id++)
+    {
+        AddTask("IDLE" + std::to_string(core_id), core_id, 0, 768, 0, 0);
+    }
+}
+
+void FakeTaskSource::AddTask(const std::string& name, int8_t core_id, uint16_t cpu_permille, uint32_t stack_free_bytes, uint32_t stack_shrink_per_step, uint8_t priority)
+{
+    // Tasks start counting from zero, like a task created between two samples
+    _tasks.push_back({name, _next_task_number++, core_id, cpu_permille, stack_free_bytes, stack_shrink_per_step, priority, 0});
+}
+
+void FakeTaskSource::RemoveTask(const std::string& name)
+{
+    _tasks.erase(std::remove_if(_tasks.begin(), _tasks.end(), [&](const FakeTask& task) {
+        return task.name == name;
+    }), _tasks.end());
+}
+
+void FakeTaskSource::Advance(uint32_t elapsed_us)
+{
+    for (FakeTask& task : _tasks)
+    {
+        uint16_t cpu_permille = task.name.rfind("IDLE", 0) == 0 ? 1000 - GetBusyPermille(task.core_id) : task.cpu_permille;
+        task.runtime_counter += (uint64_t)elapsed_us * cpu_permille / 1000;
+        task.stack_free_bytes -= std::min(task.stack_free_bytes, task.stack_shrink_per_step);
+    }
+    _total_runtime += elapsed_us;
+
+    // A slow leak that also splits the largest block
+    _heap.free_bytes -= std::min<uint32_t>(_heap.free_bytes, 512);
+    _heap.minimum_free_bytes = std::min(_heap.minimum_free_bytes, _heap.free_bytes);
+    _heap.largest_free_block_bytes -= std::min<uint32_t>(_heap.largest_free_block_bytes, 2048);
+}
+
+size_t FakeTaskSource::ReadTasks(TaskCounters* output_tasks, size_t capacity, uint32_t& output_total_runtime)
+{
+    // uxTaskGetSystemState fails the same way when the array is too small
+    if (_tasks.size() > capacity)
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < _tasks.size(); i++)
+    {
+        const FakeTask& task = _tasks[i];
+        TaskCounters& counters = output_tasks[i];
+        memset(counters.name, 0, sizeof(counters.name));
+        strncpy(counters.name, task.name.c_str(), sizeof(counters.name) - 1);
+        counters.task_number = task.task_number;
+        counters.runtime_counter = task.runtime_counter;
+        counters.stack_free_bytes = task.stack_free_bytes;
+        counters.priority = task.priority;
+        counters.core_id = task.core_id;
+    }
+
+    output_total_runtime = _total_runtime;
+    return _tasks.size();
+}
+
+HeapCounters FakeTaskSource::ReadHeap()
+{
+    return _heap;
+}
+
+size_t FakeTaskSource::GetTaskCount() const
+{
+    return _tasks.size();
+}
+
+uint16_t FakeTaskSource::GetBusyPermille(int8_t core_id) const
+{
+    uint32_t busy_permille = 0;
+    for (const FakeTask& task : _tasks)
+    {
+        if (task.core_id == core_id && task.name.rfind("IDLE", 0) != 0)
+        {
+            busy_permille += task.cpu_permille;
+        }
+    }
+    return std::min<uint32_t>(busy_permille, 1000);
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef FAKETASKSOURCE_HPP
+#define FAKETASKSOURCE_HPP
+
+#include <string>
+#include <vector>
+#include "TaskSampler.hpp"
+
+/// @brief Stand in for FreeRTOS on the host. Tasks are given a fixed share of their core and a
+/// stack that shrinks over time, the clock is advanced explicitly by the caller.
+class FakeTaskSource : public TaskSampleSource
+{
+public:
+    struct FakeTask
+    {
+        std::string name;
+        uint32_t task_number;
+        int8_t core_id;
+        // Share of its core, the idle task of each core gets whatever is left
+        uint16_t cpu_permille;
+        uint32_t stack_free_bytes;
+        uint32_t stack_shrink_per_step;
+        uint8_t priority;
+        uint32_t runtime_counter;
+    };
+
+    /// @param start_runtime Runtime clock at the start, close to UINT32_MAX to exercise the wrap
+    FakeTaskSource(int core_count, uint32_t start_runtime);
+
+    void AddTask(const std::string& name, int8_t core_id, uint16_t cpu_permille, uint32_t stack_free_bytes, uint32_t stack_shrink_per_step, uint8_t priority);
+    void RemoveTask(const std::string& name);
+
+    /// @brief Let the tasks run for elapsed_us and leak a little heap
+    void Advance(uint32_t elapsed_us);
+
+    size_t ReadTasks(TaskCounters* output_tasks, size_t capacity, uint32_t& output_total_runtime) override;
+    HeapCounters ReadHeap() override;
+
+    size_t GetTaskCount() const;
+
+private:
+    int _core_count;
+    uint32_t _total_runtime;
+    uint32_t _next_task_number = 1;
+    std::vector<FakeTask> _tasks;
+    HeapCounters _heap = {180000, 180000, 110000};
+
+    uint16_t GetBusyPermille(int8_t core_id) const;
+};
+
+#endif
\ No newline at end of file
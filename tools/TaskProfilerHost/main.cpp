@@ -0,0 +1,170 @@
+// Drives the firmware task sampler with a scripted FreeRTOS stand in and checks what it reports.
+//
+//   TaskProfilerHost [--samples <n>]
+//
+// The script looks like the device: httpd, WiFi and the event loop on core 0, app_main and the
+// component tasks on core 1. The runtime clock starts just below UINT32_MAX so it wraps during the
+// run, httpd spikes half way, a task is created and another deleted. The last window is printed the
+// way /debug/tasks reports it. The exit code is non zero if any check fails.
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "FakeTaskSource.hpp"
+#include "TaskSampler.hpp"
+
+static int _failure_count = 0;
+
+static void Check(bool condition, const std::string& message)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << message << "\n";
+        _failure_count++;
+    }
+}
+
+static const TaskUsage* FindTask(const TaskSample& sample, const char* name)
+{
+    for (uint8_t i = 0; i < sample.task_count; i++)
+    {
+        if (strcmp(sample.tasks[i].name, name) == 0)
+        {
+            return &sample.tasks[i];
+        }
+    }
+    return nullptr;
+}
+
+static void PrintSample(const TaskSample& sample)
+{
+    std::cout << "t=" << sample.time_us / 1000 << " ms  heap free " << sample.heap.free_bytes
+              << "  minimum " << sample.heap.minimum_free_bytes
+              << "  largest block " << sample.heap.largest_free_block_bytes
+              << "  fragmentation " << (int)sample.heap_fragmentation_percent << "%\n";
+    std::cout << "  " << std::left << std::setw(16) << "task" << std::right << std::setw(6) << "core"
+              << std::setw(6) << "prio" << std::setw(8) << "cpu %" << std::setw(12) << "stack free\n";
+    for (uint8_t i = 0; i < sample.task_count; i++)
+    {
+        const TaskUsage& usage = sample.tasks[i];
+        std::cout << "  " << std::left << std::setw(16) << usage.name << std::right << std::setw(6) << (int)usage.core_id
+                  << std::setw(6) << (int)usage.priority << std::setw(8) << std::fixed << std::setprecision(1) << usage.cpu_permille / 10.0
+                  << std::setw(11) << usage.stack_free_bytes << "\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int sample_target = 15;
+    if (argc == 3 && strcmp(argv[1], "--samples") == 0)
+    {
+        sample_target = atoi(argv[2]);
+    }
+    else if (argc != 1)
+    {
+        std::cerr << "Usage: TaskProfilerHost [--samples <n>]\n";
+        return 1;
+    }
+
+    const int core_count = 2;
+    const uint32_t interval_us = 1000000;
+    FakeTaskSource source(core_count, UINT32_MAX - 3 * interval_us);
+    source.AddTask("httpd", 0, 250, 2400, 40, 5);
+    source.AddTask("wifi", 0, 120, 2000, 0, 23);
+    source.AddTask("sys_evt", 0, 10, 1200, 0, 20);
+    source.AddTask("esp_timer", 0, 20, 2100, 0, 22);
+    source.AddTask("main", 1, 5, 1800, 0, 1);
+    source.AddTask("mqtt_publish", 1, 30, 2600, 0, 5);
+    source.AddTask("group_sync", 1, 15, 2300, 0, 6);
+    source.AddTask("task_profiler", 1, 2, 1500, 0, 1);
+
+    TaskSampler sampler(source);
+    int64_t now_us = 0;
+    Check(!sampler.Sample(now_us), "the first sample must only prime the counters");
+
+    for (int step = 1; step <= sample_target; step++)
+    {
+        if (step == sample_target / 2)
+        {
+            source.RemoveTask("httpd");
+            source.AddTask("httpd_flood", 0, 700, 2400, 200, 5);
+        }
+        if (step == sample_target / 2 + 2)
+        {
+            source.RemoveTask("mqtt_publish");
+        }
+
+        source.Advance(interval_us);
+        now_us += interval_us;
+        Check(sampler.Sample(now_us), "sample " + std::to_string(step) + " was not stored");
+    }
+
+    size_t expected_count = sample_target < TASK_SAMPLER_WINDOW ? sample_target : TASK_SAMPLER_WINDOW;
+    Check(sampler.GetSampleCount() == expected_count, "the window holds " + std::to_string(sampler.GetSampleCount()) + " samples");
+
+    int64_t previous_time_us = -1;
+    const TaskSample* last_sample = nullptr;
+    std::vector<TaskSample> samples(TASK_SAMPLER_WINDOW);
+    size_t sample_count = sampler.CopySamples(samples.data(), samples.size());
+    Check(sample_count == expected_count, "copied " + std::to_string(sample_count) + " samples");
+    for (size_t sample_index = 0; sample_index < sample_count; sample_index++)
+    {
+        const TaskSample& sample = samples[sample_index];
+        Check(sample.time_us > previous_time_us, "samples are not oldest first");
+        previous_time_us = sample.time_us;
+        last_sample = &sample;
+
+        // Every core is fully accounted for, up to the rounding down of each task
+        for (int core_id = 0; core_id < core_count; core_id++)
+        {
+            uint32_t core_permille = 0;
+            for (uint8_t i = 0; i < sample.task_count; i++)
+            {
+                core_permille += sample.tasks[i].core_id == core_id ? sample.tasks[i].cpu_permille : 0;
+            }
+            Check(core_permille >= 1000u - sample.task_count && core_permille <= 1000,
+                  "core " + std::to_string(core_id) + " adds up to " + std::to_string(core_permille) + " permille");
+        }
+
+        const TaskUsage* flood = FindTask(sample, "httpd_flood");
+        const TaskUsage* httpd = FindTask(sample, "httpd");
+        Check(flood || httpd, "httpd is missing");
+        Check(!flood || (flood->cpu_permille >= 699 && flood->cpu_permille <= 700), "the httpd spike is not reported");
+        Check(!httpd || (httpd->cpu_permille >= 249 && httpd->cpu_permille <= 250), "httpd is not at 25%");
+    }
+
+    if (last_sample)
+    {
+        Check(!FindTask(*last_sample, "mqtt_publish"), "a deleted task is still reported");
+        Check(last_sample->heap_fragmentation_percent > 0, "the heap fragmentation is not computed");
+
+        PrintSample(*last_sample);
+    }
+
+    // Less room than samples: the newest ones
+    TaskSample newest_samples[2] = {};
+    size_t newest_count = sampler.CopySamples(newest_samples, 2);
+    Check(newest_count == (sample_count < 2 ? sample_count : 2), "copied the wrong number of newest samples");
+    Check(newest_count == 0 || newest_samples[newest_count - 1].time_us == samples[sample_count - 1].time_us, "the newest samples are not copied");
+
+    // More tasks than the sampler has room for: the sample is skipped, not truncated
+    while (source.GetTaskCount() <= TASK_SAMPLER_MAX_TASKS)
+    {
+        source.AddTask("filler" + std::to_string(source.GetTaskCount()), 1, 0, 1000, 0, 1);
+    }
+    source.Advance(interval_us);
+    Check(!sampler.Sample(now_us + interval_us), "a sample with too many tasks was stored");
+    Check(sampler.GetSkippedSampleCount() == 1, "the skipped sample is not counted");
+
+    if (_failure_count > 0)
+    {
+        std::cerr << _failure_count << " checks failed\n";
+        return 1;
+    }
+
+    std::cout << "All checks passed over " << sample_target << " samples\n";
+    return 0;
+}
\ No newline at end of file
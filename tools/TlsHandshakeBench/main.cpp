@@ -0,0 +1,547 @@
+// Benchmarks the TLS handshakes of the HTTPS server on the host and checks that resumption works.
+//
+//   TlsHandshakeBench [--handshakes <n>] [--write-credentials <directory>]
+//
+// Client and server run in one process over an in memory pipe, only the server side is timed: that is
+// the work the httpd task does for every new connection. Like esp-tls, the server sets up a fresh
+// mbedTLS config for every connection, with TLS 1.2 and session tickets as the firmware configures
+// them, and that setup is timed as well. For an ECDSA P-256 and an RSA-2048 self signed certificate it
+// runs <n> handshakes (50 by default) of each kind:
+//   full, preloaded    the firmware with CONFIG_ESP_HTTPS_SERVER_CERT_SELECT_HOOK: no buffers, the hook
+//                      hands out the credentials TlsCredentials parsed once
+//   resumed            the same server, the client presents the session ticket of an earlier handshake
+//   full, DER parse    the firmware without the hook: the DER buffers are parsed for every connection
+//   full, PEM parse    the same from PEM, what the server did before it was given DER
+// The exit code is non zero if any handshake fails or a resumed handshake still sends the certificate.
+//
+// --write-credentials also stores the ECDSA credentials for provisioning a device:
+//   cd <directory>
+//   python $IDF_PATH/components/nvs_flash/nvs_partition_gen/nvs_partition_gen.py generate tls_nvs.csv tls_nvs.bin 0x6000
+//   esptool.py write_flash 0x9000 tls_nvs.bin
+// This replaces the whole nvs partition (partitions.csv). Compare with the device afterwards:
+//   openssl s_time -connect baobao.local:443 -new -time 10
+//   openssl s_time -connect baobao.local:443 -reuse -time 10
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/ecp.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/rsa.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/ssl_ticket.h>
+#include <mbedtls/x509_crt.h>
+#include <psa/crypto.h>
+#include "TlsCredentials.hpp"
+
+// Lifetime of the tickets issued by esp-tls (CONFIG_ESP_TLS_SERVER_SESSION_TICKET_TIMEOUT)
+#ifndef TICKET_LIFETIME_S
+#define TICKET_LIFETIME_S 86400
+#endif
+
+// A handshake that needs more round trips than this is stuck
+#ifndef MAX_HANDSHAKE_STEPS
+#define MAX_HANDSHAKE_STEPS 64
+#endif
+
+static int _failure_count = 0;
+
+static mbedtls_entropy_context _entropy;
+static mbedtls_ctr_drbg_context _ctr_drbg;
+
+static void Check(bool condition, const std::string& message)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << message << "\n";
+        _failure_count++;
+    }
+}
+
+/// @brief One direction of the connection
+struct Pipe
+{
+    std::deque<uint8_t> data;
+    size_t written_bytes = 0;
+};
+
+/// @brief The pipes an endpoint reads from and writes to
+struct Endpoint
+{
+    Pipe* incoming;
+    Pipe* outgoing;
+};
+
+static int SendStatic(void* context, const unsigned char* data, size_t length)
+{
+    Endpoint* endpoint = reinterpret_cast<Endpoint*>(context);
+    endpoint->outgoing->data.insert(endpoint->outgoing->data.end(), data, data + length);
+    endpoint->outgoing->written_bytes += length;
+    return (int)length;
+}
+
+static int ReceiveStatic(void* context, unsigned char* output_data, size_t length)
+{
+    Endpoint* endpoint = reinterpret_cast<Endpoint*>(context);
+    if (endpoint->incoming->data.empty())
+    {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    }
+
+    size_t read_length = std::min(length, endpoint->incoming->data.size());
+    std::copy(endpoint->incoming->data.begin(), endpoint->incoming->data.begin() + read_length, output_data);
+    endpoint->incoming->data.erase(endpoint->incoming->data.begin(), endpoint->incoming->data.begin() + read_length);
+    return (int)read_length;
+}
+
+/// @brief Generated certificate and key in both encodings
+struct GeneratedCredentials
+{
+    std::string name;
+    std::vector<uint8_t> certificate_der;
+    std::vector<uint8_t> certificate_pem;
+    std::vector<uint8_t> private_key_der;
+    std::vector<uint8_t> private_key_pem;
+};
+
+struct HandshakeResult
+{
+    bool is_ok = false;
+    double server_seconds = 0;
+    size_t server_sent_bytes = 0;
+};
+
+static std::vector<uint8_t> TakeTail(const std::vector<uint8_t>& buffer, int length)
+{
+    return std::vector<uint8_t>(buffer.end() - length, buffer.end());
+}
+
+static std::vector<uint8_t> TakePem(const std::vector<uint8_t>& buffer)
+{
+    // The PEM writers leave a null terminated string at the start of the buffer
+    return std::vector<uint8_t>(buffer.begin(), buffer.begin() + strlen(reinterpret_cast<const char*>(buffer.data())));
+}
+
+static bool GenerateCredentials(bool is_ecdsa, GeneratedCredentials& output_credentials)
+{
+    output_credentials.name = is_ecdsa ? "ECDSA P-256" : "RSA-2048";
+
+    mbedtls_pk_context key;
+    mbedtls_pk_init(&key);
+    int error = mbedtls_pk_setup(&key, mbedtls_pk_info_from_type(is_ecdsa ? MBEDTLS_PK_ECKEY : MBEDTLS_PK_RSA));
+    if (error == 0)
+    {
+        error = is_ecdsa ? mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(key), mbedtls_ctr_drbg_random, &_ctr_drbg)
+                         : mbedtls_rsa_gen_key(mbedtls_pk_rsa(key), mbedtls_ctr_drbg_random, &_ctr_drbg, 2048, 65537);
+    }
+
+    mbedtls_x509write_cert writer;
+    mbedtls_x509write_crt_init(&writer);
+    unsigned char serial[] = {0x01};
+    if (error == 0)
+    {
+        mbedtls_x509write_crt_set_version(&writer, MBEDTLS_X509_CRT_VERSION_3);
+        mbedtls_x509write_crt_set_md_alg(&writer, MBEDTLS_MD_SHA256);
+        mbedtls_x509write_crt_set_subject_key(&writer, &key);
+        mbedtls_x509write_crt_set_issuer_key(&writer, &key);
+        error = mbedtls_x509write_crt_set_subject_name(&writer, "CN=baobao.local");
+    }
+    if (error == 0)
+    {
+        error = mbedtls_x509write_crt_set_issuer_name(&writer, "CN=baobao.local");
+    }
+    if (error == 0)
+    {
+        error = mbedtls_x509write_crt_set_serial_raw(&writer, serial, sizeof(serial));
+    }
+    if (error == 0)
+    {
+        error = mbedtls_x509write_crt_set_validity(&writer, "20240101000000", "20440101000000");
+    }
+
+    std::vector<uint8_t> buffer(4096);
+    int length = 0;
+    if (error == 0)
+    {
+        length = mbedtls_x509write_crt_der(&writer, buffer.data(), buffer.size(), mbedtls_ctr_drbg_random, &_ctr_drbg);
+        error = std::min(length, 0);
+    }
+    if (error == 0)
+    {
+        output_credentials.certificate_der = TakeTail(buffer, length);
+        std::fill(buffer.begin(), buffer.end(), 0);
+        error = mbedtls_x509write_crt_pem(&writer, buffer.data(), buffer.size(), mbedtls_ctr_drbg_random, &_ctr_drbg);
+    }
+    if (error == 0)
+    {
+        output_credentials.certificate_pem = TakePem(buffer);
+        length = mbedtls_pk_write_key_der(&key, buffer.data(), buffer.size());
+        error = std::min(length, 0);
+    }
+    if (error == 0)
+    {
+        output_credentials.private_key_der = TakeTail(buffer, length);
+        std::fill(buffer.begin(), buffer.end(), 0);
+        error = mbedtls_pk_write_key_pem(&key, buffer.data(), buffer.size());
+    }
+    if (error == 0)
+    {
+        output_credentials.private_key_pem = TakePem(buffer);
+    }
+
+    mbedtls_x509write_crt_free(&writer);
+    mbedtls_pk_free(&key);
+
+    Check(error == 0, output_credentials.name + ": generating the credentials failed with " + std::to_string(error));
+    return error == 0;
+}
+
+/// @brief What esp-tls sets up for every connection before the credentials
+static void SetupServerConfig(mbedtls_ssl_config& config, mbedtls_ssl_ticket_context& ticket_context)
+{
+    mbedtls_ssl_config_init(&config);
+    mbedtls_ssl_config_defaults(&config, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    mbedtls_ssl_conf_rng(&config, mbedtls_ctr_drbg_random, &_ctr_drbg);
+    mbedtls_ssl_conf_max_tls_version(&config, MBEDTLS_SSL_VERSION_TLS1_2);
+    mbedtls_ssl_conf_session_tickets_cb(&config, mbedtls_ssl_ticket_write, mbedtls_ssl_ticket_parse, &ticket_context);
+}
+
+/// @brief Run one handshake to completion, alternating between client and server
+/// @param resume_session Session to resume, nullptr for a full handshake
+/// @param output_session Receives the session of the client, nullptr if not needed
+static HandshakeResult RunHandshake(const mbedtls_ssl_config& server_config, const mbedtls_ssl_config& client_config,
+                                    const mbedtls_ssl_session* resume_session, mbedtls_ssl_session* output_session)
+{
+    HandshakeResult result;
+    Pipe client_to_server;
+    Pipe server_to_client;
+    Endpoint server_endpoint = {&client_to_server, &server_to_client};
+    Endpoint client_endpoint = {&server_to_client, &client_to_server};
+
+    mbedtls_ssl_context server;
+    mbedtls_ssl_context client;
+    mbedtls_ssl_init(&server);
+    mbedtls_ssl_init(&client);
+
+    int server_status = mbedtls_ssl_setup(&server, &server_config);
+    int client_status = mbedtls_ssl_setup(&client, &client_config);
+    if (server_status == 0 && client_status == 0)
+    {
+        mbedtls_ssl_set_bio(&server, &server_endpoint, SendStatic, ReceiveStatic, NULL);
+        mbedtls_ssl_set_bio(&client, &client_endpoint, SendStatic, ReceiveStatic, NULL);
+        client_status = mbedtls_ssl_set_hostname(&client, "baobao.local");
+    }
+    if (client_status == 0 && resume_session)
+    {
+        client_status = mbedtls_ssl_set_session(&client, resume_session);
+    }
+
+    server_status = server_status == 0 ? MBEDTLS_ERR_SSL_WANT_READ : server_status;
+    client_status = client_status == 0 ? MBEDTLS_ERR_SSL_WANT_READ : client_status;
+    for (int step = 0; step < MAX_HANDSHAKE_STEPS && (server_status != 0 || client_status != 0); step++)
+    {
+        if (client_status == MBEDTLS_ERR_SSL_WANT_READ || client_status == MBEDTLS_ERR_SSL_WANT_WRITE)
+        {
+            client_status = mbedtls_ssl_handshake(&client);
+        }
+
+        if (server_status == MBEDTLS_ERR_SSL_WANT_READ || server_status == MBEDTLS_ERR_SSL_WANT_WRITE)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            server_status = mbedtls_ssl_handshake(&server);
+            result.server_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        bool is_client_failed = client_status != 0 && client_status != MBEDTLS_ERR_SSL_WANT_READ && client_status != MBEDTLS_ERR_SSL_WANT_WRITE;
+        bool is_server_failed = server_status != 0 && server_status != MBEDTLS_ERR_SSL_WANT_READ && server_status != MBEDTLS_ERR_SSL_WANT_WRITE;
+        if (is_client_failed || is_server_failed)
+        {
+            break;
+        }
+    }
+
+    result.is_ok = server_status == 0 && client_status == 0;
+    result.server_sent_bytes = server_to_client.written_bytes;
+    if (!result.is_ok)
+    {
+        std::cerr << "Handshake failed, server " << server_status << ", client " << client_status << "\n";
+    }
+    else if (output_session)
+    {
+        result.is_ok = mbedtls_ssl_get_session(&client, output_session) == 0;
+    }
+
+    mbedtls_ssl_free(&client);
+    mbedtls_ssl_free(&server);
+    return result;
+}
+
+/// @brief Collected handshakes of one kind
+struct Measurement
+{
+    std::vector<double> seconds;
+    size_t server_sent_bytes = 0;
+    bool is_ok = true;
+
+    void Add(const HandshakeResult& result, double seconds_value)
+    {
+        is_ok = is_ok && result.is_ok;
+        seconds.push_back(seconds_value);
+        server_sent_bytes = result.server_sent_bytes;
+    }
+
+    double GetMedianMs() const
+    {
+        std::vector<double> sorted = seconds;
+        std::sort(sorted.begin(), sorted.end());
+        return sorted.empty() ? 0 : sorted[sorted.size() / 2] * 1000;
+    }
+
+    double GetMaxMs() const
+    {
+        return seconds.empty() ? 0 : *std::max_element(seconds.begin(), seconds.end()) * 1000;
+    }
+};
+
+static void Report(const std::string& credentials_name, const std::string& kind, const Measurement& measurement)
+{
+    char line[160];
+    snprintf(line, sizeof(line), "%-12s %-20s median %8.3f ms  max %8.3f ms  %5zu bytes from the server",
+             credentials_name.c_str(), kind.c_str(), measurement.GetMedianMs(), measurement.GetMaxMs(), measurement.server_sent_bytes);
+    std::cout << line << "\n";
+    Check(measurement.is_ok, credentials_name + ": a " + kind + " handshake failed");
+}
+
+/// @brief One connection to the firmware server with the certificate hook. The config holds no
+/// credentials, the hook hands out the activated TlsCredentials.
+static HandshakeResult RunPreloadedHandshake(mbedtls_ssl_ticket_context& ticket_context, const mbedtls_ssl_config& client_config,
+                                             const mbedtls_ssl_session* resume_session, mbedtls_ssl_session* output_session)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    mbedtls_ssl_config server_config;
+    SetupServerConfig(server_config, ticket_context);
+    mbedtls_ssl_conf_cert_cb(&server_config, &TlsCredentials::SelectCertificateStatic);
+    double setup_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    HandshakeResult result = RunHandshake(server_config, client_config, resume_session, output_session);
+    result.server_seconds += setup_seconds;
+    mbedtls_ssl_config_free(&server_config);
+    return result;
+}
+
+/// @brief Parse the credentials into a fresh server config for every connection, what esp-tls does
+/// without the certificate hook, then run the handshake. Parsing is part of the measured time.
+static Measurement MeasureParsePerConnection(const std::vector<uint8_t>& certificate, const std::vector<uint8_t>& private_key,
+                                             mbedtls_ssl_ticket_context& ticket_context, const mbedtls_ssl_config& client_config,
+                                             size_t handshake_count)
+{
+    // mbedTLS only takes a PEM with its null terminator counted in the length
+    std::vector<uint8_t> certificate_buffer = certificate;
+    std::vector<uint8_t> key_buffer = private_key;
+    if (certificate_buffer.front() == '-')
+    {
+        certificate_buffer.push_back(0);
+        key_buffer.push_back(0);
+    }
+
+    Measurement measurement;
+    for (size_t i = 0; i < handshake_count; i++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        mbedtls_x509_crt parsed_certificate;
+        mbedtls_pk_context parsed_key;
+        mbedtls_x509_crt_init(&parsed_certificate);
+        mbedtls_pk_init(&parsed_key);
+        mbedtls_ssl_config server_config;
+        SetupServerConfig(server_config, ticket_context);
+
+        int error = mbedtls_x509_crt_parse(&parsed_certificate, certificate_buffer.data(), certificate_buffer.size());
+        if (error == 0)
+        {
+            error = mbedtls_pk_parse_key(&parsed_key, key_buffer.data(), key_buffer.size(), NULL, 0, mbedtls_ctr_drbg_random, &_ctr_drbg);
+        }
+        if (error == 0)
+        {
+            error = mbedtls_ssl_conf_own_cert(&server_config, &parsed_certificate, &parsed_key);
+        }
+        double parse_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        Check(error == 0, "Parsing per connection failed with " + std::to_string(error));
+
+        HandshakeResult result = RunHandshake(server_config, client_config, nullptr, nullptr);
+        measurement.Add(result, parse_seconds + result.server_seconds);
+
+        mbedtls_ssl_config_free(&server_config);
+        mbedtls_pk_free(&parsed_key);
+        mbedtls_x509_crt_free(&parsed_certificate);
+    }
+    return measurement;
+}
+
+static void RunBenchmark(const GeneratedCredentials& generated, size_t handshake_count)
+{
+    TlsCredentials credentials;
+    std::string error_message;
+    if (!credentials.Load(generated.certificate_der.data(), generated.certificate_der.size(),
+                          generated.private_key_der.data(), generated.private_key_der.size(), error_message))
+    {
+        Check(false, generated.name + ": " + error_message);
+        return;
+    }
+    Check(credentials.IsEcdsa() == (generated.name.rfind("ECDSA", 0) == 0), generated.name + ": wrong key type");
+    Check(credentials.GetCertificateDerLength() == generated.certificate_der.size(), generated.name + ": certificate length");
+
+    // The ticket keys live as long as the server, esp-tls creates them in httpd_ssl_start
+    mbedtls_ssl_ticket_context ticket_context;
+    mbedtls_ssl_ticket_init(&ticket_context);
+    Check(mbedtls_ssl_ticket_setup(&ticket_context, mbedtls_ctr_drbg_random, &_ctr_drbg, MBEDTLS_CIPHER_AES_256_GCM, TICKET_LIFETIME_S) == 0,
+          generated.name + ": ticket setup");
+    credentials.Activate();
+
+    // A browser does not verify a self signed certificate either until the user accepted it
+    mbedtls_ssl_config client_config;
+    mbedtls_ssl_config_init(&client_config);
+    mbedtls_ssl_config_defaults(&client_config, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    mbedtls_ssl_conf_rng(&client_config, mbedtls_ctr_drbg_random, &_ctr_drbg);
+    mbedtls_ssl_conf_authmode(&client_config, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_max_tls_version(&client_config, MBEDTLS_SSL_VERSION_TLS1_2);
+    mbedtls_ssl_conf_session_tickets(&client_config, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+
+    Measurement full;
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    for (size_t i = 0; i < handshake_count; i++)
+    {
+        HandshakeResult result = RunPreloadedHandshake(ticket_context, client_config, nullptr, i == 0 ? &session : nullptr);
+        full.Add(result, result.server_seconds);
+    }
+
+    Measurement resumed;
+    for (size_t i = 0; i < handshake_count && full.is_ok; i++)
+    {
+        HandshakeResult result = RunPreloadedHandshake(ticket_context, client_config, &session, nullptr);
+        resumed.Add(result, result.server_seconds);
+    }
+
+    Measurement der_parse = MeasureParsePerConnection(generated.certificate_der, generated.private_key_der, ticket_context, client_config, handshake_count);
+    Measurement pem_parse = MeasureParsePerConnection(generated.certificate_pem, generated.private_key_pem, ticket_context, client_config, handshake_count);
+
+    Report(generated.name, "full, preloaded", full);
+    Report(generated.name, "resumed", resumed);
+    Report(generated.name, "full, DER parse", der_parse);
+    Report(generated.name, "full, PEM parse", pem_parse);
+    Check(resumed.server_sent_bytes + generated.certificate_der.size() < full.server_sent_bytes,
+          generated.name + ": the resumed handshake sent " + std::to_string(resumed.server_sent_bytes) + " bytes, it was not resumed");
+    if (resumed.GetMedianMs() > 0)
+    {
+        std::cout << generated.name << ": resumption is " << full.GetMedianMs() / resumed.GetMedianMs()
+                  << "x faster than a full handshake, the hook saves " << der_parse.GetMedianMs() - full.GetMedianMs() << " ms over parsing DER\n";
+    }
+
+    mbedtls_ssl_session_free(&session);
+    mbedtls_ssl_config_free(&client_config);
+    mbedtls_ssl_ticket_free(&ticket_context);
+}
+
+static bool WriteFile(const std::string& path, const std::string& data)
+{
+    std::ofstream file(path, std::ios::binary);
+    file.write(data.data(), data.size());
+    return (bool)file;
+}
+
+static bool WriteProvisioning(const std::string& directory, const GeneratedCredentials& credentials)
+{
+    // nvs_partition_gen.py resolves the file paths relative to the working directory
+    std::string nvs_csv =
+        "key,type,encoding,value\n"
+        "tls,namespace,,\n"
+        "cert,file,binary,tls_cert.der\n"
+        "key,file,binary,tls_key.der\n";
+
+    bool is_written = WriteFile(directory + "/tls_cert.der", std::string(credentials.certificate_der.begin(), credentials.certificate_der.end())) &&
+                      WriteFile(directory + "/tls_key.der", std::string(credentials.private_key_der.begin(), credentials.private_key_der.end())) &&
+                      WriteFile(directory + "/tls_nvs.csv", nvs_csv);
+    if (!is_written)
+    {
+        std::cerr << "Cannot write the credentials to " << directory << "\n";
+        return false;
+    }
+
+    std::cout << "Wrote the " << credentials.name << " credentials to " << directory << "\n";
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    size_t handshake_count = 50;
+    std::string credentials_directory = "";
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--handshakes") == 0)
+        {
+            handshake_count = std::max<size_t>(strtoul(argv[++i], nullptr, 0), 1);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--write-credentials") == 0)
+        {
+            credentials_directory = argv[++i];
+        }
+        else
+        {
+            std::cerr << "Usage: TlsHandshakeBench [--handshakes <n>] [--write-credentials <directory>]\n";
+            return 1;
+        }
+    }
+
+    // mbedTLS 3.6 runs parts of TLS on the PSA crypto API
+    if (psa_crypto_init() != PSA_SUCCESS)
+    {
+        std::cerr << "psa_crypto_init failed\n";
+        return 1;
+    }
+
+    mbedtls_entropy_init(&_entropy);
+    mbedtls_ctr_drbg_init(&_ctr_drbg);
+    const char* personalization = "TlsHandshakeBench";
+    if (mbedtls_ctr_drbg_seed(&_ctr_drbg, mbedtls_entropy_func, &_entropy,
+                              reinterpret_cast<const unsigned char*>(personalization), strlen(personalization)) != 0)
+    {
+        std::cerr << "Seeding the random generator failed\n";
+        return 1;
+    }
+
+    GeneratedCredentials ecdsa_credentials;
+    GeneratedCredentials rsa_credentials;
+    if (GenerateCredentials(true, ecdsa_credentials))
+    {
+        RunBenchmark(ecdsa_credentials, handshake_count);
+    }
+    if (GenerateCredentials(false, rsa_credentials))
+    {
+        RunBenchmark(rsa_credentials, handshake_count);
+    }
+
+    if (!credentials_directory.empty() && !ecdsa_credentials.certificate_der.empty() && !WriteProvisioning(credentials_directory, ecdsa_credentials))
+    {
+        _failure_count++;
+    }
+
+    mbedtls_ctr_drbg_free(&_ctr_drbg);
+    mbedtls_entropy_free(&_entropy);
+
+    if (_failure_count > 0)
+    {
+        std::cerr << _failure_count << " checks failed\n";
+        return 1;
+    }
+    std::cout << "All checks passed\n";
+    return 0;
+}
\ No newline at end of file